@@ -0,0 +1,202 @@
+#include "checkpoint.h"
+#include "log.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHECKPOINT_MAGIC   "ERODRCKP"
+#define CHECKPOINT_VERSION 1
+
+/*
+ * On-disk header. It is followed by the raw `SimulationParameters` and the
+ * heightmap as `width * height` native floats.
+ */
+typedef struct CheckpointHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t params_size;
+    int32_t width;
+    int32_t height;
+    uint64_t seed;
+    int64_t n_simulated;
+    double eroded;
+    double deposited;
+} CheckpointHeader;
+
+int checkpoint_write(const char *filepath, const Checkpoint *ckpt)
+{
+    size_t len = strlen(filepath);
+    char *tmp_filepath = malloc(len + sizeof(".tmp"));
+    if (tmp_filepath == NULL) {
+        return -1;
+    }
+    memcpy(tmp_filepath, filepath, len);
+    memcpy(tmp_filepath + len, ".tmp", sizeof(".tmp"));
+
+    FILE *fp = fopen(tmp_filepath, "wb");
+    if (fp == NULL) {
+        free(tmp_filepath);
+        return -1;
+    }
+
+    CheckpointHeader header = {
+        .version     = CHECKPOINT_VERSION,
+        .params_size = sizeof(SimulationParameters),
+        .width       = ckpt->hmap.width,
+        .height      = ckpt->hmap.height,
+        .seed        = ckpt->seed,
+        .n_simulated = ckpt->n_simulated,
+        .eroded      = ckpt->eroded,
+        .deposited   = ckpt->deposited,
+    };
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+              fwrite(&ckpt->params, sizeof(ckpt->params), 1, fp) == 1;
+    for (int y = 0; ok && y < ckpt->hmap.height; y++) {
+        const float *row = &ckpt->hmap.data[y * ckpt->hmap.stride];
+        ok = fwrite(row, sizeof(float), ckpt->hmap.width, fp) == (size_t) ckpt->hmap.width;
+    }
+    ok = (fclose(fp) == 0) && ok;
+
+#ifdef _WIN32
+    /* rename doesn't replace existing files on windows */
+    if (ok) remove(filepath);
+#endif
+    ok = ok && (rename(tmp_filepath, filepath) == 0);
+    if (!ok) {
+        remove(tmp_filepath);
+    }
+    free(tmp_filepath);
+    return ok ? 0 : -1;
+}
+
+int checkpoint_load(const char *filepath, Checkpoint *ckpt)
+{
+    FILE *fp = fopen(filepath, "rb");
+    if (fp == NULL) {
+        return -1;
+    }
+
+    CheckpointHeader header;
+    if (fread(&header, sizeof(header), 1, fp) != 1 ||
+        memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != CHECKPOINT_VERSION ||
+        header.params_size != sizeof(SimulationParameters) ||
+        header.width <= 0 || header.height <= 0) {
+        log_error("Error: `%s` is not a valid checkpoint for this version of erodr.", filepath);
+        fclose(fp);
+        return -1;
+    }
+
+    *ckpt = (Checkpoint) {
+        .seed        = header.seed,
+        .n_simulated = header.n_simulated,
+        .eroded      = header.eroded,
+        .deposited   = header.deposited,
+        .hmap        = image_alloc(header.width, header.height),
+    };
+    size_t size = (size_t) header.width * header.height;
+    if (ckpt->hmap.data == NULL ||
+        fread(&ckpt->params, sizeof(ckpt->params), 1, fp) != 1 ||
+        fread(ckpt->hmap.data, sizeof(float), size, fp) != size) {
+        log_error("Error: could not read checkpoint `%s`.", filepath);
+        checkpoint_free(ckpt);
+        fclose(fp);
+        return -1;
+    }
+
+    fclose(fp);
+    return 0;
+}
+
+void checkpoint_free(Checkpoint *ckpt)
+{
+    image_free(&ckpt->hmap);
+    ckpt->hmap = (ErodrImage) {0};
+}
+
+static void *checkpoint_writer_run(void *arg)
+{
+    CheckpointWriter *w = (CheckpointWriter *) arg;
+    trace_set_thread_name("checkpoint writer");
+    pthread_mutex_lock(&w->mutex);
+    while (true) {
+        while (!w->busy && !w->quit) {
+            pthread_cond_wait(&w->cvar, &w->mutex);
+        }
+        if (!w->busy) {
+            break; /* quit */
+        }
+        pthread_mutex_unlock(&w->mutex);
+
+        double t_trace = trace_begin();
+        int err = checkpoint_write(w->filepath, &w->pending);
+        trace_end_n("write checkpoint", "io", t_trace, w->pending.n_simulated);
+        if (err == 0) {
+            log_info("Checkpoint written to `%s` (%ld particles).", w->filepath, (long) w->pending.n_simulated);
+        } else {
+            log_error("Error: could not write checkpoint `%s`.", w->filepath);
+        }
+
+        pthread_mutex_lock(&w->mutex);
+        w->busy = false;
+        pthread_cond_broadcast(&w->cvar);
+    }
+    pthread_mutex_unlock(&w->mutex);
+    return NULL;
+}
+
+int checkpoint_writer_start(CheckpointWriter *w, const char *filepath)
+{
+    *w = (CheckpointWriter) {0};
+    w->filepath = filepath;
+    int err  = pthread_mutex_init(&w->mutex, NULL);
+    err     |= pthread_cond_init(&w->cvar, NULL);
+    err     |= pthread_create(&w->thread, NULL, checkpoint_writer_run, w);
+    return err;
+}
+
+bool checkpoint_writer_submit(CheckpointWriter *w, const Checkpoint *ckpt)
+{
+    pthread_mutex_lock(&w->mutex);
+    bool busy = w->busy;
+    pthread_mutex_unlock(&w->mutex);
+    if (busy) {
+        return false;
+    }
+
+    /* the writer thread doesn't touch `pending` while it's not busy */
+    ErodrImage buffer = w->pending.hmap;
+    if (buffer.width != ckpt->hmap.width || buffer.height != ckpt->hmap.height) {
+        image_free(&buffer);
+        buffer = image_alloc(ckpt->hmap.width, ckpt->hmap.height);
+        if (buffer.data == NULL) {
+            w->pending.hmap = (ErodrImage) {0};
+            return false;
+        }
+    }
+    w->pending = *ckpt;
+    w->pending.hmap = buffer;
+    image_copy(&w->pending.hmap, (ErodrImage *) &ckpt->hmap);
+
+    pthread_mutex_lock(&w->mutex);
+    w->busy = true;
+    pthread_cond_broadcast(&w->cvar);
+    pthread_mutex_unlock(&w->mutex);
+    return true;
+}
+
+void checkpoint_writer_stop(CheckpointWriter *w)
+{
+    pthread_mutex_lock(&w->mutex);
+    w->quit = true;
+    pthread_cond_broadcast(&w->cvar);
+    pthread_mutex_unlock(&w->mutex);
+    pthread_join(w->thread, NULL);
+    pthread_mutex_destroy(&w->mutex);
+    pthread_cond_destroy(&w->cvar);
+    image_free(&w->pending.hmap);
+}
@@ -0,0 +1,74 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "image.h"
+#include "params.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+
+/*
+ * Snapshot of a hydraulic erosion simulation in progress. Since every
+ * particle draws from its own random number stream (seed, particle index),
+ * the seed and the index of the next particle fully describe the RNG state.
+ */
+typedef struct Checkpoint {
+    SimulationParameters params;
+    uint64_t seed;
+    int64_t n_simulated;
+    double eroded;
+    double deposited;
+    ErodrImage hmap;
+} Checkpoint;
+
+/*
+ * Writes checkpoints on a background thread so that the simulation doesn't
+ * have to wait for the disk.
+ */
+typedef struct CheckpointWriter {
+    const char *filepath;
+    Checkpoint pending;      /* owns a copy of the heightmap */
+    bool busy;
+    bool quit;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cvar;
+} CheckpointWriter;
+
+/*
+ * Writes checkpoint `ckpt` to `filepath`. The file is written to a
+ * temporary file first and then renamed, so an existing checkpoint is never
+ * left half-written. Returns 0 on success.
+ */
+int checkpoint_write(const char *filepath, const Checkpoint *ckpt);
+
+/*
+ * Loads a checkpoint from `filepath` into `ckpt`. `ckpt->hmap` is allocated
+ * and should be freed with `checkpoint_free`. Returns 0 on success.
+ */
+int checkpoint_load(const char *filepath, Checkpoint *ckpt);
+
+/*
+ * Frees the heightmap of `ckpt`.
+ */
+void checkpoint_free(Checkpoint *ckpt);
+
+/*
+ * Starts a checkpoint writer writing to `filepath`. Returns 0 on success.
+ */
+int checkpoint_writer_start(CheckpointWriter *w, const char *filepath);
+
+/*
+ * Copies `ckpt` and hands it to the writer thread. If the previous
+ * checkpoint is still being written, `ckpt` is skipped and false is
+ * returned.
+ */
+bool checkpoint_writer_submit(CheckpointWriter *w, const Checkpoint *ckpt);
+
+/*
+ * Waits for any pending checkpoint to be written and stops the writer.
+ */
+void checkpoint_writer_stop(CheckpointWriter *w);
+
+#endif /* CHECKPOINT_H */
@@ -0,0 +1,114 @@
+#include "command_queue.h"
+
+#include <sched.h>
+
+#define INDEX_MASK (COMMAND_QUEUE_CAPACITY - 1)
+
+_Static_assert((COMMAND_QUEUE_CAPACITY & INDEX_MASK) == 0, "COMMAND_QUEUE_CAPACITY must be a power of two");
+
+void command_queue_init(CommandQueue *q)
+{
+    for (int i = 0; i < COMMAND_QUEUE_CAPACITY; i++) {
+        atomic_init(&q->slots[i].seq, (uint_fast64_t) i);
+        atomic_init(&q->slots[i].cmd, COMMAND_NONE);
+    }
+    atomic_init(&q->head, 0);
+    q->tail = 0;
+    atomic_init(&q->n_sleeping, 0);
+    pthread_mutex_init(&q->mutex, NULL);
+    pthread_cond_init(&q->cvar, NULL);
+}
+
+void command_queue_destroy(CommandQueue *q)
+{
+    pthread_mutex_destroy(&q->mutex);
+    pthread_cond_destroy(&q->cvar);
+}
+
+/*
+ * Returns true if the newest queued command of `q` (before position
+ * `head`) equals `cmd` and hasn't been received yet.
+ */
+static bool is_newest_pending(CommandQueue *q, uint_fast64_t head, int cmd)
+{
+    if (head == 0) {
+        return false;
+    }
+    CommandSlot *slot = &q->slots[(head - 1) & INDEX_MASK];
+    return atomic_load(&slot->seq) == head &&
+           atomic_load_explicit(&slot->cmd, memory_order_relaxed) == cmd &&
+           atomic_load(&slot->seq) == head; /* not received and reused meanwhile */
+}
+
+bool command_queue_try_send(CommandQueue *q, int cmd, bool coalesce)
+{
+    uint_fast64_t pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+    CommandSlot *slot;
+    for (;;) {
+        if (coalesce && is_newest_pending(q, pos, cmd)) {
+            return true;
+        }
+        slot = &q->slots[pos & INDEX_MASK];
+        int64_t diff = (int64_t) (atomic_load(&slot->seq) - pos);
+        if (diff < 0) {
+            return false; /* the slot still holds a command from a lap ago */
+        }
+        if (diff == 0 && atomic_compare_exchange_weak_explicit(&q->head, &pos, pos + 1,
+                                                               memory_order_relaxed, memory_order_relaxed)) {
+            break;
+        }
+        if (diff > 0) {
+            pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+        }
+    }
+    atomic_store_explicit(&slot->cmd, cmd, memory_order_relaxed);
+    atomic_store(&slot->seq, pos + 1);
+
+    /* the consumer sets `n_sleeping` before checking the queue a last time */
+    if (atomic_load(&q->n_sleeping) != 0) {
+        pthread_mutex_lock(&q->mutex);
+        pthread_cond_signal(&q->cvar);
+        pthread_mutex_unlock(&q->mutex);
+    }
+    return true;
+}
+
+void command_queue_send(CommandQueue *q, int cmd, bool coalesce)
+{
+    while (!command_queue_try_send(q, cmd, coalesce)) {
+        sched_yield();
+    }
+}
+
+int command_queue_try_recv(CommandQueue *q)
+{
+    CommandSlot *slot = &q->slots[q->tail & INDEX_MASK];
+    if (atomic_load(&slot->seq) != q->tail + 1) {
+        return COMMAND_NONE; /* empty, or the next command is still being written */
+    }
+    int cmd = atomic_load_explicit(&slot->cmd, memory_order_relaxed);
+    atomic_store(&slot->seq, q->tail + COMMAND_QUEUE_CAPACITY);
+    q->tail++;
+    return cmd;
+}
+
+int command_queue_recv(CommandQueue *q)
+{
+    for (;;) {
+        int cmd = command_queue_try_recv(q);
+        if (cmd != COMMAND_NONE) {
+            return cmd;
+        }
+        pthread_mutex_lock(&q->mutex);
+        atomic_store(&q->n_sleeping, 1);
+        cmd = command_queue_try_recv(q);
+        if (cmd == COMMAND_NONE) {
+            pthread_cond_wait(&q->cvar, &q->mutex);
+        }
+        atomic_store(&q->n_sleeping, 0);
+        pthread_mutex_unlock(&q->mutex);
+        if (cmd != COMMAND_NONE) {
+            return cmd;
+        }
+    }
+}
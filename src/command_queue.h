@@ -0,0 +1,78 @@
+#ifndef COMMAND_QUEUE_H
+#define COMMAND_QUEUE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+/* must be a power of two */
+#define COMMAND_QUEUE_CAPACITY 64
+
+/* returned by `command_queue_try_recv` if the queue is empty */
+#define COMMAND_NONE 0
+
+typedef struct CommandSlot {
+    atomic_uint_fast64_t seq;   /* position the slot can be written (seq == pos) or read (seq == pos + 1) at */
+    atomic_int cmd;
+} CommandSlot;
+
+/*
+ * Bounded queue of commands (small positive integers) from any number of
+ * producer threads to a single consumer thread.
+ *
+ * Producers claim a slot of the ring buffer by advancing `head` with a
+ * compare-and-swap and publish it through the slot's sequence number, so
+ * sending never blocks and never takes a lock. A command equal to the
+ * newest command still waiting in the queue can be coalesced with it
+ * instead of being queued again.
+ *
+ * The consumer only sleeps if it finds the queue empty. The mutex and
+ * condition variable are only touched on that slow path: producers check
+ * `n_sleeping` after publishing and only then wake the consumer.
+ */
+typedef struct CommandQueue {
+    CommandSlot slots[COMMAND_QUEUE_CAPACITY];
+    _Alignas(64) atomic_uint_fast64_t head;     /* next position to write */
+    _Alignas(64) uint_fast64_t tail;            /* next position to read, owned by the consumer */
+    atomic_int n_sleeping;
+    pthread_mutex_t mutex;
+    pthread_cond_t cvar;
+} CommandQueue;
+
+/*
+ * Initializes empty queue `q`.
+ */
+void command_queue_init(CommandQueue *q);
+
+/*
+ * Destroys `q`.
+ */
+void command_queue_destroy(CommandQueue *q);
+
+/*
+ * Queues `cmd` (> 0) without blocking. If `coalesce` is set and the newest
+ * queued command that hasn't been received yet equals `cmd`, nothing is
+ * queued. Returns false if the queue is full.
+ */
+bool command_queue_try_send(CommandQueue *q, int cmd, bool coalesce);
+
+/*
+ * Queues `cmd`, yielding while the queue is full. Only meant for commands
+ * that must not be dropped.
+ */
+void command_queue_send(CommandQueue *q, int cmd, bool coalesce);
+
+/*
+ * Returns the oldest queued command, or COMMAND_NONE if the queue is
+ * empty. Must only be called by the consumer.
+ */
+int command_queue_try_recv(CommandQueue *q);
+
+/*
+ * Returns the oldest queued command, sleeping until one arrives if the
+ * queue is empty. Must only be called by the consumer.
+ */
+int command_queue_recv(CommandQueue *q);
+
+#endif /* COMMAND_QUEUE_H */
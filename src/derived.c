@@ -0,0 +1,259 @@
+#include "derived.h"
+#include "trace.h"
+
+#include "rlgl.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* workers updating the derived texture, kept small to leave the CPUs to the simulation */
+#define DERIVED_THREADS 2
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+/*
+ * Rows [y0, y1) x columns [x0, x1) of a run of tiles.
+ */
+typedef struct DeriveTask {
+    const ErodrImage *hmap;
+    uint16_t *out;          /* texel (x0, y0) in the staging buffer */
+    int out_stride;         /* texels per staging row */
+    float *scratch;         /* 4 * (x1 - x0) floats */
+    int x0, x1, y0, y1;
+    float snow_pooling;
+} DeriveTask;
+
+/*
+ * Converts `f` to a half float, rounding to nearest even. Branches only on
+ * the (rare) out-of-range and denormal cases.
+ */
+static inline uint16_t float_to_half(float f)
+{
+    union { float f; uint32_t u; } in = {f};
+    const union { float f; uint32_t u; } denorm_magic = {.u = ((127 - 15) + (23 - 10) + 1) << 23};
+    uint32_t sign = in.u & 0x80000000u;
+    uint16_t o;
+    in.u ^= sign;
+    if (in.u >= (uint32_t)(127 + 16) << 23) {
+        o = (in.u > (uint32_t)255 << 23) ? 0x7e00 : 0x7c00;   /* NaN or infinity */
+    } else if (in.u < (uint32_t)113 << 23) {
+        in.f += denorm_magic.f;
+        o = (uint16_t)(in.u - denorm_magic.u);
+    } else {
+        uint32_t mant_odd = (in.u >> 13) & 1;
+        in.u += ((uint32_t)(15 - 127) << 23) + 0xfff + mant_odd;
+        o = (uint16_t)(in.u >> 13);
+    }
+    return o | (uint16_t)(sign >> 16);
+}
+
+/*
+ * Index `i` reflected into [0, n) like TEXTURE_WRAP_MIRROR_REPEAT does for
+ * indices less than n outside the texture.
+ */
+static inline int mirror(int i, int n)
+{
+    i = (i < 0) ? -i - 1 : (i >= n) ? 2*n - i - 1 : i;
+    return MIN(MAX(i, 0), n - 1);
+}
+
+/*
+ * Bilinearly samples row `y` of `hmap` at columns [x0, x1), offset by
+ * (`ox`, `oy`) pixels, into `out`, like a linearly filtered texture fetch.
+ */
+static void sample_row(float *out, const ErodrImage *hmap, int y, int x0, int x1, float ox, float oy)
+{
+    int ix = (int)floorf(ox);
+    int iy = (int)floorf(oy);
+    float fx = ox - ix;
+    float fy = oy - iy;
+    const float *r0 = &hmap->data[mirror(y + iy, hmap->height) * hmap->stride];
+    const float *r1 = &hmap->data[mirror(y + iy + 1, hmap->height) * hmap->stride];
+
+    /* columns whose samples lie inside the heightmap */
+    int lo = MIN(MAX(x0, -ix), x1);
+    int hi = MAX(MIN(x1, hmap->width - 1 - ix), lo);
+    for (int x = x0; x < lo; x++) {
+        int a = mirror(x + ix, hmap->width);
+        int b = mirror(x + ix + 1, hmap->width);
+        out[x - x0] = (1 - fy) * ((1 - fx) * r0[a] + fx * r0[b]) + fy * ((1 - fx) * r1[a] + fx * r1[b]);
+    }
+    for (int x = lo; x < hi; x++) {
+        out[x - x0] = (1 - fy) * ((1 - fx) * r0[x + ix] + fx * r0[x + ix + 1]) +
+                      fy * ((1 - fx) * r1[x + ix] + fx * r1[x + ix + 1]);
+    }
+    for (int x = hi; x < x1; x++) {
+        int a = mirror(x + ix, hmap->width);
+        int b = mirror(x + ix + 1, hmap->width);
+        out[x - x0] = (1 - fy) * ((1 - fx) * r0[a] + fx * r0[b]) + fy * ((1 - fx) * r1[a] + fx * r1[b]);
+    }
+}
+
+/*
+ * Computes the gradient magnitude of row `y` at scale `k` into `out`: the
+ * differences between samples half `k` pixels apart (see hmap_shader.frag).
+ * Offsets along y are relative to the width, like the shader's `res`.
+ */
+static void gradient_row(float *out, float *scratch, const ErodrImage *hmap, int y, int x0, int x1, float k)
+{
+    int n = x1 - x0;
+    float *s0 = scratch;
+    float *s1 = scratch + n;
+    float *s2 = scratch + 2 * n;
+    float ry = (float) hmap->height / hmap->width;
+    sample_row(s0, hmap, y, x0, x1, -0.5f * k, -0.5f * k * ry);
+    sample_row(s1, hmap, y, x0, x1, 0.0f, 0.5f * k * ry);
+    sample_row(s2, hmap, y, x0, x1, 0.5f * k, 0.0f);
+    for (int i = 0; i < n; i++) {
+        float d1 = s0[i] - s1[i];
+        float d2 = s0[i] - s2[i];
+        out[i] = sqrtf(d1 * d1 + d2 * d2);
+    }
+}
+
+static void derive_rows(void *arg)
+{
+    DeriveTask *task = (DeriveTask *) arg;
+    const ErodrImage *hmap = task->hmap;
+    int n = task->x1 - task->x0;
+    float *gradient = task->scratch + 3 * n;
+    for (int y = task->y0; y < task->y1; y++) {
+        uint16_t *out = &task->out[(y - task->y0) * task->out_stride * 4];
+        const float *heights = &hmap->data[y * hmap->stride + task->x0];
+        gradient_row(gradient, task->scratch, hmap, y, task->x0, task->x1, 1.0f);
+        for (int i = 0; i < n; i++) {
+            out[4*i + 0] = float_to_half(heights[i]);
+            out[4*i + 1] = float_to_half(gradient[i]);
+            out[4*i + 3] = 0x3c00; /* 1.0 */
+        }
+        gradient_row(gradient, task->scratch, hmap, y, task->x0, task->x1, task->snow_pooling);
+        for (int i = 0; i < n; i++) {
+            out[4*i + 2] = float_to_half(gradient[i]);
+        }
+    }
+}
+
+int derived_init(DerivedTexture *d, const SnapshotBuffer *sb, const Snapshot *snapshot, float snow_pooling)
+{
+    *d = (DerivedTexture) {0};
+    int width = snapshot->hmap.width;
+    int height = snapshot->hmap.height;
+    d->staging = malloc((size_t) width * SNAPSHOT_TILE_SIZE * 4 * sizeof(uint16_t));
+    d->tiles = calloc(sb->n_words, sizeof(uint64_t));
+    bool ok = d->staging != NULL && d->tiles != NULL;
+    for (int i = 0; i < DERIVED_MAX_TASKS; i++) {
+        d->scratch[i] = malloc((size_t) width * 4 * sizeof(float));
+        ok = ok && d->scratch[i] != NULL;
+    }
+    if (!ok || thread_pool_init(&d->pool, DERIVED_THREADS) != 0) {
+        derived_free(d);
+        return -1;
+    }
+
+    d->texture = (Texture2D) {
+        .id      = rlLoadTexture(NULL, width, height, PIXELFORMAT_UNCOMPRESSED_R16G16B16A16, 1),
+        .width   = width,
+        .height  = height,
+        .mipmaps = 1,
+        .format  = PIXELFORMAT_UNCOMPRESSED_R16G16B16A16,
+    };
+    SetTextureFilter(d->texture, TEXTURE_FILTER_BILINEAR);
+    SetTextureWrap(d->texture, TEXTURE_WRAP_MIRROR_REPEAT);
+    derived_update(d, sb, snapshot, snow_pooling, true);
+    return 0;
+}
+
+/*
+ * Sets the tiles of `d` that are in, or next to a tile in, `changed`.
+ */
+static void dilate_tiles(DerivedTexture *d, const SnapshotBuffer *sb, const uint64_t *changed)
+{
+    memset(d->tiles, 0, sb->n_words * sizeof(uint64_t));
+    for (int ty = 0; ty < sb->tiles_y; ty++) {
+        for (int tx = 0; tx < sb->tiles_x; tx++) {
+            if (!snapshot_tile_test(sb, changed, tx, ty)) {
+                continue;
+            }
+            for (int ny = MAX(ty - 1, 0); ny <= MIN(ty + 1, sb->tiles_y - 1); ny++) {
+                for (int nx = MAX(tx - 1, 0); nx <= MIN(tx + 1, sb->tiles_x - 1); nx++) {
+                    int tile = ny * sb->tiles_x + nx;
+                    d->tiles[tile >> 6] |= (uint64_t) 1 << (tile & 63);
+                }
+            }
+        }
+    }
+}
+
+size_t derived_update(DerivedTexture *d, const SnapshotBuffer *sb, const Snapshot *snapshot, float snow_pooling, bool all)
+{
+    double t_trace = trace_begin();
+    const ErodrImage *hmap = &snapshot->hmap;
+    if (all || snow_pooling != d->snow_pooling) {
+        memset(d->tiles, 0xff, sb->n_words * sizeof(uint64_t));
+        d->snow_pooling = snow_pooling;
+    } else {
+        dilate_tiles(d, sb, snapshot->changed);
+    }
+
+    /* horizontal runs of tiles, each split into row tasks */
+    int n_tiles = 0;
+    size_t n_bytes = 0;
+    for (int ty = 0; ty < sb->tiles_y; ty++) {
+        int y = ty * SNAPSHOT_TILE_SIZE;
+        int h = MIN(SNAPSHOT_TILE_SIZE, hmap->height - y);
+        for (int tx = 0; tx < sb->tiles_x; tx++) {
+            if (!snapshot_tile_test(sb, d->tiles, tx, ty)) {
+                continue;
+            }
+            int tx_end = tx + 1;
+            while (tx_end < sb->tiles_x && snapshot_tile_test(sb, d->tiles, tx_end, ty)) {
+                tx_end++;
+            }
+            int x = tx * SNAPSHOT_TILE_SIZE;
+            int w = MIN(tx_end * SNAPSHOT_TILE_SIZE, hmap->width) - x;
+
+            DeriveTask tasks[DERIVED_MAX_TASKS];
+            TaskGroup group = {0};
+            int n_tasks = (h + DERIVED_TASK_ROWS - 1) / DERIVED_TASK_ROWS;
+            for (int i = 0; i < n_tasks; i++) {
+                int y0 = y + i * DERIVED_TASK_ROWS;
+                tasks[i] = (DeriveTask) {
+                    .hmap         = hmap,
+                    .out          = &d->staging[(y0 - y) * w * 4],
+                    .out_stride   = w,
+                    .scratch      = d->scratch[i],
+                    .x0           = x,
+                    .x1           = x + w,
+                    .y0           = y0,
+                    .y1           = MIN(y0 + DERIVED_TASK_ROWS, y + h),
+                    .snow_pooling = d->snow_pooling,
+                };
+                thread_pool_submit(&d->pool, derive_rows, &tasks[i], &group);
+            }
+            thread_pool_wait(&d->pool, &group);
+            UpdateTextureRec(d->texture, (Rectangle) {x, y, w, h}, d->staging);
+            n_bytes += (size_t) w * h * 4 * sizeof(uint16_t);
+            n_tiles += tx_end - tx;
+            tx = tx_end;
+        }
+    }
+    trace_end_n("update derived texture", "ui", t_trace, n_tiles);
+    return n_bytes;
+}
+
+void derived_free(DerivedTexture *d)
+{
+    if (d->texture.id != 0) {
+        UnloadTexture(d->texture);
+    }
+    if (d->pool.threads != NULL) {
+        thread_pool_destroy(&d->pool);
+    }
+    free(d->staging);
+    free(d->tiles);
+    for (int i = 0; i < DERIVED_MAX_TASKS; i++) {
+        free(d->scratch[i]);
+    }
+}
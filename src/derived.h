@@ -0,0 +1,54 @@
+#ifndef DERIVED_H
+#define DERIVED_H
+
+#include "snapshot.h"
+#include "thread_pool.h"
+
+#include "raylib.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* derived texels computed by one task */
+#define DERIVED_TASK_ROWS 8
+#define DERIVED_MAX_TASKS (SNAPSHOT_TILE_SIZE / DERIVED_TASK_ROWS)
+
+/*
+ * Per-pixel visualization data derived from the heightmap, so that the
+ * fragment shader needs a single texture fetch. Each texel (RGBA, half
+ * float) holds the height, the gradient magnitude, and the gradient
+ * magnitude at the snow pooling scale. The finite differences match the
+ * ones the shader used to take on the fly.
+ *
+ * The texture is updated tile by tile on a small pool of worker threads.
+ * A tile depends on heights up to half the snow pooling distance away,
+ * so the neighbours of every changed tile are recomputed as well.
+ */
+typedef struct DerivedTexture {
+    Texture2D texture;
+    float snow_pooling;             /* pooling the texture was computed with */
+    ThreadPool pool;
+    uint16_t *staging;              /* one run of tiles in texture layout */
+    float *scratch[DERIVED_MAX_TASKS];
+    uint64_t *tiles;                /* tiles to recompute */
+} DerivedTexture;
+
+/*
+ * Creates the derived texture of `snapshot` with snow pooling distance
+ * `snow_pooling` (in pixels). Returns 0 on success.
+ */
+int derived_init(DerivedTexture *d, const SnapshotBuffer *sb, const Snapshot *snapshot, float snow_pooling);
+
+/*
+ * Recomputes and uploads the texels affected by the tiles changed in
+ * `snapshot`, or all texels if `all` is set or `snow_pooling` differs from
+ * the current pooling. Returns the number of bytes uploaded.
+ */
+size_t derived_update(DerivedTexture *d, const SnapshotBuffer *sb, const Snapshot *snapshot, float snow_pooling, bool all);
+
+/*
+ * Frees `d` and its texture.
+ */
+void derived_free(DerivedTexture *d);
+
+#endif /* DERIVED_H */
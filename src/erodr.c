@@ -0,0 +1,256 @@
+#include "erodr.h"
+#include "pipeline.h"
+#include "workspace.h"
+#include "io.h"
+#include "log.h"
+#include "spawn.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+struct ErodrContext {
+    Workspace ws;
+    ErodrProgressFn progress;
+    void *progress_user;
+    ErodrLogFn log;
+    void *log_user;
+    atomic_bool cancel;
+};
+
+struct ErodrParams {
+    SimulationParameters p;
+};
+
+/*
+ * Numeric simulation parameter, by its *.ini key.
+ */
+typedef struct ParamField {
+    const char *name;
+    size_t offset;
+    bool is_int;
+} ParamField;
+
+#define PARAM_INT(field)   {#field, offsetof(SimulationParameters, field), true}
+#define PARAM_FLOAT(field) {#field, offsetof(SimulationParameters, field), false}
+
+static const ParamField param_fields[] = {
+    PARAM_INT(n),
+    PARAM_INT(ttl),
+    PARAM_INT(seed),
+    PARAM_INT(p_radius),
+    PARAM_FLOAT(p_inertia),
+    PARAM_FLOAT(p_capacity),
+    PARAM_FLOAT(p_gravity),
+    PARAM_FLOAT(p_evaporation),
+    PARAM_FLOAT(p_erosion),
+    PARAM_FLOAT(p_deposition),
+    PARAM_FLOAT(p_min_slope),
+    PARAM_FLOAT(p_initial_velocity),
+    PARAM_FLOAT(p_initial_water),
+    PARAM_INT(thermal_iterations),
+    PARAM_FLOAT(thermal_talus),
+    PARAM_FLOAT(thermal_rate),
+    PARAM_INT(thermal_first),
+    PARAM_INT(pyramid_levels),
+    PARAM_FLOAT(pyramid_refine),
+    PARAM_INT(spawn_regions),
+    PARAM_FLOAT(spawn_region_floor),
+    PARAM_INT(roi_x),
+    PARAM_INT(roi_y),
+    PARAM_INT(roi_width),
+    PARAM_INT(roi_height),
+    PARAM_FLOAT(roi_feather),
+    PARAM_INT(wrap),
+    PARAM_INT(epoch_size),
+    PARAM_FLOAT(converge_threshold),
+    PARAM_FLOAT(time_budget),
+};
+
+/*
+ * Returns the field named `name`, or NULL.
+ */
+static const ParamField *find_param(const char *name)
+{
+    if (name == NULL) {
+        return NULL;
+    }
+    for (size_t i = 0; i < sizeof(param_fields) / sizeof(param_fields[0]); i++) {
+        if (strcmp(param_fields[i].name, name) == 0) {
+            return &param_fields[i];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Forwards progress to the user callback and checks for cancellation.
+ */
+static bool context_progress(void *user, int64_t done, int64_t total)
+{
+    ErodrContext *ctx = (ErodrContext *) user;
+    if (atomic_load_explicit(&ctx->cancel, memory_order_relaxed)) {
+        return false;
+    }
+    return ctx->progress == NULL || ctx->progress(ctx->progress_user, done, total);
+}
+
+static void context_log(void *user, LogLevel level, const char *msg)
+{
+    ErodrContext *ctx = (ErodrContext *) user;
+    if (ctx->log != NULL) {
+        ctx->log(ctx->log_user, level == LOG_LEVEL_ERROR, msg);
+    }
+}
+
+ErodrStatus erodr_context_create(ErodrContext **ctx)
+{
+    if (ctx == NULL) {
+        return ERODR_ERROR_INVALID_ARGUMENT;
+    }
+    *ctx = calloc(1, sizeof(ErodrContext));
+    if (*ctx == NULL) {
+        return ERODR_ERROR_OUT_OF_MEMORY;
+    }
+    atomic_init(&(*ctx)->cancel, false);
+    return ERODR_OK;
+}
+
+void erodr_context_destroy(ErodrContext *ctx)
+{
+    if (ctx == NULL) {
+        return;
+    }
+    workspace_free(&ctx->ws);
+    free(ctx);
+}
+
+void erodr_set_progress_callback(ErodrContext *ctx, ErodrProgressFn fn, void *user)
+{
+    ctx->progress = fn;
+    ctx->progress_user = user;
+}
+
+void erodr_cancel(ErodrContext *ctx)
+{
+    atomic_store_explicit(&ctx->cancel, true, memory_order_relaxed);
+}
+
+void erodr_set_log_callback(ErodrContext *ctx, ErodrLogFn fn, void *user)
+{
+    ctx->log = fn;
+    ctx->log_user = user;
+}
+
+ErodrStatus erodr_params_create(ErodrParams **params)
+{
+    if (params == NULL) {
+        return ERODR_ERROR_INVALID_ARGUMENT;
+    }
+    *params = malloc(sizeof(ErodrParams));
+    if (*params == NULL) {
+        return ERODR_ERROR_OUT_OF_MEMORY;
+    }
+    (*params)->p = DEFAULT_PARAM;
+    return ERODR_OK;
+}
+
+void erodr_params_destroy(ErodrParams *params)
+{
+    free(params);
+}
+
+ErodrStatus erodr_params_set(ErodrParams *params, const char *name, double value)
+{
+    const ParamField *field = find_param(name);
+    if (params == NULL || field == NULL) {
+        return ERODR_ERROR_INVALID_ARGUMENT;
+    }
+    char *ptr = (char *) &params->p + field->offset;
+    if (field->is_int) {
+        *(int *) ptr = (int) value;
+    } else {
+        *(float *) ptr = (float) value;
+    }
+    return ERODR_OK;
+}
+
+ErodrStatus erodr_params_get(const ErodrParams *params, const char *name, double *value)
+{
+    const ParamField *field = find_param(name);
+    if (params == NULL || field == NULL || value == NULL) {
+        return ERODR_ERROR_INVALID_ARGUMENT;
+    }
+    const char *ptr = (const char *) &params->p + field->offset;
+    *value = field->is_int ? (double) *(const int *) ptr : (double) *(const float *) ptr;
+    return ERODR_OK;
+}
+
+ErodrStatus erodr_params_set_spawn_mode(ErodrParams *params, const char *mode)
+{
+    SpawnMode parsed;
+    if (params == NULL || mode == NULL || spawn_mode_parse(mode, &parsed) != 0 || parsed == SPAWN_MODE_MAP) {
+        return ERODR_ERROR_INVALID_ARGUMENT;
+    }
+    params->p.spawn_mode = parsed;
+    return ERODR_OK;
+}
+
+ErodrStatus erodr_params_read(ErodrParams *params, const char *filepath)
+{
+    if (filepath == NULL || params == NULL) {
+        return ERODR_ERROR_INVALID_ARGUMENT;
+    }
+    return (io_read_params_ini(filepath, &params->p) == 0) ? ERODR_OK : ERODR_ERROR_IO;
+}
+
+ErodrStatus erodr_erode(ErodrContext *ctx, float *data, int width, int height, int stride,
+                        const ErodrParams *params)
+{
+    if (ctx == NULL || data == NULL || params == NULL || width < 2 || height < 2 || stride < width) {
+        return ERODR_ERROR_INVALID_ARGUMENT;
+    }
+    if (params->p.spawn_mode == SPAWN_MODE_MAP) {
+        return ERODR_ERROR_INVALID_ARGUMENT; /* no spawn density map in this API */
+    }
+    atomic_store_explicit(&ctx->cancel, false, memory_order_relaxed);
+    SimulationParameters p = params->p;
+
+    /* thermal erosion and the pyramid want a contiguous map */
+    ErodrImage hmap = {.data = data, .width = width, .height = height, .stride = stride};
+    ErodrImage *target = &hmap;
+    if (stride != width && (p.thermal_iterations > 0 || p.pyramid_levels > 1)) {
+        target = workspace_image(&ctx->ws, WORKSPACE_SLOT_INPUT, width, height);
+        if (target == NULL) {
+            return ERODR_ERROR_OUT_OF_MEMORY;
+        }
+        image_copy(target, &hmap);
+    }
+
+    ErosionSimOptions opts = {
+        .workspace     = &ctx->ws,
+        .progress      = context_progress,
+        .progress_user = ctx,
+    };
+    log_set_thread_sink(context_log, ctx);
+    bool completed = pipeline_run(target, &p, &opts);
+    log_set_thread_sink(NULL, NULL);
+
+    if (target != &hmap) {
+        image_copy(&hmap, target);
+    }
+    return completed ? ERODR_OK : ERODR_CANCELLED;
+}
+
+const char *erodr_status_string(ErodrStatus status)
+{
+    switch (status) {
+        case ERODR_OK:                     return "ok";
+        case ERODR_ERROR_INVALID_ARGUMENT: return "invalid argument";
+        case ERODR_ERROR_OUT_OF_MEMORY:    return "out of memory";
+        case ERODR_ERROR_IO:               return "could not read file";
+        case ERODR_CANCELLED:              return "cancelled";
+    }
+    return "unknown status";
+}
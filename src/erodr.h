@@ -0,0 +1,123 @@
+#ifndef ERODR_H
+#define ERODR_H
+
+/*
+ * liberodr - embeddable heightmap erosion.
+ *
+ * A context owns the scratch buffers of the simulation. They grow to fit
+ * the largest map eroded so far and are reused by later calls, so a
+ * process that erodes many maps should create one context per thread and
+ * keep it around. Heightmaps are caller-owned float buffers. The library
+ * never exits the process and is silent unless a log callback is set.
+ *
+ * Simulation parameters are opaque and accessed by name, so parameters
+ * can be added without breaking the ABI of existing callers.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct ErodrContext ErodrContext;
+typedef struct ErodrParams ErodrParams;
+
+typedef enum ErodrStatus {
+    ERODR_OK = 0,
+    ERODR_ERROR_INVALID_ARGUMENT,
+    ERODR_ERROR_OUT_OF_MEMORY,
+    ERODR_ERROR_IO,
+    ERODR_CANCELLED,
+} ErodrStatus;
+
+/*
+ * Progress callback. `done` and `total` count particles of the current
+ * hydraulic erosion stage (each pyramid level is a stage). Returning false
+ * cancels the run.
+ */
+typedef bool (*ErodrProgressFn)(void *user, int64_t done, int64_t total);
+
+/*
+ * Log callback. `is_error` is set for error messages. `msg` has no
+ * trailing newline.
+ */
+typedef void (*ErodrLogFn)(void *user, bool is_error, const char *msg);
+
+/*
+ * Creates a context. Returns ERODR_OK and stores the context in `*ctx` on
+ * success.
+ */
+ErodrStatus erodr_context_create(ErodrContext **ctx);
+
+/*
+ * Destroys context `ctx` and frees its scratch buffers.
+ */
+void erodr_context_destroy(ErodrContext *ctx);
+
+/*
+ * Sets (or clears, if `fn` is NULL) the progress callback of `ctx`.
+ */
+void erodr_set_progress_callback(ErodrContext *ctx, ErodrProgressFn fn, void *user);
+
+/*
+ * Requests cancellation of the `erodr_erode` call currently running on
+ * `ctx`. May be called from any thread. The call returns ERODR_CANCELLED
+ * at the next batch boundary, leaving the heightmap partially eroded.
+ */
+void erodr_cancel(ErodrContext *ctx);
+
+/*
+ * Sets (or clears, if `fn` is NULL) the log callback of `ctx`. It receives
+ * the messages of `erodr_erode` calls on `ctx`, on the thread making the
+ * call.
+ */
+void erodr_set_log_callback(ErodrContext *ctx, ErodrLogFn fn, void *user);
+
+/*
+ * Creates a parameter set with the default simulation parameters. Returns
+ * ERODR_OK and stores it in `*params` on success.
+ */
+ErodrStatus erodr_params_create(ErodrParams **params);
+
+/*
+ * Destroys parameter set `params`.
+ */
+void erodr_params_destroy(ErodrParams *params);
+
+/*
+ * Sets numeric parameter `name` of `params` to `value`. Names are the keys
+ * of the parameter *.ini file (e.g. "n", "ttl", "p_erosion"). Integer
+ * parameters are truncated. Returns ERODR_ERROR_INVALID_ARGUMENT for
+ * unknown names.
+ */
+ErodrStatus erodr_params_set(ErodrParams *params, const char *name, double value);
+
+/*
+ * Stores numeric parameter `name` of `params` in `*value`. Returns
+ * ERODR_ERROR_INVALID_ARGUMENT for unknown names.
+ */
+ErodrStatus erodr_params_get(const ErodrParams *params, const char *name, double *value);
+
+/*
+ * Sets the spawn mode of `params` by name ("uniform", "height" or "slope").
+ */
+ErodrStatus erodr_params_set_spawn_mode(ErodrParams *params, const char *mode);
+
+/*
+ * Reads simulation parameters from *.ini file `filepath` into `params`.
+ * Parameters missing from the file are reset to their defaults.
+ */
+ErodrStatus erodr_params_read(ErodrParams *params, const char *filepath);
+
+/*
+ * Erodes the `width` x `height` heightmap `data` in place. Pixel (x, y) is
+ * `data[y * stride + x]`. Heights are expected in [0, 1]. Spawn mode
+ * "map" is not supported.
+ */
+ErodrStatus erodr_erode(ErodrContext *ctx, float *data, int width, int height, int stride,
+                        const ErodrParams *params);
+
+/*
+ * Returns a human readable description of `status`.
+ */
+const char *erodr_status_string(ErodrStatus status);
+
+#endif /* ERODR_H */
@@ -1,16 +1,40 @@
 
 #include "erosion_sim.h"
+#include "spawn.h"
 #include "vector.h"
+#include "rng.h"
+#include "timer.h"
+#include "log.h"
+#include "thread_pool.h"
+#include "profile.h"
+#include "trace.h"
 
 #include <time.h>
 #include <string.h>
 #include <math.h>
 #include <stdlib.h>
-#include <stdio.h>
+#include <assert.h>
 
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
 
+/* number of epochs in the moving average of the adaptive mode */
+#define ADAPTIVE_WINDOW 3
+
+/* number of particles between progress callbacks */
+#define PROGRESS_INTERVAL 10000
+
+/* number of particles handed to a thread at a time */
+#define PARTICLE_GRAIN 256
+
+/*
+ * A particle that reaches its ttl counts as stalled if it moved less than
+ * STALL_DISTANCE pixels during its last STALL_WINDOW steps (it moves one
+ * pixel per step when not trapped in a pit).
+ */
+#define STALL_WINDOW 8
+#define STALL_DISTANCE 1.0f
+
 /*
  * Particle type.
  */
@@ -22,6 +46,35 @@ typedef struct Particle {
     float water;
 } Particle;
 
+/*
+ * Per-thread totals of eroded and deposited material. Aligned to a cache
+ * line so that threads don't share lines.
+ */
+typedef struct MassTotals {
+    _Alignas(64) double eroded;
+    double deposited;
+} MassTotals;
+
+/*
+ * `parallel_for` context of `erosion_sim_step`.
+ */
+typedef struct StepContext {
+    ErosionSim *sim;
+    MassTotals totals[THREAD_POOL_MAX_THREADS];
+} StepContext;
+
+/*
+ * `parallel_for` context of the per-epoch change reduction.
+ */
+typedef struct EpochChangeContext {
+    ErodrImage *hmap;
+    ErodrImage *prev;
+    struct {
+        _Alignas(64) double l1;
+        float linf;
+    } partial[THREAD_POOL_MAX_THREADS];
+} EpochChangeContext;
+
 /*
  * gradient & height tuple.
  */
@@ -30,56 +83,109 @@ typedef struct HeigthGradientTuple {
     float height;
 } HeigthGradientTuple;
 
+/*
+ * Returns the weight of heightmap writes at (x, y): the weight of `mask`
+ * if `masked`, 1 otherwise. Like `wrap`, `masked` is a compile time
+ * constant in the specialized particle loops, so full map runs never
+ * evaluate the mask.
+ */
+static inline float write_weight(const WriteMask *mask, int x, int y, bool masked) {
+    return masked ? write_mask_weight(mask, x, y) : 1.0f;
+}
+
+/*
+ * Returns `i` + 1. With `wrap`, returns 0 instead of `n`. `wrap` is a
+ * compile time constant in the specialized particle loops, so this is a
+ * plain increment or a conditional move, never a branch.
+ */
+static inline int next_index(int i, int n, bool wrap) {
+    int j = i + 1;
+    return (wrap && j == n) ? 0 : j;
+}
+
+/*
+ * Wraps `i` in [-n, 2n) around to [0, n) without branching.
+ */
+static inline int wrap_index(int i, int n) {
+    return i + n * ((i < 0) - (i >= n));
+}
+
 /*
  * Bilinearly interpolate float value at (x, y) in map.
  */
-float bilerp_map(ErodrImage *hmap, Vec2 pos) {
+static inline float bilerp_map(ErodrImage *hmap, Vec2 pos, bool wrap) {
     float u, v, ul, ur, ll, lr, ipl_l, ipl_r;
     int x_i = (int)pos.x;
     int y_i = (int)pos.y;
+    int x_n = next_index(x_i, hmap->width, wrap);
+    int y_n = next_index(y_i, hmap->height, wrap);
     u = pos.x - x_i;
     v = pos.y - y_i;
-    ul = hmap->data[y_i*hmap->width + x_i];
-    ur = hmap->data[y_i*hmap->width + x_i + 1];
-    ll = hmap->data[(y_i + 1)*hmap->width + x_i];
-    lr = hmap->data[(y_i + 1)*hmap->width + x_i + 1];
+    ul = hmap->data[y_i*hmap->stride + x_i];
+    ur = hmap->data[y_i*hmap->stride + x_n];
+    ll = hmap->data[y_n*hmap->stride + x_i];
+    lr = hmap->data[y_n*hmap->stride + x_n];
     ipl_l = (1 - v) * ul + v * ll;
     ipl_r = (1 - v) * ur + v * lr;
     return (1 - u) * ipl_l + u * ipl_r; 
 }
 
+/*
+ * Adds `amount` to the cells around `pos` in `img`, weighted bilinearly.
+ */
+static inline void splat(ErodrImage *img, Vec2 pos, float amount, bool wrap) {
+    int x_i = (int)pos.x;
+    int y_i = (int)pos.y;
+    int x_n = next_index(x_i, img->width, wrap);
+    int y_n = next_index(y_i, img->height, wrap);
+    float u = pos.x - x_i;
+    float v = pos.y - y_i;
+    img->data[y_i*img->stride + x_i] += amount * (1 - u) * (1 - v);
+    img->data[y_i*img->stride + x_n] += amount * u * (1 - v);
+    img->data[y_n*img->stride + x_i] += amount * (1 - u) * v;
+    img->data[y_n*img->stride + x_n] += amount * u * v;
+}
+
 /*
  * Deposits sediment at position `pos` in heighmap `hmap`.
  * Deposition only affect immediate neighbouring gridpoints
  * to `pos`.
  */
-void deposit(ErodrImage *hmap, Vec2 pos, float amount) {
+static inline void deposit(ErodrImage *hmap, const WriteMask *mask, Vec2 pos, float amount, bool wrap, bool masked) {
     int x_i = (int)pos.x;
     int y_i = (int)pos.y;
+    int x_n = next_index(x_i, hmap->width, wrap);
+    int y_n = next_index(y_i, hmap->height, wrap);
     float u = pos.x - x_i;
     float v = pos.y - y_i;
-    hmap->data[y_i*hmap->width + x_i] += amount * (1 - u) * (1 - v);
-    hmap->data[y_i*hmap->width + x_i + 1] += amount * u * (1 - v);
-    hmap->data[(y_i + 1)*hmap->width + x_i] += amount * (1 - u) * v;
-    hmap->data[(y_i + 1)*hmap->width + x_i + 1] += amount * u * v;
+    hmap->data[y_i*hmap->stride + x_i] += amount * (1 - u) * (1 - v) * write_weight(mask, x_i, y_i, masked);
+    hmap->data[y_i*hmap->stride + x_n] += amount * u * (1 - v) * write_weight(mask, x_n, y_i, masked);
+    hmap->data[y_n*hmap->stride + x_i] += amount * (1 - u) * v * write_weight(mask, x_i, y_n, masked);
+    hmap->data[y_n*hmap->stride + x_n] += amount * u * v * write_weight(mask, x_n, y_n, masked);
 }
 
 /*
  * Erodes heighmap `hmap` at position `pos` by amount `amount`.
  * Erosion is distributed over an area defined through p_radius.
+ * The eroded material is added to `eroded` if not NULL. With `wrap`,
+ * the kernel wraps around the map edges instead of being cut off.
  */
-void erode(ErodrImage *hmap, Vec2 pos, float amount, int radius) {  
+static inline void erode(ErodrImage *hmap, const WriteMask *mask, Vec2 pos, float amount, int radius,
+                         ErodrImage *eroded, bool wrap, bool masked) {  
     if(radius < 1){
-        deposit(hmap, pos, -amount);
+        deposit(hmap, mask, pos, -amount, wrap, masked);
+        if (eroded != NULL) {
+            deposit(eroded, mask, pos, amount, wrap, masked);
+        }
         return;
     }
 
     int x0 = (int)pos.x - radius;
     int y0 = (int)pos.y - radius;
-    int x_start = MAX(0, x0);
-    int y_start = MAX(0, y0);
-    int x_end = MIN(hmap->width, x0+2*radius+1);
-    int y_end = MIN(hmap->height, y0+2*radius+1);
+    int x_start = wrap ? x0 : MAX(0, x0);
+    int y_start = wrap ? y0 : MAX(0, y0);
+    int x_end = wrap ? x0+2*radius+1 : MIN(hmap->width, x0+2*radius+1);
+    int y_end = wrap ? y0+2*radius+1 : MIN(hmap->height, y0+2*radius+1);
 
     /* construct erosion/deposition kernel. */
     float kernel[2*radius + 1][2*radius + 1];
@@ -97,20 +203,58 @@ void erode(ErodrImage *hmap, Vec2 pos, float amount, int radius) {
 
     /* normalize weights and apply changes on heighmap. */
     for(int y = y_start; y < y_end; y++) {
+        int y_w = wrap ? wrap_index(y, hmap->height) : y;
         for(int x = x_start; x < x_end; x++) {
+            int x_w = wrap ? wrap_index(x, hmap->width) : x;
             kernel[y-y0][x-x0] /= kernel_sum;
-            hmap->data[y*hmap->width + x] -= amount * kernel[y-y0][x-x0];
+            float delta = amount * kernel[y-y0][x-x0] * write_weight(mask, x_w, y_w, masked);
+            hmap->data[y_w*hmap->stride + x_w] -= delta;
+            if (eroded != NULL) {
+                eroded->data[y_w*eroded->stride + x_w] += delta;
+            }
         }   
     }
 }
 
+/*
+ * Marks the pixels changed by erosion or deposition at `pos` (in view
+ * coordinates) dirty in the snapshot buffer of `sim`. With `wrap`, the
+ * parts of the kernel wrapped around the map edges are marked as well.
+ */
+static inline void mark_dirty(ErosionSim *sim, Vec2 pos, int radius, bool wrap)
+{
+    int r = MAX(radius, 1);
+    int x0 = sim->view_x0 + (int)pos.x - r;
+    int y0 = sim->view_y0 + (int)pos.y - r;
+    int x1 = sim->view_x0 + (int)pos.x + r;
+    int y1 = sim->view_y0 + (int)pos.y + r;
+    snapshot_mark_dirty(sim->snapshots, x0, y0, x1, y1);
+    int w = sim->hmap->width;
+    int h = sim->hmap->height;
+    if (wrap && (x0 < 0 || y0 < 0 || x1 >= w || y1 >= h)) {
+        for (int dy = -1; dy <= 1; dy++) {
+            for (int dx = -1; dx <= 1; dx++) {
+                if (dx != 0 || dy != 0) {
+                    snapshot_mark_dirty(sim->snapshots, x0 + dx*w, y0 + dy*h, x1 + dx*w, y1 + dy*h);
+                }
+            }
+        }
+    }
+}
+
 /*
  * Returns gradient at (int x, int y) on heightmap `hmap`.
  */
-Vec2 gradient_at(ErodrImage *hmap, int x, int y) {
-    int idx = y * hmap->width + x;
-    int right = idx + ((x > hmap->width - 2) ? 0 : 1);
-    int below = idx + ((y > hmap->height - 2) ? 0 : hmap->width);
+static inline Vec2 gradient_at(ErodrImage *hmap, int x, int y, bool wrap) {
+    int idx = y * hmap->stride + x;
+    int right, below;
+    if (wrap) {
+        right = y * hmap->stride + next_index(x, hmap->width, true);
+        below = next_index(y, hmap->height, true) * hmap->stride + x;
+    } else {
+        right = idx + ((x > hmap->width - 2) ? 0 : 1);
+        below = idx + ((y > hmap->height - 2) ? 0 : hmap->stride);
+    }
     Vec2 g;
     g.x = hmap->data[right] - hmap->data[idx]; 
     g.y = hmap->data[below] - hmap->data[idx];
@@ -121,65 +265,212 @@ Vec2 gradient_at(ErodrImage *hmap, int x, int y) {
  * Returns interpolated gradient and height at (float x, float y) on
  * heightmap `hmap`.
  */
-HeigthGradientTuple height_gradient_at(ErodrImage *hmap, Vec2 pos) {
+static inline HeigthGradientTuple height_gradient_at(ErodrImage *hmap, Vec2 pos, bool wrap) {
     HeigthGradientTuple ret;
     Vec2 ul, ur, ll, lr, ipl_l, ipl_r;
     int x_i = (int)pos.x;
     int y_i = (int)pos.y;
+    int x_n = next_index(x_i, hmap->width, wrap);
+    int y_n = next_index(y_i, hmap->height, wrap);
     float u = pos.x - x_i;
     float v = pos.y - y_i;
-    ul = gradient_at(hmap, x_i, y_i);
-    ur = gradient_at(hmap, x_i + 1, y_i);
-    ll = gradient_at(hmap, x_i, y_i + 1);
-    lr = gradient_at(hmap, x_i + 1, y_i + 1);
+    ul = gradient_at(hmap, x_i, y_i, wrap);
+    ur = gradient_at(hmap, x_n, y_i, wrap);
+    ll = gradient_at(hmap, x_i, y_n, wrap);
+    lr = gradient_at(hmap, x_n, y_n, wrap);
     ipl_l = vec2_add(vec2_scalar_mul(1 - v, ul), vec2_scalar_mul(v, ll));
     ipl_r = vec2_add(vec2_scalar_mul(1 - v, ur), vec2_scalar_mul(v, lr));
     ret.gradient = vec2_add(vec2_scalar_mul(1 - u, ipl_l), vec2_scalar_mul(u, ipl_r));
-    ret.height = bilerp_map(hmap, pos);
+    ret.height = bilerp_map(hmap, pos, wrap);
     return ret;
 }
 
-/*
- * Runs hydraulic erosion simulation.
- */
-#include <assert.h>
-void erosion_sim_run(ErodrImage *hmap, SimulationParameters *params) {
-    if (params->seed == 0) {
-        srand(time(NULL));
-    } else {
-        srand((unsigned int)params->seed);
+int erosion_sim_init(ErosionSim *sim, ErodrImage *full_hmap, SimulationParameters *params, ErodrImage *spawn_density, Workspace *ws)
+{
+    *sim = (ErosionSim) {0};
+    sim->hmap = full_hmap;
+    sim->params = *params;
+    sim->seed = (params->seed == 0) ? (uint64_t)time(NULL) : (uint64_t)params->seed;
+
+    /* 
+     * Region of interest. Particles are spawned inside the ROI and changes
+     * to the heightmap are feathered out around it. A particle moves at most
+     * one pixel per step, so it can never reach further than `ttl` pixels
+     * (plus the erosion radius) outside the ROI. The simulation runs on a
+     * view of the ROI and that halo, so cost scales with the ROI size. In
+     * wrap mode particles may cross the map edges, so the whole map is used.
+     */
+    int view_x0 = 0;
+    int view_y0 = 0;
+    sim->view = *full_hmap;
+    bool roi = write_mask_init(&sim->mask, params, full_hmap->width, full_hmap->height);
+    int roi_x0 = sim->mask.x0;
+    int roi_y0 = sim->mask.y0;
+    int roi_x1 = sim->mask.x1;
+    int roi_y1 = sim->mask.y1;
+    if (roi && params->wrap) {
+        log_info("Simulating region %dx%d at (%d, %d).", roi_x1 - roi_x0, roi_y1 - roi_y0, roi_x0, roi_y0);
+    } else if (roi) {
+        int halo = MAX(params->ttl, 0) + MAX(params->p_radius, 1) + 1;
+        view_x0 = MAX(roi_x0 - halo, 0);
+        view_y0 = MAX(roi_y0 - halo, 0);
+        int view_x1 = MIN(roi_x1 + halo, full_hmap->width);
+        int view_y1 = MIN(roi_y1 + halo, full_hmap->height);
+        sim->view = image_view(full_hmap, view_x0, view_y0, view_x1 - view_x0, view_y1 - view_y0);
+        sim->view_x0 = view_x0;
+        sim->view_y0 = view_y0;
+        log_info("Simulating region %dx%d at (%d, %d) (%dx%d including halo).", roi_x1 - roi_x0,
+                 roi_y1 - roi_y0, roi_x0, roi_y0, sim->view.width, sim->view.height);
+        roi_x0 -= view_x0;
+        roi_x1 -= view_x0;
+        roi_y0 -= view_y0;
+        roi_y1 -= view_y0;
+    }
+    sim->mask.x0 = roi_x0;
+    sim->mask.y0 = roi_y0;
+    sim->mask.x1 = roi_x1;
+    sim->mask.y1 = roi_y1;
+    sim->masked = roi;
+
+    /* importance sampled spawning (restricted to the ROI) */
+    if (params->spawn_mode != SPAWN_MODE_UNIFORM) {
+        ErodrImage spawn_hmap = image_view(&sim->view, roi_x0, roi_y0, roi_x1 - roi_x0, roi_y1 - roi_y0);
+        ErodrImage spawn_density_view;
+        ErodrImage *spawn_density_ptr = spawn_density;
+        if (roi && spawn_density != NULL) {
+            /* the density map may have a different resolution than the heightmap */
+            float sx = (float)spawn_density->width / full_hmap->width;
+            float sy = (float)spawn_density->height / full_hmap->height;
+            int dx0 = MIN((int)((view_x0 + roi_x0) * sx), spawn_density->width - 1);
+            int dy0 = MIN((int)((view_y0 + roi_y0) * sy), spawn_density->height - 1);
+            int dw = MIN(MAX((int)((roi_x1 - roi_x0) * sx), 1), spawn_density->width - dx0);
+            int dh = MIN(MAX((int)((roi_y1 - roi_y0) * sy), 1), spawn_density->height - dy0);
+            spawn_density_view = image_view(spawn_density, dx0, dy0, dw, dh);
+            spawn_density_ptr = &spawn_density_view;
+        }
+        sim->spawn = &ws->spawn;
+        sim->importance_spawn = (spawn_map_build(sim->spawn, &spawn_hmap, spawn_density_ptr, params) == 0);
+        if (!sim->importance_spawn) {
+            log_info("Falling back to uniform particle spawning.");
+        }
     }
 
-    /* simulate each particle */
-    printf("Starting simulation.\n");
-    #pragma omp parallel for
-    for(int i = 0; i < params->n; i++) {
-        if((i % 10000) == 0) {
-            printf("Particles simulated: %d\n", i);
+    return 0;
+}
+
+void erosion_sim_set_layers(ErosionSim *sim, const ErosionLayers *layers)
+{
+    ErodrImage *dst[] = {&sim->layers.flux, &sim->layers.eroded, &sim->layers.deposited, &sim->layers.sediment};
+    const ErodrImage *src[] = {&layers->flux, &layers->eroded, &layers->deposited, &layers->sediment};
+    sim->write_layers = false;
+    for (int i = 0; i < 4; i++) {
+        *dst[i] = (ErodrImage) {0};
+        if (src[i]->data != NULL) {
+            assert(src[i]->width == sim->hmap->width && src[i]->height == sim->hmap->height);
+            *dst[i] = image_view((ErodrImage *) src[i], sim->view_x0, sim->view_y0, sim->view.width, sim->view.height);
+            sim->write_layers = true;
+        }
+    }
+}
+
+int erosion_sim_collect_stats(ErosionSim *sim)
+{
+    if (sim->thread_stats == NULL) {
+        /* one cache line aligned slot per thread; the size of the
+         * _Alignas(64) type is a multiple of 64 as aligned_alloc requires */
+        size_t size = parallel_n_threads() * sizeof(ParticleStats);
+        sim->thread_stats = aligned_alloc(_Alignof(ParticleStats), size);
+        if (sim->thread_stats == NULL) {
+            return -1;
         }
+        memset(sim->thread_stats, 0, size);
+    }
+    return 0;
+}
+
+void erosion_sim_get_stats(const ErosionSim *sim, ParticleStats *stats)
+{
+    if (sim->thread_stats == NULL) {
+        return;
+    }
+    for (int t = 0; t < parallel_n_threads(); t++) {
+        particle_stats_add(stats, &sim->thread_stats[t]);
+    }
+}
+
+void erosion_sim_deinit(ErosionSim *sim)
+{
+    /* the spawn map stays in the workspace for the next run */
+    free(sim->thread_stats);
+    *sim = (ErosionSim) {0};
+}
+
+/*
+ * Simulates particles [first, last). `wrap` and `masked` are constants in
+ * each of the specializations below, so none pays for the other edge mode
+ * or for a write mask it doesn't have.
+ */
+static inline void simulate_particles(void *arg, int64_t first, int64_t last, int thread, bool wrap, bool masked)
+{
+    StepContext *ctx = (StepContext *) arg;
+    ErosionSim *sim = ctx->sim;
+    ErodrImage *hmap = &sim->view;
+    SimulationParameters *params = &sim->params;
+    const WriteMask *mask = &sim->mask;
+    ErosionLayers *layers = &sim->layers;
+    double eroded = 0.0;
+    double deposited = 0.0;
+    ParticleStats stats = {0};
+    double t_trace = trace_begin();
+    double t_start = (sim->counters != NULL) ? timer_now() : 0.0;
+    PROFILE_THREAD_ATTACH(thread);
 
+    /* spawn extent; with wrap the far edge is a valid position too */
+    const float epsilon = 0.0001f;
+    const float spawn_w = (float)(mask->x1 - mask->x0 - (wrap ? 0 : 1)) - epsilon;
+    const float spawn_h = (float)(mask->y1 - mask->y0 - (wrap ? 0 : 1)) - epsilon;
+
+    const bool mark = sim->snapshots != NULL;
+    const bool collect = sim->thread_stats != NULL;
+
+    /* largest positions strictly inside the map, for wrap mode */
+    const float max_x = nextafterf((float)hmap->width, 0.0f);
+    const float max_y = nextafterf((float)hmap->height, 0.0f);
+
+    for(int64_t i = first; i < last; i++) {
         /* spawn particle. */
+        PROFILE_START(t);
         Particle p;
-        const float epsilon = 0.0001f;
-        float denom = (RAND_MAX / ((float)(hmap->width - 1) - epsilon));
-        p.pos = (Vec2){(float)rand() / denom, (float)rand() / denom}; 
+        Rng rng = rng_make(sim->seed, (uint64_t)i);
+        if (sim->importance_spawn) {
+            p.pos = vec2_add(spawn_map_sample(sim->spawn, &rng), (Vec2){(float)mask->x0, (float)mask->y0});
+        } else {
+            p.pos = (Vec2){mask->x0 + rng_float(&rng) * spawn_w, 
+                           mask->y0 + rng_float(&rng) * spawn_h}; 
+        }
         p.dir = (Vec2){0, 0};
         p.vel = params->p_initial_velocity;
         p.sediment = 0;
         p.water = params->p_initial_water;
 
-        if (!(p.pos.x >= 0.0f && p.pos.x < (hmap->width - 1)) ||
-            !(p.pos.y >= 0.0f && p.pos.y < (hmap->height - 1))) {
-            printf("pos = {%f, %f}\n", p.pos.x, p.pos.y);
-            assert(false);
-        }
+        assert(p.pos.x >= 0.0f && p.pos.x < (hmap->width - (wrap ? 0 : 1)));
+        assert(p.pos.y >= 0.0f && p.pos.y < (hmap->height - (wrap ? 0 : 1)));
+        PROFILE_LAP(thread, PROFILE_PHASE_SPAWN, t);
 
+        int steps = MAX(params->ttl, 0);
+        bool left_map = false;
+        Vec2 stall_anchor = p.pos;
         for(int j = 0; j < params->ttl; j++) {
+            if (collect && j == params->ttl - STALL_WINDOW) {
+                stall_anchor = p.pos;
+            }
+
             /* interpolate gradient g and height h_old at p's position. */
             Vec2 pos_old = p.pos;
-            HeigthGradientTuple hg = height_gradient_at(hmap, pos_old);
+            HeigthGradientTuple hg = height_gradient_at(hmap, pos_old, wrap);
             Vec2 g = hg.gradient;
             float h_old = hg.height; 
+            PROFILE_LAP(thread, PROFILE_PHASE_SAMPLE, t);
 
             /* calculate new dir vector */
             p.dir = vec2_sub(vec2_scalar_mul(params->p_inertia, p.dir),
@@ -188,36 +479,488 @@ void erosion_sim_run(ErodrImage *hmap, SimulationParameters *params) {
 
             /* calculate new pos */
             p.pos = vec2_add(p.pos, p.dir);
+            PROFILE_LAP(thread, PROFILE_PHASE_DIRECTION, t);
 
-            /* check bounds */
-            if (p.pos.x >= (hmap->width - 1.0f)  || p.pos.x <= 0.0f || 
-                p.pos.y >= (hmap->height - 1.0f) || p.pos.y <= 0.0f) {
+            /* wrap around or check bounds */
+            if (wrap) {
+                p.pos.x += hmap->width * ((p.pos.x < 0.0f) - (p.pos.x >= hmap->width));
+                p.pos.y += hmap->height * ((p.pos.y < 0.0f) - (p.pos.y >= hmap->height));
+                p.pos.x = fminf(fmaxf(p.pos.x, 0.0f), max_x);
+                p.pos.y = fminf(fmaxf(p.pos.y, 0.0f), max_y);
+            } else if (p.pos.x >= (hmap->width - 1.0f)  || p.pos.x <= 0.0f || 
+                       p.pos.y >= (hmap->height - 1.0f) || p.pos.y <= 0.0f) {
+                PROFILE_EXIT(thread);
+                steps = j;
+                left_map = true;
                 break;
             }
 
             /* new height */
-            float h_new = bilerp_map(hmap, p.pos);
+            float h_new = bilerp_map(hmap, p.pos, wrap);
             float h_diff = h_new - h_old;
+            PROFILE_LAP(thread, PROFILE_PHASE_SAMPLE, t);
 
             /* sediment capacity */
             float c = fmaxf(-h_diff, params->p_min_slope) * p.vel * p.water * params->p_capacity;
 
             /* decide whether to erode or deposit depending on particle properties */
-            if(h_diff > 0 || p.sediment > c) {
+            bool depositing = h_diff > 0 || p.sediment > c;
+            if(depositing) {
                 float to_deposit = (h_diff > 0) ? fminf(p.sediment, h_diff) :
                                                   (p.sediment - c) * params->p_deposition;
                 p.sediment -= to_deposit;
-                deposit(hmap, pos_old, to_deposit); 
+                deposit(hmap, mask, pos_old, to_deposit, wrap, masked);
+                if (layers->deposited.data != NULL) {
+                    deposit(&layers->deposited, mask, pos_old, to_deposit, wrap, masked);
+                }
+                deposited += to_deposit;
             } else {
                 float to_erode = fminf((c - p.sediment) * params->p_erosion, -h_diff);
                 p.sediment += to_erode;
-                erode(hmap, pos_old, to_erode, params->p_radius);
+                erode(hmap, mask, pos_old, to_erode, params->p_radius,
+                      (layers->eroded.data != NULL) ? &layers->eroded : NULL, wrap, masked);
+                eroded += to_erode;
+            }
+
+            if (mark) {
+                mark_dirty(sim, pos_old, depositing ? 1 : params->p_radius, wrap);
+            }
+
+            /* flow through the cell the particle left */
+            if (sim->write_layers) {
+                if (layers->flux.data != NULL) {
+                    splat(&layers->flux, pos_old, p.water, wrap);
+                }
+                if (layers->sediment.data != NULL) {
+                    splat(&layers->sediment, pos_old, p.sediment, wrap);
+                }
             }
 
             /* update `vel` and `water` */
             p.vel = sqrt(p.vel*p.vel + h_diff*params->p_gravity);
             p.water *= (1 - params->p_evaporation);
-        }   
+            PROFILE_LAP(thread, depositing ? PROFILE_PHASE_DEPOSIT : PROFILE_PHASE_ERODE, t);
+        }
+
+        /* particle died */
+        stats.n_particles++;
+        stats.total_steps += steps;
+        if (collect) {
+            stats.lifetime[(int64_t)steps * PARTICLE_STATS_BINS / (MAX(params->ttl, 0) + 1)]++;
+            stats.sediment_at_death += p.sediment;
+            if (left_map) {
+                stats.n_left_map++;
+            } else {
+                Vec2 moved = vec2_sub(p.pos, stall_anchor);
+                if (wrap) {
+                    /* shortest way around the torus, in case the particle crossed an edge */
+                    moved.x -= hmap->width * ((moved.x > 0.5f * hmap->width) - (moved.x < -0.5f * hmap->width));
+                    moved.y -= hmap->height * ((moved.y > 0.5f * hmap->height) - (moved.y < -0.5f * hmap->height));
+                }
+                if (moved.x * moved.x + moved.y * moved.y < STALL_DISTANCE * STALL_DISTANCE) {
+                    stats.n_stalled++;
+                } else {
+                    stats.n_ttl_reached++;
+                }
+            }
+        }
+    }
+
+    ctx->totals[thread].eroded += eroded;
+    ctx->totals[thread].deposited += deposited;
+    if (collect) {
+        stats.eroded = eroded;
+        stats.deposited = deposited;
+        particle_stats_add(&sim->thread_stats[thread], &stats);
+    }
+    if (sim->counters != NULL) {
+        sim_counters_add(sim->counters, thread, stats.n_particles, stats.total_steps, timer_now() - t_start);
+    }
+    trace_end_n("particle chunk", "sim", t_trace, last - first);
+}
+
+static void simulate_particles_clamped(void *arg, int64_t first, int64_t last, int thread)
+{
+    simulate_particles(arg, first, last, thread, false, false);
+}
+
+static void simulate_particles_wrapped(void *arg, int64_t first, int64_t last, int thread)
+{
+    simulate_particles(arg, first, last, thread, true, false);
+}
+
+static void simulate_particles_clamped_masked(void *arg, int64_t first, int64_t last, int thread)
+{
+    simulate_particles(arg, first, last, thread, false, true);
+}
+
+static void simulate_particles_wrapped_masked(void *arg, int64_t first, int64_t last, int thread)
+{
+    simulate_particles(arg, first, last, thread, true, true);
+}
+
+void erosion_sim_step(ErosionSim *sim, int64_t n_particles)
+{
+    StepContext ctx = {.sim = sim};
+    const int64_t first = sim->n_simulated;
+    const int64_t last = first + n_particles;
+    ParallelForFn fn;
+    if (sim->masked) {
+        fn = sim->params.wrap ? simulate_particles_wrapped_masked : simulate_particles_clamped_masked;
+    } else {
+        fn = sim->params.wrap ? simulate_particles_wrapped : simulate_particles_clamped;
+    }
+    parallel_for(first, last, PARTICLE_GRAIN, fn, &ctx);
+
+    int n_threads = parallel_n_threads();
+    for (int t = 0; t < n_threads; t++) {
+        sim->eroded += ctx.totals[t].eroded;
+        sim->deposited += ctx.totals[t].deposited;
+    }
+    sim->n_simulated = last;
+}
+
+/*
+ * Hands the current state of `sim` to the checkpoint writer if at least
+ * `checkpoint_interval` particles have been simulated since the last
+ * checkpoint.
+ */
+static void maybe_checkpoint(ErosionSim *sim, const ErosionSimOptions *opts, int64_t *last_checkpoint)
+{
+    if (opts == NULL || opts->checkpoint_writer == NULL ||
+        sim->n_simulated - *last_checkpoint < opts->checkpoint_interval ||
+        sim->n_simulated >= sim->params.n) {
+        return;
+    }
+    Checkpoint ckpt = {
+        .params      = sim->params,
+        .seed        = sim->seed,
+        .n_simulated = sim->n_simulated,
+        .eroded      = sim->eroded,
+        .deposited   = sim->deposited,
+        .hmap        = *sim->hmap,
+    };
+    if (checkpoint_writer_submit(opts->checkpoint_writer, &ckpt)) {
+        *last_checkpoint = sim->n_simulated;
+    } else {
+        log_info("Previous checkpoint still being written, skipping checkpoint.");
+    }
+}
+
+/*
+ * Returns the number of particles to simulate in about `slice` seconds,
+ * given that `n_batch` particles took `elapsed` seconds.
+ */
+static int64_t slice_batch(int64_t n_batch, double elapsed, double slice)
+{
+    double n = (double) n_batch * slice / fmax(elapsed, 1e-6);
+    return (int64_t) fmin(fmax(n, (double) PARTICLE_GRAIN), (double) INT32_MAX);
+}
+
+/*
+ * Returns true if the run has been cancelled through the cancel flag of
+ * `opts`.
+ */
+static bool is_cancelled(const ErosionSimOptions *opts)
+{
+    return opts != NULL && opts->cancel != NULL && atomic_load_explicit(opts->cancel, memory_order_relaxed);
+}
+
+/*
+ * Takes over the particle coefficients of the live parameters of `opts`.
+ * Parameters that shape the whole run (particle count, ttl, radius, seed,
+ * spawning, region of interest) stay as they were at the start.
+ */
+static void apply_live_params(ErosionSim *sim, const ErosionSimOptions *opts)
+{
+    if (opts == NULL || opts->live == NULL) {
+        return;
+    }
+    const SimulationParameters *live = opts->live;
+    SimulationParameters *params = &sim->params;
+    params->p_inertia          = live->p_inertia;
+    params->p_capacity         = live->p_capacity;
+    params->p_gravity          = live->p_gravity;
+    params->p_evaporation      = live->p_evaporation;
+    params->p_erosion          = live->p_erosion;
+    params->p_deposition       = live->p_deposition;
+    params->p_min_slope        = live->p_min_slope;
+    params->p_initial_velocity = live->p_initial_velocity;
+    params->p_initial_water    = live->p_initial_water;
+}
+
+/*
+ * Publishes a snapshot of the heightmap (if the snapshot budget allows),
+ * reports the progress of `sim` to the progress callback of `opts` and
+ * applies live parameter changes. Returns false if the run should be
+ * cancelled.
+ */
+static bool report_progress(ErosionSim *sim, const ErosionSimOptions *opts)
+{
+    if (opts != NULL && opts->snapshots != NULL) {
+        snapshot_publish(opts->snapshots, sim->hmap, false);
+    }
+    if (opts != NULL && opts->progress != NULL &&
+        !opts->progress(opts->progress_user, sim->n_simulated, sim->params.n)) {
+        return false;
+    }
+    apply_live_params(sim, opts);
+    return !is_cancelled(opts);
+}
+
+/*
+ * Simulates the next `n_particles` particles of `sim`. If `opts` asks for
+ * time slicing, the particles are simulated in batches of about
+ * `opts->slice` seconds (`*batch` particles, adjusted after every batch)
+ * and the cancel flag is checked in between. Returns false if cancelled.
+ */
+static bool step_sliced(ErosionSim *sim, int64_t n_particles, const ErosionSimOptions *opts, int64_t *batch)
+{
+    if (opts == NULL || opts->slice <= 0.0) {
+        erosion_sim_step(sim, n_particles);
+        return true;
+    }
+    int64_t end = sim->n_simulated + n_particles;
+    while (sim->n_simulated < end) {
+        int64_t n_batch = MIN(*batch, end - sim->n_simulated);
+        double t_step = timer_now();
+        erosion_sim_step(sim, n_batch);
+        *batch = slice_batch(n_batch, timer_now() - t_step, opts->slice);
+        if (is_cancelled(opts)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Accumulates the L1 and L-infinity change between `ctx->hmap` and
+ * `ctx->prev` over rows [y0, y1).
+ */
+static void epoch_change_rows(void *arg, int64_t y0, int64_t y1, int thread)
+{
+    EpochChangeContext *ctx = (EpochChangeContext *) arg;
+    ErodrImage *hmap = ctx->hmap;
+    ErodrImage *prev = ctx->prev;
+    double l1 = 0.0;
+    float linf = 0.0f;
+    for (int64_t y = y0; y < y1; y++) {
+        for (int x = 0; x < hmap->width; x++) {
+            float d = fabsf(hmap->data[y * hmap->stride + x] - prev->data[y * prev->stride + x]);
+            l1 += d;
+            linf = fmaxf(linf, d);
+        }
+    }
+    ctx->partial[thread].l1 += l1;
+    ctx->partial[thread].linf = fmaxf(ctx->partial[thread].linf, linf);
+}
+
+/*
+ * Runs particles in epochs of `epoch_size` particles until the per-epoch
+ * change of the heightmap has converged, the time budget has run out or
+ * `params->n` particles have been simulated. Returns false if cancelled.
+ */
+static bool erosion_sim_run_adaptive(ErosionSim *sim, const ErosionSimOptions *opts, Workspace *ws)
+{
+    SimulationParameters *params = &sim->params;
+    ErodrImage *hmap = &sim->view;
+    ErodrImage *prev = workspace_image(ws, WORKSPACE_SLOT_EPOCH, hmap->width, hmap->height);
+    if (prev == NULL) {
+        log_error("Error: could not allocate epoch buffer.");
+        erosion_sim_step(sim, params->n - sim->n_simulated);
+        return true;
+    }
+
+    const int64_t epoch_size = MAX(params->epoch_size, 1);
+    int64_t batch = PROGRESS_INTERVAL;
+    double t_start = timer_now();
+    double first_l1 = 0.0;
+    double l1_window[ADAPTIVE_WINDOW] = {0};
+    const char *reason = "particle limit reached";
+    int64_t last_checkpoint = sim->n_simulated;
+    bool completed = true;
+    for (int epoch = 0; sim->n_simulated < params->n; epoch++) {
+        double t_epoch = trace_begin();
+        PROFILE_REGION_BEGIN("epoch analysis");
+        image_copy(prev, hmap);
+        PROFILE_REGION_END();
+        double eroded_before = sim->eroded;
+        PROFILE_REGION_BEGIN("particles");
+        bool cancelled = !step_sliced(sim, MIN(epoch_size, params->n - sim->n_simulated), opts, &batch);
+        PROFILE_REGION_END();
+        if (cancelled) {
+            reason = "cancelled";
+            completed = false;
+            trace_end_n("epoch", "sim", t_epoch, epoch);
+            break;
+        }
+
+        /* change of the heightmap during this epoch */
+        PROFILE_REGION_BEGIN("epoch analysis");
+        EpochChangeContext change = {.hmap = hmap, .prev = prev};
+        parallel_for(0, hmap->height, 16, epoch_change_rows, &change);
+        double l1 = 0.0;
+        float linf = 0.0f;
+        for (int t = 0; t < parallel_n_threads(); t++) {
+            l1 += change.partial[t].l1;
+            linf = fmaxf(linf, change.partial[t].linf);
+        }
+        PROFILE_REGION_END();
+        
+        /* moving average of the per-epoch change, relative to the first epoch */
+        if (epoch == 0) {
+            first_l1 = l1;
+        }
+        l1_window[epoch % ADAPTIVE_WINDOW] = l1;
+        double l1_avg = 0.0;
+        int n_window = MIN(epoch + 1, ADAPTIVE_WINDOW);
+        for (int i = 0; i < n_window; i++) {
+            l1_avg += l1_window[i] / n_window;
+        }
+        double rel_change = (first_l1 > 0.0) ? l1_avg / first_l1 : 0.0;
+        double elapsed = timer_now() - t_start;
+        log_info("Epoch %d: particles = %ld, L1 = %g, Linf = %g, eroded = %g, relative change = %.4f, time = %.2f s",
+                 epoch, (long)sim->n_simulated, l1, linf, sim->eroded - eroded_before, rel_change, elapsed);
+
+        PROFILE_REGION_BEGIN("checkpoint");
+        maybe_checkpoint(sim, opts, &last_checkpoint);
+        PROFILE_REGION_END();
+        trace_end_n("epoch", "sim", t_epoch, epoch);
+
+        if (!report_progress(sim, opts)) {
+            reason = "cancelled";
+            completed = false;
+            break;
+        }
+        if (params->converge_threshold > 0.0f && epoch >= ADAPTIVE_WINDOW - 1 &&
+            rel_change < params->converge_threshold) {
+            reason = "converged";
+            break;
+        }
+        if (params->time_budget > 0.0f && elapsed >= params->time_budget) {
+            reason = "time budget exhausted";
+            break;
+        }
+    }
+    log_info("Adaptive simulation stopped (%s) after %ld particles.", reason, (long)sim->n_simulated);
+    return completed;
+}
+
+int erosion_layers_alloc(ErosionLayers *layers, int width, int height,
+                         bool flux, bool eroded, bool deposited, bool sediment)
+{
+    *layers = (ErosionLayers) {0};
+    ErodrImage *images[] = {&layers->flux, &layers->eroded, &layers->deposited, &layers->sediment};
+    bool selected[] = {flux, eroded, deposited, sediment};
+    for (int i = 0; i < 4; i++) {
+        if (!selected[i]) {
+            continue;
+        }
+        *images[i] = image_alloc(width, height);
+        if (images[i]->data == NULL) {
+            erosion_layers_free(layers);
+            return -1;
+        }
+    }
+    erosion_layers_clear(layers);
+    return 0;
+}
+
+void erosion_layers_clear(ErosionLayers *layers)
+{
+    ErodrImage *images[] = {&layers->flux, &layers->eroded, &layers->deposited, &layers->sediment};
+    for (int i = 0; i < 4; i++) {
+        if (images[i]->data != NULL) {
+            memset(images[i]->data, 0, sizeof(float) * images[i]->width * images[i]->height);
+        }
+    }
+}
+
+void erosion_layers_free(ErosionLayers *layers)
+{
+    image_free(&layers->flux);
+    image_free(&layers->eroded);
+    image_free(&layers->deposited);
+    image_free(&layers->sediment);
+    *layers = (ErosionLayers) {0};
+}
+
+/*
+ * Runs hydraulic erosion simulation.
+ */
+bool erosion_sim_run(ErodrImage *hmap, SimulationParameters *params, const ErosionSimOptions *opts) {
+    Workspace local_ws = {0};
+    Workspace *ws = (opts != NULL && opts->workspace != NULL) ? opts->workspace : &local_ws;
+
+    PROFILE_REGION_BEGIN("init");
+    ErosionSim sim;
+    erosion_sim_init(&sim, hmap, params, (opts != NULL) ? opts->spawn_density : NULL, ws);
+    if (opts != NULL && opts->layers != NULL) {
+        erosion_sim_set_layers(&sim, opts->layers);
+    }
+    if (opts != NULL && opts->stats != NULL && erosion_sim_collect_stats(&sim) != 0) {
+        log_error("Error: could not allocate particle statistics.");
+    }
+    if (opts != NULL && opts->snapshots != NULL) {
+        /* other stages may have changed the heightmap since the last publish */
+        sim.snapshots = opts->snapshots;
+        snapshot_mark_all(sim.snapshots);
+    }
+    if (opts != NULL) {
+        sim.counters = opts->counters;
+    }
+    PROFILE_REGION_END();
+
+    /* continue where the checkpoint left off */
+    if (opts != NULL && opts->resume != NULL) {
+        sim.seed        = opts->resume->seed;
+        sim.n_simulated = opts->resume->n_simulated;
+        sim.eroded      = opts->resume->eroded;
+        sim.deposited   = opts->resume->deposited;
+        log_info("Resuming simulation at particle %ld.", (long)sim.n_simulated);
+    }
+
+    log_info("Starting simulation.");
+    bool completed = true;
+    if (params->converge_threshold > 0.0f || params->time_budget > 0.0f) {
+        completed = erosion_sim_run_adaptive(&sim, opts, ws);
+    } else {
+        /* only split the run into batches if something happens in between */
+        bool sliced = opts != NULL && opts->slice > 0.0;
+        int64_t batch = params->n;
+        if (opts != NULL && (opts->progress != NULL || opts->snapshots != NULL || sliced)) {
+            batch = PROGRESS_INTERVAL;
+        }
+        int64_t max_batch = params->n;
+        if (opts != NULL && opts->checkpoint_writer != NULL && opts->checkpoint_interval > 0) {
+            max_batch = opts->checkpoint_interval;
+        }
+        int64_t last_checkpoint = sim.n_simulated;
+        while (completed && sim.n_simulated < params->n) {
+            int64_t n_batch = MIN(MIN(batch, max_batch), params->n - sim.n_simulated);
+            double t_batch = trace_begin();
+            double t_step = timer_now();
+            PROFILE_REGION_BEGIN("particles");
+            erosion_sim_step(&sim, n_batch);
+            PROFILE_REGION_END();
+            if (sliced) {
+                batch = slice_batch(n_batch, timer_now() - t_step, opts->slice);
+            }
+            trace_end_n("particle batch", "sim", t_batch, n_batch);
+            PROFILE_REGION_BEGIN("checkpoint");
+            maybe_checkpoint(&sim, opts, &last_checkpoint);
+            PROFILE_REGION_END();
+            completed = report_progress(&sim, opts);
+        }
+    }
+    log_info("Simulation %s.", completed ? "finished" : "cancelled");
+    if (opts != NULL && opts->stats != NULL) {
+        erosion_sim_get_stats(&sim, opts->stats);
+    }
+
+    erosion_sim_deinit(&sim);
+    if (ws == &local_ws) {
+        workspace_free(&local_ws);
     }
-    printf("Simulation finished.\n");
+    return completed;
 }
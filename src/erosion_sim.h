@@ -3,8 +3,140 @@
 
 #include "image.h"
 #include "params.h"
+#include "spawn.h"
+#include "checkpoint.h"
+#include "workspace.h"
+#include "particle_stats.h"
+#include "snapshot.h"
+#include "sim_counters.h"
+#include "write_mask.h"
 
-void erosion_sim_run(ErodrImage *hmap, SimulationParameters *params);
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Optional output layers accumulated during a run, with the dimensions of
+ * the heightmap. Layers with NULL data are not computed. Like the
+ * heightmap, layers are updated without synchronization between threads.
+ */
+typedef struct ErosionLayers {
+    ErodrImage flux;      /* water passing through each cell (flow accumulation) */
+    ErodrImage eroded;    /* material eroded from each cell */
+    ErodrImage deposited; /* material deposited on each cell */
+    ErodrImage sediment;  /* sediment carried through each cell */
+} ErosionLayers;
+
+/*
+ * State of a hydraulic erosion simulation in progress. Particles are
+ * simulated in batches with `erosion_sim_step`. Particle `i` always gets the
+ * same random numbers, so splitting a run into batches doesn't change the
+ * spawn positions.
+ */
+typedef struct ErosionSim {
+    ErodrImage *hmap;             /* the full heightmap */
+    ErodrImage view;              /* the part of `hmap` being simulated (ROI + halo) */
+    int view_x0;                  /* origin of `view` in `hmap` */
+    int view_y0;
+    SimulationParameters params;
+    WriteMask mask;               /* ROI in `view` coordinates */
+    bool masked;                  /* writes are weighted by `mask`; without a ROI it is skipped */
+    SpawnMap *spawn;              /* owned by the workspace */
+    bool importance_spawn;
+    uint64_t seed;
+    int64_t n_simulated;          /* index of the next particle */
+    double eroded;                /* total amount of eroded material */
+    double deposited;             /* total amount of deposited material */
+    ParticleStats *thread_stats;  /* per-thread particle statistics, NULL if not collected */
+    ErosionLayers layers;         /* views of the output layers matching `view` */
+    bool write_layers;
+    SnapshotBuffer *snapshots;    /* tiles of `hmap` changed by particles are marked dirty in it */
+    SimCounters *counters;        /* live throughput counters, NULL if not kept */
+} ErosionSim;
+
+/*
+ * Progress callback. Called with the number of particles simulated so far
+ * and the total number of particles of the run. Returning false cancels
+ * the run.
+ */
+typedef bool (*ErosionProgressFn)(void *user, int64_t n_simulated, int64_t n_total);
+
+/*
+ * Optional inputs of `erosion_sim_run`. All fields may be NULL/0.
+ */
+typedef struct ErosionSimOptions {
+    ErodrImage *spawn_density;           /* spawn density map used with SPAWN_MODE_MAP */
+    CheckpointWriter *checkpoint_writer; /* if set, checkpoints are written periodically */
+    int64_t checkpoint_interval;         /* number of particles between checkpoints */
+    Checkpoint *resume;                  /* if set, the run continues from this checkpoint */
+    Workspace *workspace;                /* scratch buffers reused between runs */
+    ErosionProgressFn progress;          /* called between batches of particles */
+    void *progress_user;
+    ParticleStats *stats;                /* if set, particle statistics of the run are added to it */
+    ErosionLayers *layers;               /* if set, output layers are accumulated into it */
+    SnapshotBuffer *snapshots;           /* if set, the heightmap is published between batches */
+    const atomic_bool *cancel;           /* if set, the run stops once it becomes true */
+    double slice;                        /* if > 0, batches are sized to take about `slice` seconds */
+    const SimulationParameters *live;    /* if set, particle coefficients are re-read from it between batches */
+    SimCounters *counters;               /* if set, simulated particles, steps and busy time are added to it */
+} ErosionSimOptions;
+
+/*
+ * Prepares simulation `sim` of heightmap `hmap`. `spawn_density` is an
+ * optional (may be NULL) spawn density map used with SPAWN_MODE_MAP. The
+ * spawn map is built in workspace `ws`, which must outlive `sim`. Returns
+ * 0 on success.
+ */
+int erosion_sim_init(ErosionSim *sim, ErodrImage *hmap, SimulationParameters *params, ErodrImage *spawn_density, Workspace *ws);
+
+/*
+ * Simulates the next `n_particles` particles of `sim`.
+ */
+void erosion_sim_step(ErosionSim *sim, int64_t n_particles);
+
+/*
+ * Accumulates the output layers of `sim` into `layers` (heightmap sized).
+ */
+void erosion_sim_set_layers(ErosionSim *sim, const ErosionLayers *layers);
+
+/*
+ * Starts collecting particle statistics in `sim`. Returns 0 on success.
+ */
+int erosion_sim_collect_stats(ErosionSim *sim);
+
+/*
+ * Adds the particle statistics collected by `sim` to `stats`.
+ */
+void erosion_sim_get_stats(const ErosionSim *sim, ParticleStats *stats);
+
+/*
+ * Frees resources held by `sim`.
+ */
+void erosion_sim_deinit(ErosionSim *sim);
+
+/*
+ * Allocates the layers of `layers` selected by `flux`, `eroded`,
+ * `deposited` and `sediment` with dimensions `width` x `height`. Returns 0
+ * on success.
+ */
+int erosion_layers_alloc(ErosionLayers *layers, int width, int height,
+                         bool flux, bool eroded, bool deposited, bool sediment);
+
+/*
+ * Sets all allocated layers of `layers` to 0.
+ */
+void erosion_layers_clear(ErosionLayers *layers);
+
+/*
+ * Frees the layers of `layers`.
+ */
+void erosion_layers_free(ErosionLayers *layers);
+
+/*
+ * Runs hydraulic erosion simulation on heightmap `hmap`. `opts` may be NULL.
+ * Returns false if the run was cancelled by the progress callback.
+ */
+bool erosion_sim_run(ErodrImage *hmap, SimulationParameters *params, const ErosionSimOptions *opts);
 
 #endif /* EROSION_SIM_H */
 
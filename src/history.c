@@ -0,0 +1,358 @@
+#include "history.h"
+#include "thread_pool.h"
+#include "trace.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+#define TILE_FLOATS (HISTORY_TILE_SIZE * HISTORY_TILE_SIZE)
+#define TILE_BYTES  (4 * TILE_FLOATS)
+
+/* longest run of a single token of the encoding */
+#define MAX_RUN 128
+
+/* worst case size of an encoded tile: a token for every MAX_RUN literals */
+#define ENCODED_BOUND (TILE_BYTES + TILE_BYTES / MAX_RUN + 1)
+
+/* tiles encoded per parallel pass, bounding the size of the scratch buffer */
+#define CHUNK_TILES 256
+
+/*
+ * Run-length encodes the `n` bytes of `in` into `out` (at least
+ * ENCODED_BOUND bytes). A token byte with the high bit set stands for
+ * (low bits + 1) zeros, otherwise (low bits + 1) literal bytes follow it.
+ * Returns the encoded size.
+ */
+static size_t encode(uint8_t *out, const uint8_t *in, size_t n)
+{
+    size_t o = 0;
+    size_t i = 0;
+    while (i < n) {
+        size_t z = i;
+        while (z < n && z - i < MAX_RUN && in[z] == 0) {
+            z++;
+        }
+        if (z - i >= 2) {
+            out[o++] = (uint8_t) (0x80 | (z - i - 1));
+            i = z;
+            continue;
+        }
+
+        /* literals up to the next run of zeros */
+        size_t l = i;
+        while (l < n && l - i < MAX_RUN && !(in[l] == 0 && l + 1 < n && in[l + 1] == 0)) {
+            l++;
+        }
+        out[o++] = (uint8_t) (l - i - 1);
+        memcpy(&out[o], &in[i], l - i);
+        o += l - i;
+        i = l;
+    }
+    return o;
+}
+
+/*
+ * Decodes the `size` bytes of `in` encoded by `encode` into `out`.
+ */
+static void decode(uint8_t *out, const uint8_t *in, size_t size)
+{
+    size_t o = 0;
+    size_t i = 0;
+    while (i < size) {
+        uint8_t token = in[i++];
+        size_t len = (size_t) (token & 0x7f) + 1;
+        if (token & 0x80) {
+            memset(&out[o], 0, len);
+        } else {
+            memcpy(&out[o], &in[i], len);
+            i += len;
+        }
+        o += len;
+    }
+}
+
+/*
+ * Returns the view of tile `tile` of `img`.
+ */
+static ErodrImage tile_view(const History *h, ErodrImage *img, int tile)
+{
+    int x = (tile % h->tiles_x) * HISTORY_TILE_SIZE;
+    int y = (tile / h->tiles_x) * HISTORY_TILE_SIZE;
+    return image_view(img, x, y, MIN(HISTORY_TILE_SIZE, img->width - x), MIN(HISTORY_TILE_SIZE, img->height - y));
+}
+
+/*
+ * Writes the XOR of the bit patterns of `a` and `b` to `planes` as four
+ * byte planes, least significant byte first.
+ */
+static void xor_to_planes(uint8_t *planes, const ErodrImage *a, const ErodrImage *b)
+{
+    int n = a->width * a->height;
+    int k = 0;
+    for (int y = 0; y < a->height; y++) {
+        const uint32_t *ra = (const uint32_t *) &a->data[y * a->stride];
+        const uint32_t *rb = (const uint32_t *) &b->data[y * b->stride];
+        for (int x = 0; x < a->width; x++, k++) {
+            uint32_t d = ra[x] ^ rb[x];
+            planes[k]         = (uint8_t) d;
+            planes[n + k]     = (uint8_t) (d >> 8);
+            planes[2 * n + k] = (uint8_t) (d >> 16);
+            planes[3 * n + k] = (uint8_t) (d >> 24);
+        }
+    }
+}
+
+/*
+ * XORs the bit patterns of `img` with the byte planes `planes`.
+ */
+static void xor_from_planes(ErodrImage *img, const uint8_t *planes)
+{
+    int n = img->width * img->height;
+    int k = 0;
+    for (int y = 0; y < img->height; y++) {
+        uint32_t *r = (uint32_t *) &img->data[y * img->stride];
+        for (int x = 0; x < img->width; x++, k++) {
+            r[x] ^= (uint32_t) planes[k] |
+                    (uint32_t) planes[n + k] << 8 |
+                    (uint32_t) planes[2 * n + k] << 16 |
+                    (uint32_t) planes[3 * n + k] << 24;
+        }
+    }
+}
+
+typedef struct TileContext {
+    History *h;
+    ErodrImage *hmap;
+    const int32_t *tiles;
+    const HistoryEntry *entry;
+    uint32_t sizes[CHUNK_TILES];
+} TileContext;
+
+/*
+ * Flags the tiles [t0, t1) that differ between `ctx->hmap` and the
+ * current state.
+ */
+static void compare_tiles(void *arg, int64_t t0, int64_t t1, int thread)
+{
+    (void) thread;
+    TileContext *ctx = (TileContext *) arg;
+    for (int64_t t = t0; t < t1; t++) {
+        ErodrImage a = tile_view(ctx->h, &ctx->h->current, (int) t);
+        ErodrImage b = tile_view(ctx->h, ctx->hmap, (int) t);
+        bool changed = false;
+        for (int y = 0; y < a.height && !changed; y++) {
+            changed = memcmp(&a.data[y * a.stride], &b.data[y * b.stride], a.width * sizeof(float)) != 0;
+        }
+        ctx->h->changed[t] = changed;
+    }
+}
+
+/*
+ * Encodes tiles [i0, i1) of `ctx->tiles` into the scratch buffer and
+ * brings them up to date in the current state.
+ */
+static void encode_tiles(void *arg, int64_t i0, int64_t i1, int thread)
+{
+    (void) thread;
+    TileContext *ctx = (TileContext *) arg;
+    uint8_t planes[TILE_BYTES];
+    for (int64_t i = i0; i < i1; i++) {
+        ErodrImage a = tile_view(ctx->h, &ctx->h->current, ctx->tiles[i]);
+        ErodrImage b = tile_view(ctx->h, ctx->hmap, ctx->tiles[i]);
+        xor_to_planes(planes, &a, &b);
+        ctx->sizes[i] = (uint32_t) encode(&ctx->h->scratch[i * ENCODED_BOUND], planes, 4 * a.width * a.height);
+        image_copy(&a, &b);
+    }
+}
+
+/*
+ * Applies tiles [i0, i1) of `ctx->entry` to `ctx->hmap` and the current
+ * state.
+ */
+static void apply_tiles(void *arg, int64_t i0, int64_t i1, int thread)
+{
+    (void) thread;
+    TileContext *ctx = (TileContext *) arg;
+    const HistoryEntry *e = ctx->entry;
+    uint8_t planes[TILE_BYTES];
+    for (int64_t i = i0; i < i1; i++) {
+        decode(planes, &e->data[e->offsets[i]], e->offsets[i + 1] - e->offsets[i]);
+        ErodrImage a = tile_view(ctx->h, ctx->hmap, e->tiles[i]);
+        ErodrImage b = tile_view(ctx->h, &ctx->h->current, e->tiles[i]);
+        xor_from_planes(&a, planes);
+        xor_from_planes(&b, planes);
+    }
+}
+
+static void entry_free(HistoryEntry *e)
+{
+    free(e->tiles);
+    free(e->offsets);
+    free(e->data);
+}
+
+/*
+ * Drops all entries from index `first` on.
+ */
+static void truncate_entries(History *h, int first)
+{
+    for (int i = first; i < h->n_entries; i++) {
+        h->size -= h->entries[i].size;
+        entry_free(&h->entries[i]);
+    }
+    h->n_entries = first;
+    h->position = MIN(h->position, first);
+}
+
+int history_init(History *h, ErodrImage *hmap, size_t budget)
+{
+    *h = (History) {0};
+    h->tiles_x = (hmap->width + HISTORY_TILE_SIZE - 1) / HISTORY_TILE_SIZE;
+    h->tiles_y = (hmap->height + HISTORY_TILE_SIZE - 1) / HISTORY_TILE_SIZE;
+    h->budget  = budget;
+    h->current = image_alloc(hmap->width, hmap->height);
+    h->changed = calloc((size_t) h->tiles_x * h->tiles_y, 1);
+    h->scratch = malloc((size_t) CHUNK_TILES * ENCODED_BOUND);
+    if (h->current.data == NULL || h->changed == NULL || h->scratch == NULL) {
+        history_free(h);
+        return -1;
+    }
+    image_copy(&h->current, hmap);
+    return 0;
+}
+
+void history_free(History *h)
+{
+    truncate_entries(h, 0);
+    free(h->entries);
+    image_free(&h->current);
+    free(h->changed);
+    free(h->scratch);
+    *h = (History) {0};
+}
+
+int history_commit(History *h, ErodrImage *hmap)
+{
+    double t_trace = trace_begin();
+    int n_tiles = h->tiles_x * h->tiles_y;
+    TileContext ctx = {.h = h, .hmap = hmap};
+    parallel_for(0, n_tiles, 16, compare_tiles, &ctx);
+    HistoryEntry e = {0};
+    for (int t = 0; t < n_tiles; t++) {
+        e.n_tiles += h->changed[t];
+    }
+    if (e.n_tiles == 0) {
+        return 0;
+    }
+
+    /* encode chunk by chunk, appending to the entry */
+    size_t capacity = 0;
+    e.tiles   = malloc(e.n_tiles * sizeof(int32_t));
+    e.offsets = malloc((e.n_tiles + 1) * sizeof(uint32_t));
+    bool ok = e.tiles != NULL && e.offsets != NULL;
+    if (ok && h->position == h->capacity) {
+        int new_capacity = (h->capacity == 0) ? 16 : 2 * h->capacity;
+        HistoryEntry *entries = realloc(h->entries, new_capacity * sizeof(HistoryEntry));
+        ok = entries != NULL;
+        if (ok) {
+            h->entries = entries;
+            h->capacity = new_capacity;
+        }
+    }
+    if (ok) {
+        int i = 0;
+        for (int t = 0; t < n_tiles; t++) {
+            if (h->changed[t]) {
+                e.tiles[i++] = t;
+            }
+        }
+    }
+    uint32_t size = 0;
+    for (int c = 0; ok && c < e.n_tiles; c += CHUNK_TILES) {
+        int n = MIN(CHUNK_TILES, e.n_tiles - c);
+        ctx.tiles = &e.tiles[c];
+        parallel_for(0, n, 1, encode_tiles, &ctx);
+        for (int i = 0; ok && i < n; i++) {
+            if (size + ctx.sizes[i] > capacity) {
+                capacity = 2 * (size + ctx.sizes[i]);
+                uint8_t *data = realloc(e.data, capacity);
+                ok = data != NULL;
+                e.data = ok ? data : e.data;
+                if (!ok) {
+                    break;
+                }
+            }
+            e.offsets[c + i] = size;
+            memcpy(&e.data[size], &h->scratch[i * ENCODED_BOUND], ctx.sizes[i]);
+            size += ctx.sizes[i];
+        }
+    }
+    if (!ok) {
+        /* tiles may have been brought up to date without being recorded */
+        entry_free(&e);
+        truncate_entries(h, 0);
+        image_copy(&h->current, hmap);
+        return -1;
+    }
+    e.offsets[e.n_tiles] = size;
+    uint8_t *data = realloc(e.data, size);
+    e.data = (data != NULL) ? data : e.data;
+    e.size = size + e.n_tiles * sizeof(int32_t) + (e.n_tiles + 1) * sizeof(uint32_t);
+
+    /* the entries that could have been redone are gone */
+    truncate_entries(h, h->position);
+    h->entries[h->n_entries++] = e;
+    h->position = h->n_entries;
+    h->size += e.size;
+
+    /* stay within the budget, oldest entries first */
+    int n_dropped = 0;
+    while (h->size > h->budget && n_dropped < h->n_entries) {
+        h->size -= h->entries[n_dropped].size;
+        entry_free(&h->entries[n_dropped]);
+        n_dropped++;
+    }
+    if (n_dropped > 0) {
+        memmove(h->entries, &h->entries[n_dropped], (h->n_entries - n_dropped) * sizeof(HistoryEntry));
+        h->n_entries -= n_dropped;
+        h->position -= n_dropped;
+    }
+    trace_end_n("history commit", "history", t_trace, e.n_tiles);
+    return e.n_tiles;
+}
+
+/*
+ * Applies entry `e` to `hmap` and the current state, in either direction.
+ */
+static void apply_entry(History *h, const HistoryEntry *e, ErodrImage *hmap, SnapshotBuffer *snapshots)
+{
+    double t_trace = trace_begin();
+    TileContext ctx = {.h = h, .hmap = hmap, .entry = e};
+    parallel_for(0, e->n_tiles, 4, apply_tiles, &ctx);
+    for (int i = 0; snapshots != NULL && i < e->n_tiles; i++) {
+        int x = (e->tiles[i] % h->tiles_x) * HISTORY_TILE_SIZE;
+        int y = (e->tiles[i] / h->tiles_x) * HISTORY_TILE_SIZE;
+        snapshot_mark_dirty(snapshots, x, y, x + HISTORY_TILE_SIZE - 1, y + HISTORY_TILE_SIZE - 1);
+    }
+    trace_end_n("history apply", "history", t_trace, e->n_tiles);
+}
+
+bool history_undo(History *h, ErodrImage *hmap, SnapshotBuffer *snapshots)
+{
+    if (h->position == 0) {
+        return false;
+    }
+    apply_entry(h, &h->entries[--h->position], hmap, snapshots);
+    return true;
+}
+
+bool history_redo(History *h, ErodrImage *hmap, SnapshotBuffer *snapshots)
+{
+    if (h->position == h->n_entries) {
+        return false;
+    }
+    apply_entry(h, &h->entries[h->position++], hmap, snapshots);
+    return true;
+}
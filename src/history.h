@@ -0,0 +1,86 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include "image.h"
+#include "snapshot.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* the heightmap is diffed in tiles of the same size as the UI snapshots */
+#define HISTORY_TILE_SIZE SNAPSHOT_TILE_SIZE
+
+/*
+ * The change between two consecutive states of the heightmap: the XOR of
+ * their bit patterns for every tile that changed, compressed.
+ */
+typedef struct HistoryEntry {
+    int n_tiles;
+    int32_t *tiles;         /* changed tiles (ty * tiles_x + tx) */
+    uint32_t *offsets;      /* start of each tile in `data`, plus the end */
+    uint8_t *data;
+    size_t size;            /* bytes used by the entry */
+} HistoryEntry;
+
+/*
+ * Undo/redo history of a heightmap.
+ *
+ * Every committed state of the heightmap is stored as its difference to
+ * the previous state. Tiles are compared to a copy of the last committed
+ * state and only the changed tiles are stored: the XOR of the old and new
+ * bit patterns, split into byte planes (so the mostly equal sign and
+ * exponent bytes line up into runs of zeros) and run-length encoded. As
+ * XOR is its own inverse, the same delta steps back and forth. Tiles are
+ * encoded and applied in parallel.
+ *
+ * The oldest entries are dropped once the history exceeds its memory
+ * budget.
+ */
+typedef struct History {
+    ErodrImage current;     /* the heightmap as of the applied entries */
+    int tiles_x;
+    int tiles_y;
+    HistoryEntry *entries;
+    int n_entries;
+    int capacity;
+    int position;           /* number of applied entries */
+    size_t size;            /* bytes used by all entries */
+    size_t budget;
+    uint8_t *changed;       /* per-tile flags of a commit */
+    uint8_t *scratch;       /* encoded tiles of a chunk */
+} History;
+
+/*
+ * Starts the history of `hmap` with its current state. `budget` is the
+ * maximum number of bytes used by the entries. Returns 0 on success.
+ */
+int history_init(History *h, ErodrImage *hmap, size_t budget);
+
+/*
+ * Frees `h`.
+ */
+void history_free(History *h);
+
+/*
+ * Records the current state of `hmap` as a new entry, dropping the entries
+ * that could have been redone. Nothing is recorded if `hmap` didn't
+ * change. Returns the number of changed tiles, or -1 if the entry could not
+ * be allocated, in which case the history is cleared.
+ */
+int history_commit(History *h, ErodrImage *hmap);
+
+/*
+ * Steps `hmap`, which must be in its last committed state, back to the
+ * previous state and marks the changed tiles dirty in `snapshots` (may be
+ * NULL). Returns false if there is nothing to undo.
+ */
+bool history_undo(History *h, ErodrImage *hmap, SnapshotBuffer *snapshots);
+
+/*
+ * Steps `hmap` forward again after `history_undo`. Returns false if there
+ * is nothing to redo.
+ */
+bool history_redo(History *h, ErodrImage *hmap, SnapshotBuffer *snapshots);
+
+#endif /* HISTORY_H */
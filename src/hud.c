@@ -0,0 +1,272 @@
+#include "hud.h"
+#include "timer.h"
+
+#include "raylib.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#define HUD_WIDTH        480
+#define HUD_PADDING       10
+#define HUD_TITLE_SIZE    38
+#define HUD_TEXT_SIZE     20
+#define HUD_LINE         (HUD_TEXT_SIZE + 4)
+#define HUD_GRAPH_HEIGHT  60
+#define HUD_GAP           10
+
+/* frame times are drawn up to two vsync intervals at 60 Hz */
+#define HUD_FRAME_SCALE (1.0f / 30.0f)
+#define HUD_VSYNC       (1.0f / 60.0f)
+
+/* mean frame times in the legend are taken over this many frames */
+#define HUD_MEAN_FRAMES 60
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+static const char *phase_names[HUD_N_PHASES] = {"update", "upload", "draw", "present"};
+
+static const Color phase_colors[HUD_N_PHASES] = {
+    {  0, 121, 241, 255},   /* BLUE */
+    {255, 161,   0, 255},   /* ORANGE */
+    {  0, 158,  47, 255},   /* LIME */
+    {130, 130, 130, 255},   /* GRAY */
+};
+
+/*
+ * Index of the `k`th oldest of the `count` values in a ring of `capacity`
+ * values whose next slot is `pos`.
+ */
+static inline int ring_index(int pos, int count, int capacity, int k)
+{
+    return (pos - count + k + capacity) % capacity;
+}
+
+static float ring_max(const float *values, int pos, int count, int capacity)
+{
+    float max = 0.0f;
+    for (int k = 0; k < count; k++) {
+        max = fmaxf(max, values[ring_index(pos, count, capacity, k)]);
+    }
+    return max;
+}
+
+/*
+ * Formats `value` with an SI prefix, e.g. "1.25 M`unit`".
+ */
+static void format_si(char *buf, size_t size, double value, const char *unit)
+{
+    static const char *prefixes[] = {"", "k", "M", "G", "T"};
+    int p = 0;
+    while (fabs(value) >= 1000.0 && p < 4) {
+        value /= 1000.0;
+        p++;
+    }
+    snprintf(buf, size, "%.2f %s%s", value, prefixes[p], unit);
+}
+
+/*
+ * Draws the `count` newest values of a ring as a line graph filling
+ * `bounds`, with `scale` at the top. Newer values are to the right.
+ */
+static void draw_line_graph(const float *values, int pos, int count, int capacity, float scale,
+                            Rectangle bounds, Color color)
+{
+    DrawRectangleLinesEx(bounds, 1.0f, LIGHTGRAY);
+    if (count < 2 || scale <= 0.0f) {
+        return;
+    }
+    float dx = bounds.width / (capacity - 1);
+    float x0 = bounds.x + bounds.width - (count - 1) * dx;
+    Vector2 prev = {0};
+    for (int k = 0; k < count; k++) {
+        float v = fminf(values[ring_index(pos, count, capacity, k)] / scale, 1.0f);
+        Vector2 p = {x0 + k * dx, bounds.y + bounds.height * (1.0f - v)};
+        if (k > 0) {
+            DrawLineV(prev, p, color);
+        }
+        prev = p;
+    }
+}
+
+void hud_init(PerfHud *hud, const SimCounters *counters)
+{
+    *hud = (PerfHud) {0};
+    hud->counters = counters;
+    sim_counters_read(counters, &hud->last);
+}
+
+void hud_add_frame(PerfHud *hud, const float times[HUD_N_PHASES], size_t upload_bytes)
+{
+    for (int i = 0; i < HUD_N_PHASES; i++) {
+        hud->frame_times[hud->frame_pos][i] = times[i];
+    }
+    hud->upload_bytes[hud->frame_pos] = (float) upload_bytes;
+    hud->frame_pos = (hud->frame_pos + 1) % HUD_FRAMES;
+    hud->n_frames = MIN(hud->n_frames + 1, HUD_FRAMES);
+}
+
+void hud_sample(PerfHud *hud)
+{
+    if (timer_now() - hud->last.time < HUD_SIM_INTERVAL) {
+        return;
+    }
+    SimCountersSample now;
+    sim_counters_read(hud->counters, &now);
+    double dt = now.time - hud->last.time;
+
+    /* busy time is added when a chunk of particles finishes, so a sample
+     * can briefly exceed the interval */
+    int n_threads = hud->counters->n_threads;
+    float total = 0.0f;
+    for (int t = 0; t < n_threads; t++) {
+        float u = (float)((now.busy_ns[t] - hud->last.busy_ns[t]) * 1e-9 / dt);
+        hud->thread_utilization[t] = fminf(u, 1.0f);
+        total += hud->thread_utilization[t];
+    }
+
+    hud->particle_rate[hud->sim_pos] = (float)((now.n_particles - hud->last.n_particles) / dt);
+    hud->step_rate[hud->sim_pos]     = (float)((now.n_steps - hud->last.n_steps) / dt);
+    hud->utilization[hud->sim_pos]   = total / MAX(n_threads, 1);
+    hud->sim_pos = (hud->sim_pos + 1) % HUD_SIM_SAMPLES;
+    hud->n_sim = MIN(hud->n_sim + 1, HUD_SIM_SAMPLES);
+    hud->last = now;
+}
+
+/*
+ * Draws the frame time graph, one stacked bar of phases per frame, and
+ * its legend at `y`. Returns the y coordinate below it.
+ */
+static int draw_frame_times(const PerfHud *hud, int x, int y)
+{
+    /* legend: mean time of each phase over the last frames */
+    int n_mean = MIN(hud->n_frames, HUD_MEAN_FRAMES);
+    float mean[HUD_N_PHASES] = {0};
+    float frame = 0.0f;
+    for (int k = hud->n_frames - n_mean; k < hud->n_frames; k++) {
+        int i = ring_index(hud->frame_pos, hud->n_frames, HUD_FRAMES, k);
+        for (int p = 0; p < HUD_N_PHASES; p++) {
+            mean[p] += hud->frame_times[i][p] / MAX(n_mean, 1);
+            frame += hud->frame_times[i][p] / MAX(n_mean, 1);
+        }
+    }
+    DrawText(TextFormat("Frame time: %.2f ms (%.0f fps)", frame * 1e3f, (frame > 0.0f) ? 1.0f / frame : 0.0f),
+             x, y, HUD_TEXT_SIZE, BLACK);
+    y += HUD_LINE;
+    int lx = x;
+    for (int p = 0; p < HUD_N_PHASES; p++) {
+        const char *label = TextFormat("%s %.2f", phase_names[p], mean[p] * 1e3f);
+        DrawRectangle(lx, y + 4, HUD_TEXT_SIZE - 8, HUD_TEXT_SIZE - 8, phase_colors[p]);
+        DrawText(label, lx + HUD_TEXT_SIZE, y, HUD_TEXT_SIZE, BLACK);
+        lx += HUD_TEXT_SIZE + MeasureText(label, HUD_TEXT_SIZE) + HUD_GAP;
+    }
+    y += HUD_LINE;
+
+    /* stacked bars, newest on the right, with a line at the vsync interval */
+    Rectangle bounds = {x, y, HUD_WIDTH, HUD_GRAPH_HEIGHT};
+    float bar_w = (float) HUD_WIDTH / HUD_FRAMES;
+    float x0 = bounds.x + bounds.width - hud->n_frames * bar_w;
+    for (int k = 0; k < hud->n_frames; k++) {
+        int i = ring_index(hud->frame_pos, hud->n_frames, HUD_FRAMES, k);
+        float bottom = bounds.y + bounds.height;
+        for (int p = 0; p < HUD_N_PHASES; p++) {
+            float h = fminf(hud->frame_times[i][p] / HUD_FRAME_SCALE * bounds.height, bottom - bounds.y);
+            DrawRectangleRec((Rectangle) {x0 + k * bar_w, bottom - h, bar_w, h}, phase_colors[p]);
+            bottom -= h;
+        }
+    }
+    float vsync_y = bounds.y + bounds.height * (1.0f - HUD_VSYNC / HUD_FRAME_SCALE);
+    DrawLineV((Vector2) {bounds.x, vsync_y}, (Vector2) {bounds.x + bounds.width, vsync_y}, RED);
+    DrawRectangleLinesEx(bounds, 1.0f, LIGHTGRAY);
+    return y + HUD_GRAPH_HEIGHT + HUD_GAP;
+}
+
+/*
+ * Draws the bytes uploaded per frame at `y`. Returns the y coordinate
+ * below it.
+ */
+static int draw_uploads(const PerfHud *hud, int x, int y)
+{
+    float max = ring_max(hud->upload_bytes, hud->frame_pos, hud->n_frames, HUD_FRAMES);
+    float last = (hud->n_frames > 0) ? hud->upload_bytes[ring_index(hud->frame_pos, 1, HUD_FRAMES, 0)] : 0.0f;
+    char last_text[32], max_text[32];
+    format_si(last_text, sizeof(last_text), last, "B");
+    format_si(max_text, sizeof(max_text), max, "B");
+    DrawText(TextFormat("Uploaded per frame: %s (max %s)", last_text, max_text), x, y, HUD_TEXT_SIZE, BLACK);
+    y += HUD_LINE;
+
+    Rectangle bounds = {x, y, HUD_WIDTH, HUD_GRAPH_HEIGHT};
+    float bar_w = (float) HUD_WIDTH / HUD_FRAMES;
+    float x0 = bounds.x + bounds.width - hud->n_frames * bar_w;
+    for (int k = 0; k < hud->n_frames && max > 0.0f; k++) {
+        float h = hud->upload_bytes[ring_index(hud->frame_pos, hud->n_frames, HUD_FRAMES, k)] / max * bounds.height;
+        DrawRectangleRec((Rectangle) {x0 + k * bar_w, bounds.y + bounds.height - h, bar_w, h}, phase_colors[HUD_UPLOAD]);
+    }
+    DrawRectangleLinesEx(bounds, 1.0f, LIGHTGRAY);
+    return y + HUD_GRAPH_HEIGHT + HUD_GAP;
+}
+
+/*
+ * Draws the line graph of a simulation rate titled `title` at `y`.
+ * Returns the y coordinate below it.
+ */
+static int draw_rate(const PerfHud *hud, const float *rates, const char *title, Color color, int x, int y)
+{
+    float max = ring_max(rates, hud->sim_pos, hud->n_sim, HUD_SIM_SAMPLES);
+    float last = (hud->n_sim > 0) ? rates[ring_index(hud->sim_pos, 1, HUD_SIM_SAMPLES, 0)] : 0.0f;
+    char last_text[32], max_text[32];
+    format_si(last_text, sizeof(last_text), last, "/s");
+    format_si(max_text, sizeof(max_text), max, "/s");
+    DrawText(TextFormat("%s: %s (max %s)", title, last_text, max_text), x, y, HUD_TEXT_SIZE, BLACK);
+    y += HUD_LINE;
+    draw_line_graph(rates, hud->sim_pos, hud->n_sim, HUD_SIM_SAMPLES, max,
+                    (Rectangle) {x, y, HUD_WIDTH, HUD_GRAPH_HEIGHT}, color);
+    return y + HUD_GRAPH_HEIGHT + HUD_GAP;
+}
+
+/*
+ * Draws the utilization of each simulation thread as a bar, and the mean
+ * utilization over time, at `y`. Returns the y coordinate below it.
+ */
+static int draw_threads(const PerfHud *hud, int x, int y)
+{
+    int n_threads = hud->counters->n_threads;
+    float last = (hud->n_sim > 0) ? hud->utilization[ring_index(hud->sim_pos, 1, HUD_SIM_SAMPLES, 0)] : 0.0f;
+    DrawText(TextFormat("Simulation threads: %.0f%% busy (%d threads)", last * 100.0f, n_threads),
+             x, y, HUD_TEXT_SIZE, BLACK);
+    y += HUD_LINE;
+
+    Rectangle bars = {x, y, HUD_WIDTH, HUD_GRAPH_HEIGHT / 2};
+    float bar_w = bars.width / MAX(n_threads, 1);
+    for (int t = 0; t < n_threads; t++) {
+        float h = hud->thread_utilization[t] * bars.height;
+        DrawRectangleRec((Rectangle) {bars.x + t * bar_w + 1, bars.y + bars.height - h, fmaxf(bar_w - 2, 1.0f), h}, DARKGREEN);
+    }
+    DrawRectangleLinesEx(bars, 1.0f, LIGHTGRAY);
+    y += HUD_GRAPH_HEIGHT / 2 + HUD_GAP / 2;
+
+    draw_line_graph(hud->utilization, hud->sim_pos, hud->n_sim, HUD_SIM_SAMPLES, 1.0f,
+                    (Rectangle) {x, y, HUD_WIDTH, HUD_GRAPH_HEIGHT}, DARKGREEN);
+    return y + HUD_GRAPH_HEIGHT + HUD_GAP;
+}
+
+void hud_draw(const PerfHud *hud, int right, int top)
+{
+    const int height = HUD_TITLE_SIZE + HUD_GAP
+                     + 2 * HUD_LINE + HUD_GRAPH_HEIGHT + HUD_GAP           /* frame times */
+                     + 3 * (HUD_LINE + HUD_GRAPH_HEIGHT + HUD_GAP)         /* uploads, particles, steps */
+                     + HUD_LINE + HUD_GRAPH_HEIGHT / 2 + HUD_GAP / 2
+                     + HUD_GRAPH_HEIGHT + HUD_GAP;                         /* threads */
+    int x = right - HUD_WIDTH;
+    int y = top;
+    DrawRectangle(x - HUD_PADDING, y - HUD_PADDING, HUD_WIDTH + 2 * HUD_PADDING, height + HUD_PADDING,
+                  Fade(RAYWHITE, 0.85f));
+
+    DrawText("Performance:", x, y, HUD_TITLE_SIZE, BLACK);
+    y += HUD_TITLE_SIZE + HUD_GAP;
+    y = draw_frame_times(hud, x, y);
+    y = draw_uploads(hud, x, y);
+    y = draw_rate(hud, hud->particle_rate, "Particles", DARKBLUE, x, y);
+    y = draw_rate(hud, hud->step_rate, "Particle steps", MAROON, x, y);
+    draw_threads(hud, x, y);
+}
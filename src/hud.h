@@ -0,0 +1,70 @@
+#ifndef HUD_H
+#define HUD_H
+
+#include "sim_counters.h"
+
+#include <stddef.h>
+
+#define HUD_FRAMES       240   /* frames shown by the frame graphs */
+#define HUD_SIM_SAMPLES  100   /* samples shown by the simulation graphs */
+#define HUD_SIM_INTERVAL 0.1   /* seconds between samples of the simulation counters */
+
+/*
+ * Parts of a UI frame, in the order they happen.
+ */
+typedef enum HudPhase {
+    HUD_UPDATE,     /* input, camera and shader uniforms */
+    HUD_UPLOAD,     /* heightmap and derived texture uploads */
+    HUD_DRAW,       /* issuing the draw calls */
+    HUD_PRESENT,    /* `EndDrawing`: buffer swap, vsync and waiting for the GPU */
+    HUD_N_PHASES,
+} HudPhase;
+
+/*
+ * Performance overlay of the UI: rolling graphs of the frame time by
+ * phase, the bytes uploaded per frame, the particles and particle steps
+ * simulated per second and the utilization of the simulation threads.
+ *
+ * Frames are recorded by the UI thread itself. The simulation is only
+ * observed through its `SimCounters`, which are sampled every
+ * HUD_SIM_INTERVAL seconds; rates are the differences between two samples.
+ */
+typedef struct PerfHud {
+    const SimCounters *counters;
+    float frame_times[HUD_FRAMES][HUD_N_PHASES];    /* seconds */
+    float upload_bytes[HUD_FRAMES];
+    int frame_pos;                                  /* next slot of the frame rings */
+    int n_frames;
+    float particle_rate[HUD_SIM_SAMPLES];           /* particles per second */
+    float step_rate[HUD_SIM_SAMPLES];               /* particle steps per second */
+    float utilization[HUD_SIM_SAMPLES];             /* mean over all simulation threads */
+    float thread_utilization[THREAD_POOL_MAX_THREADS];  /* of the last sample */
+    int sim_pos;                                    /* next slot of the simulation rings */
+    int n_sim;
+    SimCountersSample last;                         /* sample the rates are relative to */
+} PerfHud;
+
+/*
+ * Starts an empty overlay showing `counters`.
+ */
+void hud_init(PerfHud *hud, const SimCounters *counters);
+
+/*
+ * Records a frame that spent `times` seconds in each phase and uploaded
+ * `upload_bytes` bytes of textures.
+ */
+void hud_add_frame(PerfHud *hud, const float times[HUD_N_PHASES], size_t upload_bytes);
+
+/*
+ * Samples the simulation counters if HUD_SIM_INTERVAL seconds have passed
+ * since the last sample. Called every frame.
+ */
+void hud_sample(PerfHud *hud);
+
+/*
+ * Draws the overlay with its top right corner at (`right`, `top`). Must be
+ * called between `BeginDrawing` and `EndDrawing`.
+ */
+void hud_draw(const PerfHud *hud, int right, int top);
+
+#endif /* HUD_H */
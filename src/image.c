@@ -1,19 +1,72 @@
 #include <stdlib.h>
 #include <stdio.h> // debug
 #include "image.h"
+#include "thread_pool.h"
+#include "numa.h"
+#include "mem.h"
 #include <assert.h>
 #include <string.h>
 
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+/* number of pixels handed to a thread at a time by the per-pixel loops */
+#define PIXEL_GRAIN (1 << 16)
+
+/*
+ * `parallel_for` context of the image operations.
+ */
+typedef struct ImageOpContext {
+    ErodrImage *dst;
+    ErodrImage *src;
+    bool clamped[THREAD_POOL_MAX_THREADS];
+} ImageOpContext;
+
+/*
+ * Zeroes rows [y_begin, y_end) of `img`.
+ */
+static void first_touch_rows(void *arg, int64_t y_begin, int64_t y_end, int thread)
+{
+    (void) thread;
+    ErodrImage *img = (ErodrImage *) arg;
+    memset(&img->data[y_begin * img->width], 0, sizeof(float) * img->width * (y_end - y_begin));
+}
+
 ErodrImage image_alloc(int width, int height) {
+    ErodrImage img = {
+        .data   = mem_alloc(sizeof(float) * width * height),
+        .width  = width,
+        .height = height,
+        .stride = width,
+    };
+
+    /* 
+     * Pages are placed on the NUMA node of the thread that touches them
+     * first. Touch them in row bands, one per thread, like the row-parallel
+     * loops that work on the image later, instead of from this thread.
+     */
+    if (img.data != NULL) {
+        numa_prepare(img.data, sizeof(float) * width * height);
+        parallel_for(0, height, 0, first_touch_rows, &img);
+    }
+    return img;
+}
+
+ErodrImage image_view(ErodrImage *parent, int x, int y, int width, int height)
+{
+    assert(x >= 0 && y >= 0);
+    assert(x + width <= parent->width);
+    assert(y + height <= parent->height);
     return (ErodrImage) {
-        .data   = malloc(sizeof(float) * width * height),
+        .data   = &parent->data[y * parent->stride + x],
         .width  = width,
         .height = height,
+        .stride = parent->stride,
     };
 }
 
 void image_free(ErodrImage *img) {
-    free(img->data);
+    mem_free(img->data, sizeof(float) * img->width * img->height);
 }
 
 void image_copy(ErodrImage *dst, ErodrImage *src)
@@ -22,15 +75,21 @@ void image_copy(ErodrImage *dst, ErodrImage *src)
     assert(src->height == dst->height);
     assert(src->data != NULL);
     assert(dst->data != NULL);
-    memcpy(dst->data, src->data, sizeof(float)*src->width*src->height);
+    if (src->stride == src->width && dst->stride == dst->width) {
+        memcpy(dst->data, src->data, sizeof(float)*src->width*src->height);
+        return;
+    }
+    for (int y = 0; y < src->height; y++) {
+        memcpy(&dst->data[y * dst->stride], &src->data[y * src->stride], sizeof(float)*src->width);
+    }
 }
 
-bool image_clamp(ErodrImage *img) 
+static void clamp_pixels(void *arg, int64_t begin, int64_t end, int thread)
 {
+    ImageOpContext *ctx = (ImageOpContext *) arg;
+    float *data = ctx->dst->data;
     bool clamped = false;
-    int size = img->width * img->height;
-    float *data = (float *)img->data;
-    for (int i = 0; i < size; i++) {
+    for (int64_t i = begin; i < end; i++) {
         float value = data[i];
         if (value > 0.0f && value < 1.0f) {
             continue;
@@ -39,7 +98,95 @@ bool image_clamp(ErodrImage *img)
         value = (value > 1.0f) ? 1.0f : value;
         data[i] = value;
         clamped = true;
-    }    
+    }
+    ctx->clamped[thread] |= clamped;
+}
 
+bool image_clamp(ErodrImage *img) 
+{
+    assert(img->stride == img->width);
+    ImageOpContext ctx = {.dst = img};
+    parallel_for(0, (int64_t) img->width * img->height, PIXEL_GRAIN, clamp_pixels, &ctx);
+
+    bool clamped = false;
+    for (int t = 0; t < parallel_n_threads(); t++) {
+        clamped |= ctx.clamped[t];
+    }
     return clamped;
 }
+
+static void sub_pixels(void *arg, int64_t begin, int64_t end, int thread)
+{
+    (void) thread;
+    ImageOpContext *ctx = (ImageOpContext *) arg;
+    for (int64_t i = begin; i < end; i++) {
+        ctx->dst->data[i] -= ctx->src->data[i];
+    }
+}
+
+void image_sub(ErodrImage *dst, ErodrImage *src)
+{
+    assert(dst->width == src->width && dst->height == src->height);
+    assert(dst->stride == dst->width && src->stride == src->width);
+    ImageOpContext ctx = {.dst = dst, .src = src};
+    parallel_for(0, (int64_t) dst->width * dst->height, PIXEL_GRAIN, sub_pixels, &ctx);
+}
+
+static void downsample_rows(void *arg, int64_t y_begin, int64_t y_end, int thread)
+{
+    (void) thread;
+    ImageOpContext *ctx = (ImageOpContext *) arg;
+    ErodrImage *dst = ctx->dst;
+    ErodrImage *src = ctx->src;
+    for (int y = (int) y_begin; y < y_end; y++) {
+        int y0 = 2*y;
+        int y1 = MIN(2*y + 1, src->height - 1);
+        for (int x = 0; x < dst->width; x++) {
+            int x0 = 2*x;
+            int x1 = MIN(2*x + 1, src->width - 1);
+            dst->data[y*dst->width + x] = 0.25f * (src->data[y0*src->width + x0] +
+                                                   src->data[y0*src->width + x1] +
+                                                   src->data[y1*src->width + x0] +
+                                                   src->data[y1*src->width + x1]);
+        }
+    }
+}
+
+void image_downsample(ErodrImage *dst, ErodrImage *src)
+{
+    assert(dst->width == (src->width + 1) / 2);
+    assert(dst->height == (src->height + 1) / 2);
+    ImageOpContext ctx = {.dst = dst, .src = src};
+    parallel_for(0, dst->height, 0, downsample_rows, &ctx);
+}
+
+static void upsample_add_rows(void *arg, int64_t y_begin, int64_t y_end, int thread)
+{
+    (void) thread;
+    ImageOpContext *ctx = (ImageOpContext *) arg;
+    ErodrImage *dst = ctx->dst;
+    ErodrImage *src = ctx->src;
+    float scale_x = (float)src->width / (float)dst->width;
+    float scale_y = (float)src->height / (float)dst->height;
+    for (int y = (int) y_begin; y < y_end; y++) {
+        float sy = MAX(0.0f, ((float)y + 0.5f) * scale_y - 0.5f);
+        int y0 = MIN((int)sy, src->height - 1);
+        int y1 = MIN(y0 + 1, src->height - 1);
+        float v = sy - y0;
+        for (int x = 0; x < dst->width; x++) {
+            float sx = MAX(0.0f, ((float)x + 0.5f) * scale_x - 0.5f);
+            int x0 = MIN((int)sx, src->width - 1);
+            int x1 = MIN(x0 + 1, src->width - 1);
+            float u = sx - x0;
+            float top    = (1 - u) * src->data[y0*src->width + x0] + u * src->data[y0*src->width + x1];
+            float bottom = (1 - u) * src->data[y1*src->width + x0] + u * src->data[y1*src->width + x1];
+            dst->data[y*dst->width + x] += (1 - v) * top + v * bottom;
+        }
+    }
+}
+
+void image_upsample_add(ErodrImage *dst, ErodrImage *src)
+{
+    ImageOpContext ctx = {.dst = dst, .src = src};
+    parallel_for(0, dst->height, 0, upsample_add_rows, &ctx);
+}
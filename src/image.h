@@ -4,26 +4,37 @@
 #include <stdbool.h>
 
 /*
- * Image type.
+ * Image type. Pixel (x, y) is stored at `data[y * stride + x]`. For images 
+ * allocated with `image_alloc` the stride equals the width. Sub-image views
+ * created with `image_view` share the stride of their parent.
  */
 typedef struct ErodrImage {
     float *data;
     int width;
     int height;
+    int stride;
 } ErodrImage;
 
 /*
- * Allocates memory for image.
+ * Allocates memory for image. Large images are backed by huge pages where
+ * available.
  */
 ErodrImage image_alloc(int width, int height);
 
 /*
- * Frees image data.
+ * Returns a `width` x `height` view into `parent` with its origin at 
+ * (`x`, `y`). The view refers to the pixels of `parent` (no copy is made)
+ * and must not be freed. The rectangle must lie within `parent`.
+ */
+ErodrImage image_view(ErodrImage *parent, int x, int y, int width, int height);
+
+/*
+ * Frees image data. `img` must have the dimensions it was allocated with.
  */
 void image_free(ErodrImage *img);
 
 /*
- * copies image data from `src` to `dst`.
+ * copies image data from `src` to `dst`. Either image may be a view.
  */
 void image_copy(ErodrImage *dst, ErodrImage *src);
 
@@ -34,5 +45,27 @@ void image_copy(ErodrImage *dst, ErodrImage *src);
  */
 bool image_clamp(ErodrImage *img);
 
+/*
+ * The functions below expect contiguous images (i.e. not views).
+ */
+
+/*
+ * Subtracts `src` from `dst` pixel by pixel.
+ */
+void image_sub(ErodrImage *dst, ErodrImage *src);
+
+/*
+ * Downsamples `src` by a factor of 2 into `dst` using a 2x2 box filter.
+ * `dst` must be allocated with dimensions ((src->width + 1) / 2, 
+ * (src->height + 1) / 2).
+ */
+void image_downsample(ErodrImage *dst, ErodrImage *src);
+
+/*
+ * Bilinearly upsamples `src` to the resolution of `dst` and adds the result
+ * to `dst`.
+ */
+void image_upsample_add(ErodrImage *dst, ErodrImage *src);
+
 #endif
 
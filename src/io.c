@@ -7,6 +7,10 @@
 #include "hgl_ini.h"
 
 #include "io.h"
+#include "spawn.h"
+#include "log.h"
+#include "thread_pool.h"
+#include "trace.h"
 #include <math.h>
 #include <stdio.h> 
 #include <stdint.h>
@@ -31,17 +35,59 @@
 
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
 
+/* number of pixels converted by a thread at a time */
+#define IO_PIXEL_GRAIN (1 << 16)
+
+/*
+ * `parallel_for` context of the conversions between raw *.pgm samples and
+ * floats.
+ */
+typedef struct PgmConvertContext {
+    float *data;
+    unsigned char *raw;
+    int byte_depth;
+    int precision;
+} PgmConvertContext;
+
+/*
+ * Converts big endian raw samples to floats in [0, 1].
+ */
+static void pgm_decode(void *arg, int64_t begin, int64_t end, int thread)
+{
+    (void) thread;
+    PgmConvertContext *ctx = (PgmConvertContext *) arg;
+    for (int64_t i = begin; i < end; i++) {
+        const unsigned char *sample = &ctx->raw[i * ctx->byte_depth];
+        int val = (ctx->byte_depth == 2) ? (sample[0] << 8) | sample[1] : sample[0];
+        ctx->data[i] = (float) val / ctx->precision;
+    }
+}
+
+/*
+ * Converts floats to 16 bit big endian raw samples.
+ */
+static void pgm_encode(void *arg, int64_t begin, int64_t end, int thread)
+{
+    (void) thread;
+    PgmConvertContext *ctx = (PgmConvertContext *) arg;
+    for (int64_t i = begin; i < end; i++) {
+        uint16_t r = (uint16_t)(ctx->data[i] * PRECISION_16);
+        ctx->raw[2*i]     = (unsigned char)(r >> 8);
+        ctx->raw[2*i + 1] = (unsigned char)(r & 0xFF);
+    }
+}
+
 /*
  * Reads a parameter *.ini file.
  */
-SimulationParameters io_read_params_ini(const char *filepath)
+int io_read_params_ini(const char *filepath, SimulationParameters *params)
 {
     SimulationParameters parameters = DEFAULT_PARAM;
 
     HglIni *params_ini = hgl_ini_parse(filepath);
     if (params_ini == NULL) {
-        fprintf(stderr, "Error opening/parsing `%s`.\n", optarg);
-        exit(1);
+        log_error("Error opening/parsing `%s`.", filepath);
+        return -1;
     }
 
     GET_INI_PARAM_INT(parameters, params_ini, n);
@@ -57,9 +103,36 @@ SimulationParameters io_read_params_ini(const char *filepath)
     GET_INI_PARAM_FLOAT(parameters, params_ini, p_min_slope);
     GET_INI_PARAM_FLOAT(parameters, params_ini, p_initial_velocity);
     GET_INI_PARAM_FLOAT(parameters, params_ini, p_initial_water);
+    GET_INI_PARAM_INT(parameters, params_ini, thermal_iterations);
+    GET_INI_PARAM_FLOAT(parameters, params_ini, thermal_talus);
+    GET_INI_PARAM_FLOAT(parameters, params_ini, thermal_rate);
+    GET_INI_PARAM_INT(parameters, params_ini, thermal_first);
+    GET_INI_PARAM_INT(parameters, params_ini, pyramid_levels);
+    GET_INI_PARAM_FLOAT(parameters, params_ini, pyramid_refine);
+    GET_INI_PARAM_INT(parameters, params_ini, spawn_regions);
+    GET_INI_PARAM_FLOAT(parameters, params_ini, spawn_region_floor);
+    GET_INI_PARAM_INT(parameters, params_ini, roi_x);
+    GET_INI_PARAM_INT(parameters, params_ini, roi_y);
+    GET_INI_PARAM_INT(parameters, params_ini, roi_width);
+    GET_INI_PARAM_INT(parameters, params_ini, roi_height);
+    GET_INI_PARAM_FLOAT(parameters, params_ini, roi_feather);
+    GET_INI_PARAM_INT(parameters, params_ini, wrap);
+    GET_INI_PARAM_INT(parameters, params_ini, epoch_size);
+    GET_INI_PARAM_FLOAT(parameters, params_ini, converge_threshold);
+    GET_INI_PARAM_FLOAT(parameters, params_ini, time_budget);
+
+    if (hgl_ini_has(params_ini, "SimulationParameters", "spawn_mode")) {
+        const char *mode = hgl_ini_get(params_ini, "SimulationParameters", "spawn_mode");
+        if (spawn_mode_parse(mode, &parameters.spawn_mode) != 0) {
+            log_error("Unknown spawn_mode `%s` in `%s`.", mode, filepath);
+            hgl_ini_free(params_ini);
+            return -1;
+        }
+    }
 
     hgl_ini_free(params_ini);
-    return parameters;
+    *params = parameters;
+    return 0;
 }
 
 /*
@@ -97,53 +170,69 @@ int pgm_next_value(FILE *fp, char *buffer, size_t size)
  * Loads *.pgm into image `img`. `img` contains an internal buffer which is
  * dynamically allocated in load_pgm and should be free'd after use.
  */
-int io_load_pgm(const char *filepath, ErodrImage *img) {
+static int load_pgm(const char *filepath, ErodrImage *img) {
     FILE    *fp = fopen(filepath, "rb");
     char    *line = NULL;
     char    magic[16];
-    char    value_buffer[16];
+    char    value_buffer[16] = {0};
     int     precision;
 
     if(fp == NULL)
         return -1;
 
     /* read header */
-    if(pgm_next_value(fp, value_buffer, 16) == EOF) return 1;
+    bool header_ok = pgm_next_value(fp, value_buffer, 16) != EOF;
     strncpy(magic, value_buffer, 16);
-    if(pgm_next_value(fp, value_buffer, 16) == EOF) return 1;
+    header_ok = header_ok && pgm_next_value(fp, value_buffer, 16) != EOF;
     img->width = atoi(value_buffer);
-    if(pgm_next_value(fp, value_buffer, 16) == EOF) return 1;
+    header_ok = header_ok && pgm_next_value(fp, value_buffer, 16) != EOF;
     img->height = atoi(value_buffer);
-    if(pgm_next_value(fp, value_buffer, 16) == EOF) return 1;
+    img->stride = img->width;
+    header_ok = header_ok && pgm_next_value(fp, value_buffer, 16) != EOF;
     precision = atoi(value_buffer);
+    if (!header_ok || img->width <= 0 || img->height <= 0 || precision <= 0) {
+        log_error("Error: `%s` has an invalid *.pgm header.", filepath);
+        fclose(fp);
+        return 1;
+    }
 
     if (img->width != img->height) {
-        printf("Erodr doesn't support non-square heightmaps.\n");
-        exit(1);
+        log_error("Erodr doesn't support non-square heightmaps.");
+        fclose(fp);
+        return 1;
     }
 
     /* Allocate buffer for pixel values */
-    img->data = malloc(sizeof(float) * (img->height) * (img->width));
+    *img = image_alloc(img->width, img->height);
     float *data = (float *) img->data;
     if(data == NULL) {
+        fclose(fp);
         return -1;
     }
 
     /* Read pixel values to data. */
+    int64_t n_pixels = (int64_t) img->width * img->height;
     if(strncmp(magic, "P2", 2) == 0){
-        for(int i = 0; pgm_next_value(fp, value_buffer, 16) != EOF; i++) {
+        for(int i = 0; i < n_pixels && pgm_next_value(fp, value_buffer, 16) != EOF; i++) {
             data[i] = atof(value_buffer) / precision;
         }
     } else if(strncmp(magic, "P5", 2) == 0) {
-        int byte_depth = precision <= PRECISION_8 ? 1 : 2; 
-        char tmp[byte_depth];
-        for(int i = 0; i < img->width * img->height; i++) {
-            fread(tmp, sizeof(char), byte_depth, fp);
-            int val = (byte_depth == 2) ? 
-                (((uint16_t)tmp[0] << 8) & 0xFF00) | (tmp[1] & 0x00FF) :
-                tmp[0] & 0xFF;
-            data[i] = (float) val / precision;
+        /* read all samples at once, then convert them in parallel */
+        PgmConvertContext ctx = {
+            .data       = data,
+            .byte_depth = precision <= PRECISION_8 ? 1 : 2,
+            .precision  = precision,
+        };
+        ctx.raw = calloc(n_pixels, ctx.byte_depth);
+        if (ctx.raw == NULL) {
+            image_free(img);
+            img->data = NULL;
+            fclose(fp);
+            return -1;
         }
+        fread(ctx.raw, ctx.byte_depth, n_pixels, fp);
+        parallel_for(0, n_pixels, IO_PIXEL_GRAIN, pgm_decode, &ctx);
+        free(ctx.raw);
     }
 
     /* cleanup */
@@ -155,18 +244,20 @@ int io_load_pgm(const char *filepath, ErodrImage *img) {
     return 0;
 }
 
-#ifdef _WIN32
-static inline uint16_t bswap16(uint16_t v)
+int io_load_pgm(const char *filepath, ErodrImage *img)
 {
-    return (v << 8) | ((v >> 8) & 0xFF);
+    double t_trace = trace_begin();
+    int err = load_pgm(filepath, img);
+    trace_end("load pgm", "io", t_trace);
+    return err;
 }
-#endif
 
 /*
  * Saves image `img` to a *.pgm file.
  */
 int io_save_pgm(const char *filepath, ErodrImage *img, bool ascii_encoding)
 {
+    double t_trace = trace_begin();
     FILE *fp = fopen(filepath, "wb");
 
     /* write header */
@@ -182,21 +273,24 @@ int io_save_pgm(const char *filepath, ErodrImage *img, bool ascii_encoding)
             fprintf(fp, "%d\n", (int)round(data[i]*PRECISION_16));    
         }
     } else {
-        float *image_data32f = (float *) img->data;
-        for (int y = 0; y < img->height; y++) {
-            for (int x = 0; x < img->width; x++) {
-#ifdef _WIN32
-                /* better hope you're not running windows on a BE machine... */
-                uint16_t r = bswap16((uint16_t)(image_data32f[y*img->width + x] * PRECISION_16));
-#else
-                uint16_t r = htobe16((uint16_t)(image_data32f[y*img->width + x] * PRECISION_16));
-#endif
-                fwrite(&r, 1, sizeof(r), fp);
-            }
+        /* convert in parallel, then write all samples at once */
+        int64_t n_pixels = (int64_t) img->width * img->height;
+        PgmConvertContext ctx = {
+            .data = data,
+            .raw  = malloc(2 * n_pixels),
+        };
+        if (ctx.raw == NULL) {
+            fclose(fp);
+            trace_end("save pgm", "io", t_trace);
+            return -1;
         }
+        parallel_for(0, n_pixels, IO_PIXEL_GRAIN, pgm_encode, &ctx);
+        fwrite(ctx.raw, 2, n_pixels, fp);
+        free(ctx.raw);
         fflush(fp);
     }   
     fclose(fp);
+    trace_end("save pgm", "io", t_trace);
     
     return 0;
 }
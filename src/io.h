@@ -9,9 +9,11 @@
 #include "params.h"
 
 /*
- * Reads a parameter *.ini file.
+ * Reads a parameter *.ini file into `params`. Parameters missing from the
+ * file get their default value. Returns 0 on success. On failure `params`
+ * is left untouched.
  */
-SimulationParameters io_read_params_ini(const char *filepath);
+int io_read_params_ini(const char *filepath, SimulationParameters *params);
 
 /*
  * Loads *.pgm into image `img`. `img` contains an internal buffer which is
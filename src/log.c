@@ -0,0 +1,63 @@
+#include "log.h"
+
+#include <stdio.h>
+#include <stdarg.h>
+
+#define LOG_MAX_MSG_LEN 512
+
+static LogSink log_sink = NULL;
+static void *log_sink_user = NULL;
+static _Thread_local LogSink log_thread_sink = NULL;
+static _Thread_local void *log_thread_sink_user = NULL;
+
+void log_set_sink(LogSink sink, void *user)
+{
+    log_sink = sink;
+    log_sink_user = user;
+}
+
+void log_set_thread_sink(LogSink sink, void *user)
+{
+    log_thread_sink = sink;
+    log_thread_sink_user = user;
+}
+
+void log_stdio_sink(void *user, LogLevel level, const char *msg)
+{
+    (void) user;
+    FILE *fp = (level == LOG_LEVEL_ERROR) ? stderr : stdout;
+    fputs(msg, fp);
+    fputc('\n', fp);
+}
+
+static void log_vmsg(LogLevel level, const char *fmt, va_list args)
+{
+    LogSink sink = log_thread_sink;
+    void *user = log_thread_sink_user;
+    if (sink == NULL) {
+        sink = log_sink;
+        user = log_sink_user;
+    }
+    if (sink == NULL) {
+        return;
+    }
+    char msg[LOG_MAX_MSG_LEN];
+    vsnprintf(msg, sizeof(msg), fmt, args);
+    sink(user, level, msg);
+}
+
+void log_info(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    log_vmsg(LOG_LEVEL_INFO, fmt, args);
+    va_end(args);
+}
+
+void log_error(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    log_vmsg(LOG_LEVEL_ERROR, fmt, args);
+    va_end(args);
+}
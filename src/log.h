@@ -0,0 +1,43 @@
+#ifndef LOG_H
+#define LOG_H
+
+/*
+ * Log message severity.
+ */
+typedef enum LogLevel {
+    LOG_LEVEL_INFO = 0,
+    LOG_LEVEL_ERROR,
+} LogLevel;
+
+/*
+ * Receives log messages. `msg` has no trailing newline.
+ */
+typedef void (*LogSink)(void *user, LogLevel level, const char *msg);
+
+/*
+ * Sets the process-wide log sink. Messages are dropped while no sink is
+ * set, so the simulation modules are silent unless the application asks
+ * for their output.
+ */
+void log_set_sink(LogSink sink, void *user);
+
+/*
+ * Sets the log sink of the calling thread. While set (`sink` is not NULL),
+ * it receives the messages logged by this thread instead of the
+ * process-wide sink, so that library callers on different threads can have
+ * their own sinks.
+ */
+void log_set_thread_sink(LogSink sink, void *user);
+
+/*
+ * Log sink that prints info messages to stdout and errors to stderr.
+ */
+void log_stdio_sink(void *user, LogLevel level, const char *msg);
+
+/*
+ * printf-style logging.
+ */
+void log_info(const char *fmt, ...);
+void log_error(const char *fmt, ...);
+
+#endif /* LOG_H */
@@ -1,19 +1,29 @@
 #include "erosion_sim.h"
+#include "pipeline.h"
+#include "workspace.h"
+#include "spawn.h"
+#include "checkpoint.h"
 #include "ui.h"
+#include "history.h"
 #include "io.h"
 #include "image.h"
+#include "log.h"
+#include "numa.h"
+#include "mem.h"
+#include "thread_pool.h"
+#include "profile.h"
+#include "trace.h"
 
+#define HGL_FLAGS_MAX_N_FLAGS 64
 #define HGL_FLAGS_IMPLEMENTATION
 #include "hgl_flags.h"
 
-#define HGL_CHAN_IMPLEMENTATION
-#include "hgl_chan.h"
-
 #include <stdio.h>
 #include <stdbool.h>
 #include <string.h>
 #include <stdlib.h>
 #include <pthread.h>
+#include <math.h>
 
 #define EXIT_WITH_USAGE(code)               \
     do {                                    \
@@ -22,16 +32,84 @@
         exit((code));                       \
     } while (0)
 
+/* duration of a simulation time slice in UI mode, which bounds the latency of UI commands */
+#define UI_SIM_SLICE 0.02
+
 typedef struct
 {
     const char *input_filepath; 
     const char *output_filepath; 
     const char *params_filepath; 
+    const char *spawn_map_filepath; 
+    const char *checkpoint_filepath; 
+    const char *resume_filepath; 
+    const char *profile_json_filepath; 
+    const char *trace_filepath; 
+    int64_t checkpoint_interval;
     bool ascii_encode_output;
     bool no_ui;
+    bool numa_interleave;
+    bool pin_threads;
+    bool numa_report;
+    bool hugetlb;
+    bool huge_page_report;
+    bool particle_stats;
+    bool layers[4];             /* flux, eroded, deposited, sediment */
+    float preview_overhead;     /* percent of simulation time spent on UI snapshots */
+    int64_t history_budget;     /* MB of memory used by the UI's undo history */
     SimulationParameters sim_params;
 } Args;
 
+/*
+ * Parses a duration such as "90", "90s", "1.5m" or "2h" into seconds.
+ */
+int parse_duration(const char *str, float *seconds)
+{
+    char *end;
+    double value = strtod(str, &end);
+    if (end == str || value < 0.0) {
+        return -1;
+    }
+    if (strcmp(end, "") == 0 || strcmp(end, "s") == 0) {
+        *seconds = (float) value;
+    } else if (strcmp(end, "ms") == 0) {
+        *seconds = (float) (value / 1000.0);
+    } else if (strcmp(end, "m") == 0) {
+        *seconds = (float) (value * 60.0);
+    } else if (strcmp(end, "h") == 0) {
+        *seconds = (float) (value * 3600.0);
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+/* output layer names, in the order of `ErosionLayers` */
+static const char *layer_names[4] = {"flux", "eroded", "deposited", "sediment"};
+
+/*
+ * Parses a comma separated list of output layer names (or "all") into
+ * `selected`.
+ */
+int parse_layers(const char *str, bool selected[4])
+{
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%s", str);
+    for (char *name = strtok(buf, ","); name != NULL; name = strtok(NULL, ",")) {
+        bool found = false;
+        for (int i = 0; i < 4; i++) {
+            if (strcmp(name, layer_names[i]) == 0 || strcmp(name, "all") == 0) {
+                selected[i] = true;
+                found = true;
+            }
+        }
+        if (!found) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
 Args parse_args(int argc, char *argv[])
 {
     Args args = {0};
@@ -54,6 +132,36 @@ Args parse_args(int argc, char *argv[])
     double *opt_min_slope     = hgl_flags_add_f64("-m,--minimum-slope", "Minimum slope", DEFAULT_PARAM_MIN_SLOPE, 0);
     double *opt_initial_vel   = hgl_flags_add_f64("-f,--initial-velocity", "Particle initial velocity", DEFAULT_PARAM_INITIAL_VELOCITY, 0);
     double *opt_initial_water = hgl_flags_add_f64("-w,--initial-water", "Particle initial water content", DEFAULT_PARAM_INITIAL_WATER, 0);
+    int64_t *opt_thermal_iter = hgl_flags_add_i64("--thermal-iterations", "Number of thermal erosion iterations (0 disables thermal erosion)", DEFAULT_PARAM_THERMAL_ITERATIONS, 0);
+    double *opt_thermal_talus = hgl_flags_add_f64("--thermal-talus", "Thermal erosion talus threshold (max stable height difference between neighbouring pixels)", DEFAULT_PARAM_THERMAL_TALUS, 0);
+    double *opt_thermal_rate  = hgl_flags_add_f64("--thermal-rate", "Fraction of excess material moved per thermal erosion iteration", DEFAULT_PARAM_THERMAL_RATE, 0);
+    bool *opt_thermal_first   = hgl_flags_add_bool("--thermal-first", "Run thermal erosion before (instead of after) hydraulic erosion", DEFAULT_PARAM_THERMAL_FIRST, 0);
+    bool *opt_wrap            = hgl_flags_add_bool("--wrap", "Treat the map as toroidal (edges wrap around) to erode tileable heightmaps", DEFAULT_PARAM_WRAP, 0);
+    int64_t *opt_pyr_levels   = hgl_flags_add_i64("--pyramid-levels", "Number of coarse-to-fine image pyramid levels for hydraulic erosion (1 disables the pyramid)", DEFAULT_PARAM_PYRAMID_LEVELS, 0);
+    double *opt_pyr_refine    = hgl_flags_add_f64("--pyramid-refine", "Particle density of each finer pyramid level relative to the level below it", DEFAULT_PARAM_PYRAMID_REFINE, 0);
+    const char **opt_spawn_mode = hgl_flags_add_str("--spawn-mode", "Particle spawn distribution: uniform, height, slope or map", "uniform", 0);
+    const char **opt_spawn_map  = hgl_flags_add_str("--spawn-map", "path to spawn density *.pgm file (implies --spawn-mode map)", NULL, 0);
+    int64_t *opt_spawn_regions  = hgl_flags_add_i64("--spawn-regions", "Number of spawn budget regions along each axis", DEFAULT_PARAM_SPAWN_REGIONS, 0);
+    double *opt_spawn_floor     = hgl_flags_add_f64("--spawn-region-floor", "Minimum particle budget of a spawn region, relative to uniform spawning", DEFAULT_PARAM_SPAWN_REGION_FLOOR, 0);
+    const char **opt_roi        = hgl_flags_add_str("--roi", "Only erode the region of interest `x,y,width,height`", NULL, 0);
+    double *opt_roi_feather     = hgl_flags_add_f64("--roi-feather", "Width (in pixels) of the fade-out of changes around the region of interest", DEFAULT_PARAM_ROI_FEATHER, 0);
+    int64_t *opt_epoch_size     = hgl_flags_add_i64("--epoch-size", "Number of particles per epoch in adaptive mode", DEFAULT_PARAM_EPOCH_SIZE, 0);
+    double *opt_converge        = hgl_flags_add_f64("--converge-threshold", "Stop when the per-epoch change drops below this fraction of the first epoch's change (0 = disabled)", DEFAULT_PARAM_CONVERGE_THRESHOLD, 0);
+    const char **opt_time_budget = hgl_flags_add_str("--time-budget", "Stop the simulation after this much wall-clock time, e.g. `30s`, `5m` or `1h`", NULL, 0);
+    const char **opt_checkpoint = hgl_flags_add_str("--checkpoint", "path to checkpoint file written periodically during the simulation", NULL, 0);
+    int64_t *opt_ckpt_interval  = hgl_flags_add_i64("--checkpoint-interval", "Number of particles between checkpoints", 1000000, 0);
+    const char **opt_resume     = hgl_flags_add_str("--resume", "path to checkpoint file to resume the simulation from", NULL, 0);
+    bool *opt_numa_interleave   = hgl_flags_add_bool("--numa-interleave", "Interleave heightmap memory over all NUMA nodes (Linux only)", false, 0);
+    bool *opt_pin_threads       = hgl_flags_add_bool("--pin-threads", "Pin simulation threads to CPUs", false, 0);
+    bool *opt_numa_report       = hgl_flags_add_bool("--numa-report", "Report the NUMA node distribution of the heightmap pages after the simulation (Linux only)", false, 0);
+    bool *opt_hugetlb           = hgl_flags_add_bool("--hugetlb", "Back large buffers with explicit hugetlbfs pages if available (Linux only)", false, 0);
+    bool *opt_huge_page_report  = hgl_flags_add_bool("--huge-page-report", "Report how much of the heightmap is backed by huge pages after the simulation (Linux only)", false, 0);
+    const char **opt_layers     = hgl_flags_add_str("--layers", "Also write output layers `flux`, `eroded`, `deposited` and/or `sediment` (comma separated, or `all`) next to the output", NULL, 0);
+    bool *opt_particle_stats    = hgl_flags_add_bool("--particle-stats", "Print particle lifetime, exit reason and mass statistics after the simulation", false, 0);
+    const char **opt_trace      = hgl_flags_add_str("--trace", "path to Chrome trace *.json file written on exit or SIGUSR1 (view in https://ui.perfetto.dev)", NULL, 0);
+    const char **opt_profile_json = hgl_flags_add_str("--profile-json", "path to JSON file the profile of each simulation run is written to (requires a build with PROFILE=1)", NULL, 0);
+    double *opt_preview_overhead = hgl_flags_add_f64("--preview-overhead", "Maximum share (in percent) of the simulation time spent publishing heightmap snapshots to the UI", 5.0, 0);
+    int64_t *opt_history_budget  = hgl_flags_add_i64("--history-budget", "Maximum memory (in MB) used by the undo history of the UI", 256, 0);
     bool *opt_no_ui           = hgl_flags_add_bool("--no-ui", "Don't open the UI/Visualizer (just perform the simulation and save like older versions of erodr did)", false, 0);
     bool *opt_help            = hgl_flags_add_bool("--help", "Show this message", false, 0);
     bool *opt_gen_cmpl_cmd    = hgl_flags_add_bool("--generate-completion-cmd", "Generate a completion command for Erodr on stdout", false, 0);
@@ -68,7 +176,7 @@ Args parse_args(int argc, char *argv[])
         exit(0);
     }
 
-    if (*opt_input_filepath == NULL) {
+    if (*opt_input_filepath == NULL && *opt_resume == NULL) {
         printf("You must specify an input heightmap file with the `-i` or `--input` option.\n");
         EXIT_WITH_USAGE(0);
     }
@@ -76,13 +184,32 @@ Args parse_args(int argc, char *argv[])
     args.input_filepath      = *opt_input_filepath;
     args.output_filepath     = (*opt_output_filepath == NULL) ? "output.pgm" : *opt_output_filepath;
     args.params_filepath     = *opt_params_filepath;
+    args.spawn_map_filepath  = *opt_spawn_map;
+    args.checkpoint_filepath = *opt_checkpoint;
+    args.checkpoint_interval = *opt_ckpt_interval;
+    args.resume_filepath     = *opt_resume;
     args.ascii_encode_output = *opt_ascii_encode_output;
     args.no_ui               = *opt_no_ui;
+    args.numa_interleave     = *opt_numa_interleave;
+    args.pin_threads         = *opt_pin_threads;
+    args.numa_report         = *opt_numa_report;
+    args.hugetlb             = *opt_hugetlb;
+    args.huge_page_report    = *opt_huge_page_report;
+    args.trace_filepath      = *opt_trace;
+    args.particle_stats      = *opt_particle_stats;
+    args.preview_overhead    = (float) *opt_preview_overhead;
+    args.history_budget      = *opt_history_budget;
+#ifdef ERODR_PROFILE
+    args.profile_json_filepath = *opt_profile_json;
+#else
+    if (*opt_profile_json != NULL) {
+        printf("WARNING: --profile-json requires a build with PROFILE=1, no profile will be written.\n");
+    }
+#endif
 
-    if (args.params_filepath != NULL) {
-        args.sim_params = io_read_params_ini(args.params_filepath);
-    } else {
-        args.sim_params = DEFAULT_PARAM;
+    args.sim_params = DEFAULT_PARAM;
+    if (args.params_filepath != NULL && 0 != io_read_params_ini(args.params_filepath, &args.sim_params)) {
+        exit(1);
     }
 
     if (hgl_flags_occured_before(opt_params_filepath, opt_n)) args.sim_params.n = (int) *opt_n;
@@ -98,91 +225,604 @@ Args parse_args(int argc, char *argv[])
     if (hgl_flags_occured_before(opt_params_filepath, opt_min_slope)) args.sim_params.p_min_slope = (float) *opt_min_slope;
     if (hgl_flags_occured_before(opt_params_filepath, opt_initial_vel)) args.sim_params.p_initial_velocity = (float) *opt_initial_vel;
     if (hgl_flags_occured_before(opt_params_filepath, opt_initial_water)) args.sim_params.p_initial_water = (float) *opt_initial_water;
+    if (hgl_flags_occured_before(opt_params_filepath, opt_thermal_iter)) args.sim_params.thermal_iterations = (int) *opt_thermal_iter;
+    if (hgl_flags_occured_before(opt_params_filepath, opt_thermal_talus)) args.sim_params.thermal_talus = (float) *opt_thermal_talus;
+    if (hgl_flags_occured_before(opt_params_filepath, opt_thermal_rate)) args.sim_params.thermal_rate = (float) *opt_thermal_rate;
+    if (hgl_flags_occured_before(opt_params_filepath, opt_thermal_first)) args.sim_params.thermal_first = (int) *opt_thermal_first;
+    if (hgl_flags_occured_before(opt_params_filepath, opt_wrap)) args.sim_params.wrap = (int) *opt_wrap;
+    if (hgl_flags_occured_before(opt_params_filepath, opt_pyr_levels)) args.sim_params.pyramid_levels = (int) *opt_pyr_levels;
+    if (hgl_flags_occured_before(opt_params_filepath, opt_pyr_refine)) args.sim_params.pyramid_refine = (float) *opt_pyr_refine;
+    if (hgl_flags_occured_before(opt_params_filepath, opt_spawn_regions)) args.sim_params.spawn_regions = (int) *opt_spawn_regions;
+    if (hgl_flags_occured_before(opt_params_filepath, opt_spawn_floor)) args.sim_params.spawn_region_floor = (float) *opt_spawn_floor;
+    if (hgl_flags_occured_before(opt_params_filepath, opt_spawn_mode)) {
+        if (spawn_mode_parse(*opt_spawn_mode, &args.sim_params.spawn_mode) != 0) {
+            printf("Unknown spawn mode `%s`.\n", *opt_spawn_mode);
+            EXIT_WITH_USAGE(1);
+        }
+    }
+    if (args.spawn_map_filepath != NULL) {
+        args.sim_params.spawn_mode = SPAWN_MODE_MAP;
+    }
+    if (hgl_flags_occured_before(opt_params_filepath, opt_roi_feather)) args.sim_params.roi_feather = (float) *opt_roi_feather;
+    if (hgl_flags_occured_before(opt_params_filepath, opt_epoch_size)) args.sim_params.epoch_size = (int) *opt_epoch_size;
+    if (hgl_flags_occured_before(opt_params_filepath, opt_converge)) args.sim_params.converge_threshold = (float) *opt_converge;
+    if (hgl_flags_occured_before(opt_params_filepath, opt_time_budget)) {
+        if (parse_duration(*opt_time_budget, &args.sim_params.time_budget) != 0) {
+            printf("Invalid time budget `%s`.\n", *opt_time_budget);
+            EXIT_WITH_USAGE(1);
+        }
+    }
+    if (*opt_layers != NULL && parse_layers(*opt_layers, args.layers) != 0) {
+        printf("Invalid output layers `%s`. Expected a comma separated list of flux, eroded, deposited and sediment.\n", *opt_layers);
+        EXIT_WITH_USAGE(1);
+    }
+
+    if (hgl_flags_occured_before(opt_params_filepath, opt_roi)) {
+        SimulationParameters *p = &args.sim_params;
+        if (4 != sscanf(*opt_roi, "%d,%d,%d,%d", &p->roi_x, &p->roi_y, &p->roi_width, &p->roi_height)) {
+            printf("Invalid region of interest `%s`. Expected `x,y,width,height`.\n", *opt_roi);
+            EXIT_WITH_USAGE(1);
+        }
+    }
 
     return args;
 }
 
+/*
+ * Prints on which NUMA nodes the pages of `hmap` reside.
+ */
+void print_numa_report(ErodrImage *hmap)
+{
+    NumaPageReport report;
+    size_t size = sizeof(float) * hmap->width * hmap->height;
+    if (0 != numa_page_report(hmap->data, size, parallel_n_threads(), &report)) {
+        printf("NUMA page report is not available on this system.\n");
+        return;
+    }
+    long total = report.unknown;
+    for (int node = 0; node < report.n_nodes; node++) {
+        total += report.pages[node];
+    }
+    printf("Heightmap pages per NUMA node:\n");
+    for (int node = 0; node < report.n_nodes; node++) {
+        printf("    node %d: %ld pages (%.1f%%)\n", node, report.pages[node],
+               (total > 0) ? 100.0 * report.pages[node] / total : 0.0);
+    }
+    if (report.unknown > 0) {
+        printf("    unknown: %ld pages\n", report.unknown);
+    }
+    printf("Expected remote access ratio: %.1f%%\n", 100.0 * report.remote_ratio);
+}
+
+/*
+ * Prints how much of `hmap` is backed by huge pages.
+ */
+void print_huge_page_report(ErodrImage *hmap)
+{
+    MemHugePageReport report;
+    size_t size = sizeof(float) * hmap->width * hmap->height;
+    if (0 != mem_huge_page_report(hmap->data, size, &report)) {
+        printf("Huge page report is not available on this system.\n");
+        return;
+    }
+    printf("Heightmap huge page coverage: %.1f%% (%zu of %zu resident KiB%s)\n",
+           (report.resident > 0) ? 100.0 * report.huge / report.resident : 0.0,
+           report.huge >> 10, report.resident >> 10, report.hugetlb ? ", hugetlbfs" : "");
+}
+
+/*
+ * Writes the profile of the last simulation run to `filepath`, if set.
+ * Does nothing unless built with ERODR_PROFILE.
+ */
+void write_profile_json(const char *filepath)
+{
+#ifdef ERODR_PROFILE
+    if (filepath == NULL) {
+        return;
+    }
+    FILE *fp = fopen(filepath, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "Error: could not open profile file `%s`.\n", filepath);
+        return;
+    }
+    profile_write_json(fp);
+    fclose(fp);
+    printf("Saved profile to: %s\n", filepath);
+#else
+    (void) filepath;
+#endif
+}
+
+/*
+ * Saves the allocated layers of `layers` next to `output_filepath`, as
+ * `<output>_<layer>.pgm`. Layers are normalized to [0, 1].
+ */
+void save_layers(const char *output_filepath, ErosionLayers *layers)
+{
+    ErodrImage *images[4] = {&layers->flux, &layers->eroded, &layers->deposited, &layers->sediment};
+    size_t stem_len = strlen(output_filepath);
+    if (stem_len >= 4 && strcmp(output_filepath + stem_len - 4, ".pgm") == 0) {
+        stem_len -= 4;
+    }
+    for (int i = 0; i < 4; i++) {
+        ErodrImage *layer = images[i];
+        if (layer->data == NULL) {
+            continue;
+        }
+        ErodrImage normalized = image_alloc(layer->width, layer->height);
+        if (normalized.data == NULL) {
+            printf("Error: could not allocate %s layer.\n", layer_names[i]);
+            continue;
+        }
+        int64_t n_pixels = (int64_t) layer->width * layer->height;
+        float max = 0.0f;
+        for (int64_t j = 0; j < n_pixels; j++) {
+            max = (layer->data[j] > max) ? layer->data[j] : max;
+        }
+        for (int64_t j = 0; j < n_pixels; j++) {
+            normalized.data[j] = (max > 0.0f) ? fmaxf(layer->data[j], 0.0f) / max : 0.0f;
+        }
+
+        char filepath[1024];
+        snprintf(filepath, sizeof(filepath), "%.*s_%s.pgm", (int) stem_len, output_filepath, layer_names[i]);
+        io_save_pgm(filepath, &normalized, false);
+        printf("Saved %s layer (max = %g) to: %s\n", layer_names[i], max, filepath);
+        image_free(&normalized);
+    }
+}
+
+/*
+ * Prints simulation progress.
+ */
+bool print_progress(void *user, int64_t n_simulated, int64_t n_total)
+{
+    (void) user;
+    printf("Particles simulated: %ld / %ld\n", (long) n_simulated, (long) n_total);
+    return true;
+}
+
+/*
+ * Clamps `hmap` (warning if it was clipping) and saves it, and the output
+ * layers if `write_layers` is set, to the output file of `args`.
+ */
+void save_results(const Args *args, ErodrImage *hmap, ErosionLayers *layers, bool write_layers)
+{
+    /* Maybe clamp */
+    if (image_clamp(hmap)) {
+        printf("\n\nWARNING: Output is clipping.\n\n");
+        printf("The image has been clamped. Some information is lost.\n");
+        printf("To avoid this warning, make sure the input image is not\n");
+        printf("clipping or nearly clipping.\n");
+    }
+
+    /* Save results */
+    io_save_pgm(args->output_filepath, hmap, args->ascii_encode_output);
+    printf("Saved image to: %s\n", args->output_filepath);
+    if (write_layers) {
+        save_layers(args->output_filepath, layers);
+    }
+}
+
+/*
+ * State of a UI mode session, shared by the command loop and the progress
+ * callback of the simulation run it started.
+ */
+typedef struct
+{
+    Args *args;
+    ErodrImage *hmap;
+    ErodrImage *hmap_original;
+    ErosionSimOptions *sim_opts;
+    ParticleStats *particle_stats;
+    ErosionLayers *layers;
+    bool write_layers;
+    SnapshotBuffer *snapshots;
+    History history;            /* of the states after runs, resets and saves */
+    bool has_history;
+    CommandQueue *commands;
+    atomic_bool cancel;         /* stops the running simulation, set by the UI */
+    atomic_int state;           /* SimState, shown by the UI */
+    UiCommand deferred;         /* received during a run, handled once it has stopped */
+    int64_t last_printed;       /* particles simulated at the last progress print */
+} Session;
+
+/*
+ * Receives the next command from the UI. Returns CMD_NONE if `block` is
+ * not set and no command is pending.
+ */
+UiCommand recv_command(CommandQueue *q, bool block)
+{
+    double t_trace = trace_begin();
+    UiCommand cmd = (UiCommand) (block ? command_queue_recv(q) : command_queue_try_recv(q));
+    if (cmd != CMD_NONE) {
+        trace_end_n("queue recv", "queue", t_trace, cmd);
+    }
+    return cmd;
+}
+
+/*
+ * Snapshot notify callback, wakes the UI when it's idle.
+ */
+void wake_ui(void *user)
+{
+    (void) user;
+    ui_wake();
+}
+
+/*
+ * Sets the simulation state of session `s` shown by the UI.
+ */
+void set_state(Session *s, SimState state)
+{
+    atomic_store(&s->state, state);
+    ui_wake();
+}
+
+/*
+ * Publishes the whole heightmap of session `s` to the UI.
+ */
+void publish_hmap(Session *s)
+{
+    snapshot_mark_all(s->snapshots);
+    snapshot_publish(s->snapshots, s->hmap, true);
+}
+
+/*
+ * Records the state of the heightmap of session `s` in its history.
+ */
+void commit_history(Session *s)
+{
+    if (!s->has_history) {
+        return;
+    }
+    if (history_commit(&s->history, s->hmap) < 0) {
+        printf("Error: could not allocate undo history, history cleared.\n");
+    }
+}
+
+/*
+ * Steps the heightmap of session `s` back (`undo`) or forward in its
+ * history.
+ */
+void step_history(Session *s, bool undo)
+{
+    History *h = &s->history;
+    if (!s->has_history) {
+        printf("Undo history not available.\n");
+        return;
+    }
+    bool stepped = undo ? history_undo(h, s->hmap, s->snapshots) : history_redo(h, s->hmap, s->snapshots);
+    if (!stepped) {
+        printf("Nothing to %s.\n", undo ? "undo" : "redo");
+        return;
+    }
+    snapshot_publish(s->snapshots, s->hmap, true); /* only the changed tiles are marked */
+    printf("%s: at state %d of %d (%.1f MB of history).\n", undo ? "Undo" : "Redo",
+           h->position, h->n_entries, h->size / (1024.0 * 1024.0));
+}
+
+/*
+ * Handles the commands that are the same whether or not a simulation is
+ * running. Returns false if `cmd` isn't one of them.
+ */
+bool handle_common_command(Session *s, UiCommand cmd)
+{
+    switch (cmd) {
+        case CMD_RELOAD_SIMPARAMS: {
+            if (s->args->params_filepath != NULL) {
+                /* keeps the current parameters if the file is broken. A
+                 * running simulation picks up the new particle coefficients
+                 * at its next batch. */
+                io_read_params_ini(s->args->params_filepath, &s->args->sim_params);
+                ui_wake(); /* shows the parameters */
+            }
+        } return true;
+
+        case CMD_SAVE_HMAP: {
+            save_results(s->args, s->hmap, s->layers, s->write_layers);
+            publish_hmap(s); /* may have been clamped */
+            commit_history(s);
+        } return true;
+
+        default: return false;
+    }
+}
+
+/*
+ * Progress callback of simulations run from the UI. Handles the commands
+ * that arrived since the last batch and blocks while the simulation is
+ * paused. Returns false if the run should stop.
+ */
+bool session_progress(void *user, int64_t n_simulated, int64_t n_total)
+{
+    Session *s = (Session *) user;
+    if (n_simulated - s->last_printed >= 10000 || n_simulated < s->last_printed || n_simulated == n_total) {
+        print_progress(NULL, n_simulated, n_total);
+        s->last_printed = n_simulated;
+    }
+
+    bool paused = false;
+    for (;;) {
+        UiCommand cmd = recv_command(s->commands, paused);
+        double t_trace = trace_begin();
+        if (cmd == CMD_NONE) {
+            return true;
+        }
+        if (handle_common_command(s, cmd)) {
+            trace_end_n("command", "main", t_trace, cmd);
+            continue;
+        }
+        switch (cmd) {
+            case CMD_PAUSE_SIMULATION: {
+                paused = !paused;
+                set_state(s, paused ? SIM_PAUSED : SIM_RUNNING);
+                printf("Simulation %s at %ld / %ld particles.\n", paused ? "paused" : "resumed",
+                       (long) n_simulated, (long) n_total);
+            } break;
+
+            case CMD_RERUN_SIMULATION: {
+                printf("Simulation already running.\n");
+            } break;
+
+            case CMD_RESET_HMAP:
+            case CMD_UNDO:
+            case CMD_REDO:
+            case CMD_EXIT: {
+                s->deferred = cmd;
+            } return false;
+
+            default: { /* CMD_CANCEL_SIMULATION */
+            } return false;
+        }
+        trace_end_n("command", "main", t_trace, cmd);
+    }
+}
+
+/*
+ * Runs the simulation pipeline of session `s` in time slices, so that UI
+ * commands are handled while it runs.
+ */
+void run_simulation(Session *s)
+{
+    Args *args = s->args;
+    *s->particle_stats = (ParticleStats) {0};
+    erosion_layers_clear(s->layers);
+    atomic_store(&s->cancel, false);
+    set_state(s, SIM_RUNNING);
+    s->last_printed = 0;
+
+    /* the run keeps its own copy of the parameters, reloading only changes its coefficients */
+    SimulationParameters params = args->sim_params;
+    pipeline_run(s->hmap, &params, s->sim_opts);
+    set_state(s, SIM_IDLE);
+
+    publish_hmap(s); /* only particles mark tiles dirty */
+    commit_history(s);
+    write_profile_json(args->profile_json_filepath);
+    if (args->particle_stats) {
+        particle_stats_log(s->particle_stats);
+    }
+    s->sim_opts->resume = NULL; /* only the first run resumes */
+}
+
+/*
+ * Handles command `cmd` of the UI while no simulation is running. Returns
+ * false once the UI has exited.
+ */
+bool handle_command(Session *s, UiCommand cmd)
+{
+    if (handle_common_command(s, cmd)) {
+        return true;
+    }
+    switch (cmd) {
+        case CMD_RERUN_SIMULATION: {
+            s->deferred = CMD_NONE;
+            run_simulation(s);
+            if (s->deferred != CMD_NONE) {
+                return handle_command(s, s->deferred);
+            }
+        } break;
+
+        case CMD_RESET_HMAP: {
+            image_copy(s->hmap, s->hmap_original);
+            publish_hmap(s);
+            commit_history(s);
+        } break;
+
+        case CMD_UNDO:
+        case CMD_REDO: {
+            step_history(s, cmd == CMD_UNDO);
+        } break;
+
+        case CMD_EXIT: {
+        } return false;
+
+        default: { /* nothing to pause or cancel */
+        } break;
+    }
+    return true;
+}
+
 int main(int argc, char *argv[]) 
 {
+    /* simulation modules log through us */
+    log_set_sink(log_stdio_sink, NULL);
+
     /* parse cli args */
     Args args = parse_args(argc, argv);
 
-    /* load pgm heightmap & make a copy of it*/
+    /* tracing handles signals on its own thread, so it must start before any other thread */
+    if (args.trace_filepath != NULL && !trace_start(args.trace_filepath)) {
+        fprintf(stderr, "Error: could not start tracing.\n");
+    }
+
+    /* memory placement & thread affinity must be set up before any image is allocated */
+    numa_set_interleave(args.numa_interleave);
+    mem_set_hugetlb(args.hugetlb);
+    if (args.pin_threads) {
+        parallel_pin_threads();
+    }
+
+    /* load pgm heightmap (or checkpoint) & make a copy of it*/
     ErodrImage hmap;
-    if(0 != io_load_pgm(args.input_filepath, &hmap)) {
+    Checkpoint resume = {0};
+    if (args.resume_filepath != NULL) {
+        if (0 != checkpoint_load(args.resume_filepath, &resume)) {
+            printf("Error: could not load checkpoint `%s`.\n", args.resume_filepath);
+            EXIT_WITH_USAGE(1);
+        }
+        hmap = resume.hmap;
+        resume.hmap = (ErodrImage) {0};
+        args.sim_params = resume.params;
+        printf("Loaded checkpoint `%s`. Simulation parameters are taken from the checkpoint.\n", args.resume_filepath);
+    } else if(0 != io_load_pgm(args.input_filepath, &hmap)) {
         printf("Error: could not load `%s`.\n", args.input_filepath);
         EXIT_WITH_USAGE(1);
     }
     ErodrImage hmap_original = image_alloc(hmap.width, hmap.height);
     image_copy(&hmap_original, &hmap);
 
-    if (args.no_ui) { /* ==== No UI mode ================ */
-        erosion_sim_run(&hmap, &args.sim_params);
+    /* load optional spawn density map */
+    ErodrImage spawn_density = {0};
+    if (args.spawn_map_filepath != NULL && 0 != io_load_pgm(args.spawn_map_filepath, &spawn_density)) {
+        printf("Error: could not load `%s`.\n", args.spawn_map_filepath);
+        EXIT_WITH_USAGE(1);
+    }
+
+    /* checkpointing. A checkpoint only holds the heightmap, the parameters
+     * and the particle index, so runs with more state can't be resumed. */
+    if (args.checkpoint_filepath != NULL || args.resume_filepath != NULL) {
+        const SimulationParameters *p = &args.sim_params;
+        const char *unsupported = NULL;
+        if (p->pyramid_levels > 1) {
+            unsupported = "--pyramid-levels";
+        } else if (p->converge_threshold > 0.0f || p->time_budget > 0.0f) {
+            unsupported = "--converge-threshold or --time-budget";
+        } else if (p->spawn_mode != SPAWN_MODE_UNIFORM) {
+            unsupported = "non-uniform --spawn-mode"; /* spawn densities come from the start of the run */
+        }
+        if (unsupported != NULL) {
+            printf("Error: checkpoints are not supported together with %s.\n", unsupported);
+            EXIT_WITH_USAGE(1);
+        }
+    }
+    CheckpointWriter checkpoint_writer;
+    if (args.checkpoint_filepath != NULL) {
+        if (0 != checkpoint_writer_start(&checkpoint_writer, args.checkpoint_filepath)) {
+            printf("Error: could not start checkpoint writer.\n");
+            exit(1);
+        }
+    }
 
-        /* Maybe clamp */
-        if (image_clamp(&hmap)) {
-            printf("\n\nWARNING: Output is clipping.\n\n");
-            printf("The image has been clamped. Some information is lost.\n");
-            printf("To avoid this warning, make sure the input image is not\n");
-            printf("clipping or nearly clipping.\n");
+    /* scratch buffers are kept across reruns */
+    Workspace workspace = {0};
+    ParticleStats particle_stats = {0};
+    ErosionLayers layers = {0};
+    bool write_layers = args.layers[0] || args.layers[1] || args.layers[2] || args.layers[3];
+    if (write_layers && 0 != erosion_layers_alloc(&layers, hmap.width, hmap.height, args.layers[0],
+                                                  args.layers[1], args.layers[2], args.layers[3])) {
+        printf("Error: could not allocate output layers.\n");
+        exit(1);
+    }
+
+    ErosionSimOptions sim_opts = {
+        .spawn_density       = (spawn_density.data != NULL) ? &spawn_density : NULL,
+        .checkpoint_writer   = (args.checkpoint_filepath != NULL) ? &checkpoint_writer : NULL,
+        .checkpoint_interval = args.checkpoint_interval,
+        .resume              = (args.resume_filepath != NULL) ? &resume : NULL,
+        .workspace           = &workspace,
+        .progress            = print_progress,
+        .stats               = args.particle_stats ? &particle_stats : NULL,
+        .layers              = write_layers ? &layers : NULL,
+    };
+
+    if (args.no_ui) { /* ==== No UI mode ================ */
+        pipeline_run(&hmap, &args.sim_params, &sim_opts);
+        write_profile_json(args.profile_json_filepath);
+        if (args.particle_stats) {
+            particle_stats_log(&particle_stats);
+        }
+        if (args.numa_report) {
+            print_numa_report(&hmap);
+        }
+        if (args.huge_page_report) {
+            print_huge_page_report(&hmap);
         }
 
-        /* Save results */
-        io_save_pgm(args.output_filepath, &hmap, args.ascii_encode_output);
-        printf("Saved image to: %s\n", args.output_filepath);
+        save_results(&args, &hmap, &layers, write_layers);
     } else {          /* ==== UI mode =================== */
-        HglChan c = hgl_chan_make();
+        /* the UI only ever sees snapshots of the heightmap */
+        SnapshotBuffer snapshots;
+        if (0 != snapshot_buffer_init(&snapshots, hmap.width, hmap.height, args.preview_overhead / 100.0f)) {
+            printf("Error: could not allocate heightmap snapshots.\n");
+            exit(1);
+        }
+        snapshot_publish(&snapshots, &hmap, true);
+        snapshots.notify = wake_ui; /* the UI only redraws when something changed */
+
+        CommandQueue commands;
+        command_queue_init(&commands);
+        SimCounters counters;
+        sim_counters_init(&counters);
+        Session session = {
+            .args           = &args,
+            .hmap           = &hmap,
+            .hmap_original  = &hmap_original,
+            .sim_opts       = &sim_opts,
+            .particle_stats = &particle_stats,
+            .layers         = &layers,
+            .write_layers   = write_layers,
+            .snapshots      = &snapshots,
+            .commands       = &commands,
+        };
+        session.has_history = history_init(&session.history, &hmap, (size_t) args.history_budget << 20) == 0;
+        if (!session.has_history) {
+            printf("WARNING: could not allocate undo history.\n");
+        }
+        atomic_init(&session.cancel, false);
+        atomic_init(&session.state, SIM_IDLE);
+        sim_opts.snapshots     = &snapshots;
+        sim_opts.progress      = session_progress;
+        sim_opts.progress_user = &session;
+        sim_opts.cancel        = &session.cancel;
+        sim_opts.slice         = UI_SIM_SLICE;
+        sim_opts.live          = &args.sim_params;
+        sim_opts.counters      = &counters;
+
         pthread_t ui_thread;
         UiArgs ui_args = (UiArgs) {
-            .hmap       = &hmap,
-            .chan       = &c,
+            .snapshots  = &snapshots,
+            .commands   = &commands,
             .sim_params = &args.sim_params,
+            .cancel     = &session.cancel,
+            .sim_state  = &session.state,
+            .counters   = &counters,
         };
         pthread_create(&ui_thread, NULL, ui_run, &ui_args);
 
         bool running = true;
         while (running) {
-            UiCommand cmd = (UiCommand) hgl_chan_recv(&c);
-            switch (cmd) {
-                case CMD_RERUN_SIMULATION: {
-                    erosion_sim_run(&hmap, &args.sim_params);
-                } break;
-
-                case CMD_RELOAD_SIMPARAMS: {
-                    if (args.params_filepath != NULL) {
-                        args.sim_params = io_read_params_ini(args.params_filepath);
-                    }
-                } break;
-
-                case CMD_RESET_HMAP: {
-                    image_copy(&hmap, &hmap_original);
-                } break;
-
-                case CMD_SAVE_HMAP: {
-                    /* Maybe clamp */
-                    if (image_clamp(&hmap)) {
-                        printf("\n\nWARNING: Output is clipping.\n\n");
-                        printf("The image has been clamped. Some information is lost.\n");
-                        printf("To avoid this warning, make sure the input image is not\n");
-                        printf("clipping or nearly clipping.\n");
-                    }
-
-                    /* Save results */
-                    io_save_pgm(args.output_filepath, &hmap, args.ascii_encode_output);
-                    printf("Saved image to: %s\n", args.output_filepath);
-                } break;
-
-                case CMD_EXIT: {
-                    running = false;
-                } break;
-            }
+            UiCommand cmd = recv_command(&commands, true);
+            double t_trace = trace_begin();
+            running = handle_command(&session, cmd);
+            trace_end_n("command", "main", t_trace, cmd);
         }
 
         pthread_join(ui_thread, NULL);
-        hgl_chan_destroy(&c);
+        command_queue_destroy(&commands);
+        if (session.has_history) {
+            history_free(&session.history);
+        }
+        snapshot_buffer_free(&snapshots);
     }
 
     /* cleanup (Be polite to the operating system :) )*/
+    if (args.checkpoint_filepath != NULL) {
+        checkpoint_writer_stop(&checkpoint_writer);
+    }
     image_free(&hmap);    
+    erosion_layers_free(&layers);
     image_free(&hmap_original);    
+    image_free(&spawn_density);
+    workspace_free(&workspace);
 }
@@ -0,0 +1,123 @@
+#undef _GNU_SOURCE // gets rid of vim warning
+#define _GNU_SOURCE
+
+#include "mem.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#define MEM_ROUND_UP(n, a) (((n) + (a) - 1) / (a) * (a))
+
+static bool mem_hugetlb = false;
+
+void mem_set_hugetlb(bool hugetlb)
+{
+    mem_hugetlb = hugetlb;
+}
+
+#ifdef __linux__
+void *mem_alloc(size_t size)
+{
+    if (size < MEM_HUGE_PAGE_SIZE) {
+        return malloc(size);
+    }
+    size_t mapped = MEM_ROUND_UP(size, MEM_HUGE_PAGE_SIZE);
+
+    /* explicit huge pages come 2 MiB aligned from the hugetlbfs pool */
+    if (mem_hugetlb) {
+        void *p = mmap(NULL, mapped, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) {
+            return p;
+        }
+    }
+
+    /* over-allocate, then trim the mapping down to a 2 MiB aligned range */
+    uint8_t *p = mmap(NULL, mapped + MEM_HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        return NULL;
+    }
+    uint8_t *aligned = (uint8_t *) MEM_ROUND_UP((uintptr_t) p, MEM_HUGE_PAGE_SIZE);
+    size_t head = (size_t)(aligned - p);
+    if (head > 0) {
+        munmap(p, head);
+    }
+    if (MEM_HUGE_PAGE_SIZE - head > 0) {
+        munmap(aligned + mapped, MEM_HUGE_PAGE_SIZE - head);
+    }
+    madvise(aligned, mapped, MADV_HUGEPAGE); /* a hint, failure is fine */
+    return aligned;
+}
+
+void mem_free(void *ptr, size_t size)
+{
+    if (ptr == NULL) {
+        return;
+    }
+    if (size < MEM_HUGE_PAGE_SIZE) {
+        free(ptr);
+        return;
+    }
+    munmap(ptr, MEM_ROUND_UP(size, MEM_HUGE_PAGE_SIZE));
+}
+
+int mem_huge_page_report(const void *addr, size_t size, MemHugePageReport *report)
+{
+    *report = (MemHugePageReport) {0};
+    FILE *fp = fopen("/proc/self/smaps", "r");
+    if (fp == NULL) {
+        return -1;
+    }
+
+    /* sum up the mappings overlapping the buffer */
+    unsigned long begin = (unsigned long) (uintptr_t) addr;
+    unsigned long end = begin + size;
+    bool overlaps = false;
+    char line[256];
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        unsigned long vma_begin, vma_end;
+        size_t kb;
+        if (sscanf(line, "%lx-%lx ", &vma_begin, &vma_end) == 2) {
+            overlaps = vma_begin < end && vma_end > begin;
+        } else if (!overlaps) {
+            continue;
+        } else if (sscanf(line, "Rss: %zu kB", &kb) == 1) {
+            report->resident += kb << 10;
+        } else if (sscanf(line, "AnonHugePages: %zu kB", &kb) == 1) {
+            report->huge += kb << 10;
+        } else if (sscanf(line, "KernelPageSize: %zu kB", &kb) == 1 && kb > 4) {
+            report->hugetlb = true;
+        } else if (sscanf(line, "Private_Hugetlb: %zu kB", &kb) == 1) {
+            report->resident += kb << 10;
+            report->huge += kb << 10;
+        }
+    }
+    fclose(fp);
+    return 0;
+}
+#else
+void *mem_alloc(size_t size)
+{
+    return malloc(size);
+}
+
+void mem_free(void *ptr, size_t size)
+{
+    (void) size;
+    free(ptr);
+}
+
+int mem_huge_page_report(const void *addr, size_t size, MemHugePageReport *report)
+{
+    (void) addr;
+    (void) size;
+    *report = (MemHugePageReport) {0};
+    return -1;
+}
+#endif
@@ -0,0 +1,45 @@
+#ifndef MEM_H
+#define MEM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* allocations of at least this size are backed by huge pages if possible */
+#define MEM_HUGE_PAGE_SIZE ((size_t) 2 << 20)
+
+/*
+ * Huge page coverage of a buffer.
+ */
+typedef struct MemHugePageReport {
+    size_t resident;     /* resident bytes */
+    size_t huge;         /* resident bytes backed by huge pages */
+    bool hugetlb;        /* backed by explicit hugetlbfs pages */
+} MemHugePageReport;
+
+/*
+ * Enables or disables explicit hugetlbfs pages (MAP_HUGETLB) for large
+ * allocations. If none are available, allocations fall back to
+ * transparent huge pages. Linux only.
+ */
+void mem_set_hugetlb(bool hugetlb);
+
+/*
+ * Allocates `size` bytes. Large allocations (>= MEM_HUGE_PAGE_SIZE) are
+ * mapped 2 MiB aligned and marked for transparent huge pages (Linux only).
+ * The memory is untouched. Must be freed with `mem_free` and the same
+ * `size`. Returns NULL on failure.
+ */
+void *mem_alloc(size_t size);
+
+/*
+ * Frees `ptr` allocated by `mem_alloc(size)`.
+ */
+void mem_free(void *ptr, size_t size);
+
+/*
+ * Reports how much of [addr, addr+size) is resident and backed by huge
+ * pages, according to /proc/self/smaps. Returns 0 on success.
+ */
+int mem_huge_page_report(const void *addr, size_t size, MemHugePageReport *report);
+
+#endif /* MEM_H */
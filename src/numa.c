@@ -0,0 +1,201 @@
+#undef _GNU_SOURCE // gets rid of vim warning
+#define _GNU_SOURCE
+
+#include "numa.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+/* from <linux/mempolicy.h> */
+#define NUMA_MPOL_INTERLEAVE 3
+
+/* number of pages queried per move_pages call */
+#define NUMA_QUERY_BATCH 4096
+#endif
+
+static bool numa_interleave = false;
+
+#ifdef __linux__
+/*
+ * Parses a sysfs cpu/node list such as "0-3,8-11" into the bitmask
+ * `mask` of `n_bits` bits. Returns the highest index + 1.
+ */
+static int parse_list(const char *filepath, uint8_t *mask, int n_bits)
+{
+    FILE *fp = fopen(filepath, "r");
+    if (fp == NULL) {
+        return 0;
+    }
+    int highest = 0;
+    int first, last;
+    while (fscanf(fp, "%d", &first) == 1) {
+        last = first;
+        int c = fgetc(fp);
+        if (c == '-') {
+            if (fscanf(fp, "%d", &last) != 1) {
+                break;
+            }
+            c = fgetc(fp);
+        }
+        for (int i = first; i <= last && i < n_bits; i++) {
+            mask[i / 8] |= (uint8_t)(1u << (i % 8));
+            highest = (i + 1 > highest) ? i + 1 : highest;
+        }
+        if (c != ',') {
+            break;
+        }
+    }
+    fclose(fp);
+    return highest;
+}
+
+/*
+ * Returns the node of `cpu`, or 0 if unknown.
+ */
+static int cpu_node(int cpu)
+{
+    for (int node = 0; node < NUMA_MAX_NODES; node++) {
+        char path[128];
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/node%d", cpu, node);
+        if (access(path, F_OK) == 0) {
+            return node;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Returns the `index`th CPU (wrapping around) of the affinity mask of the
+ * process, or -1 on failure.
+ */
+static int nth_allowed_cpu(int index)
+{
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) != 0 || CPU_COUNT(&set) == 0) {
+        return -1;
+    }
+    index %= CPU_COUNT(&set);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &set) && index-- == 0) {
+            return cpu;
+        }
+    }
+    return -1;
+}
+#endif
+
+int numa_n_nodes(void)
+{
+#ifdef __linux__
+    uint8_t mask[NUMA_MAX_NODES / 8] = {0};
+    int n = parse_list("/sys/devices/system/node/online", mask, NUMA_MAX_NODES);
+    return (n > 0) ? n : 1;
+#else
+    return 1;
+#endif
+}
+
+void numa_set_interleave(bool interleave)
+{
+    numa_interleave = interleave;
+}
+
+void numa_prepare(void *addr, size_t size)
+{
+#ifdef __linux__
+    if (!numa_interleave || numa_n_nodes() < 2) {
+        return;
+    }
+    /* mbind works on whole pages inside the buffer */
+    uintptr_t page = (uintptr_t) sysconf(_SC_PAGESIZE);
+    uintptr_t begin = ((uintptr_t) addr + page - 1) & ~(page - 1);
+    uintptr_t end = ((uintptr_t) addr + size) & ~(page - 1);
+    if (end <= begin) {
+        return;
+    }
+    unsigned long nodemask = 0;
+    int n_nodes = numa_n_nodes();
+    for (int node = 0; node < n_nodes && node < (int)(8 * sizeof(nodemask)); node++) {
+        nodemask |= 1ul << node;
+    }
+    syscall(SYS_mbind, (void *) begin, end - begin, NUMA_MPOL_INTERLEAVE,
+            &nodemask, 8 * sizeof(nodemask), 0);
+#else
+    (void) addr;
+    (void) size;
+#endif
+}
+
+int numa_pin_thread(int index)
+{
+#ifdef __linux__
+    int cpu = nth_allowed_cpu(index);
+    if (cpu < 0) {
+        return -1;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+    (void) index;
+    return -1;
+#endif
+}
+
+int numa_page_report(const void *addr, size_t size, int n_threads, NumaPageReport *report)
+{
+    *report = (NumaPageReport) {.n_nodes = numa_n_nodes()};
+#ifdef __linux__
+    uintptr_t page = (uintptr_t) sysconf(_SC_PAGESIZE);
+    uintptr_t begin = (uintptr_t) addr & ~(page - 1);
+    uintptr_t end = (uintptr_t) addr + size;
+    void *pages[NUMA_QUERY_BATCH];
+    int status[NUMA_QUERY_BATCH];
+    for (uintptr_t p = begin; p < end; ) {
+        int n = 0;
+        for (; n < NUMA_QUERY_BATCH && p < end; n++, p += page) {
+            pages[n] = (void *) p;
+        }
+        /* with `nodes` == NULL, move_pages only reports the node of each page */
+        if (syscall(SYS_move_pages, 0, (unsigned long) n, pages, NULL, status, 0) != 0) {
+            return -1;
+        }
+        for (int i = 0; i < n; i++) {
+            if (status[i] >= 0 && status[i] < NUMA_MAX_NODES) {
+                report->pages[status[i]]++;
+            } else {
+                report->unknown++;
+            }
+        }
+    }
+
+    /* the threads run on the first `n_threads` allowed CPUs */
+    long total = 0;
+    for (int node = 0; node < NUMA_MAX_NODES; node++) {
+        total += report->pages[node];
+    }
+    if (total > 0 && n_threads > 0) {
+        double local = 0.0;
+        for (int t = 0; t < n_threads; t++) {
+            int node = cpu_node(nth_allowed_cpu(t));
+            local += (double) report->pages[node] / total / n_threads;
+        }
+        report->remote_ratio = 1.0 - local;
+    }
+    return 0;
+#else
+    (void) addr;
+    (void) size;
+    (void) n_threads;
+    return -1;
+#endif
+}
@@ -0,0 +1,51 @@
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define NUMA_MAX_NODES 64
+
+/*
+ * Placement of the pages of a buffer across NUMA nodes.
+ */
+typedef struct NumaPageReport {
+    int n_nodes;
+    long pages[NUMA_MAX_NODES];   /* resident pages per node */
+    long unknown;                 /* pages not yet faulted in or not queryable */
+    double remote_ratio;          /* expected fraction of remote accesses */
+} NumaPageReport;
+
+/*
+ * Returns the number of NUMA nodes (1 on systems without NUMA support).
+ */
+int numa_n_nodes(void);
+
+/*
+ * Enables or disables interleaving of heightmap allocations over all
+ * nodes. Without interleaving, pages are placed on the node of the thread
+ * that first touches them. Linux only, no effect elsewhere.
+ */
+void numa_set_interleave(bool interleave);
+
+/*
+ * Applies the allocation policy to the untouched buffer [addr, addr+size).
+ */
+void numa_prepare(void *addr, size_t size);
+
+/*
+ * Pins the calling thread to the `index`th CPU of the process' affinity
+ * mask (wrapping around). Returns 0 on success.
+ */
+int numa_pin_thread(int index);
+
+/*
+ * Queries on which node each page of [addr, addr+size) resides. The
+ * remote access ratio is estimated for uniformly random accesses by
+ * `n_threads` threads, assuming the threads are spread over the CPUs of
+ * the affinity mask in order (as `numa_pin_thread` does). Returns 0 on
+ * success.
+ */
+int numa_page_report(const void *addr, size_t size, int n_threads, NumaPageReport *report);
+
+#endif /* NUMA_H */
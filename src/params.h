@@ -14,24 +14,70 @@
 #define DEFAULT_PARAM_MIN_SLOPE           0.0001
 #define DEFAULT_PARAM_INITIAL_VELOCITY    0.9
 #define DEFAULT_PARAM_INITIAL_WATER       1.0
+#define DEFAULT_PARAM_THERMAL_ITERATIONS  0
+#define DEFAULT_PARAM_THERMAL_TALUS       0.002
+#define DEFAULT_PARAM_THERMAL_RATE        0.5
+#define DEFAULT_PARAM_THERMAL_FIRST       0
+#define DEFAULT_PARAM_PYRAMID_LEVELS      1
+#define DEFAULT_PARAM_PYRAMID_REFINE      0.25
+#define DEFAULT_PARAM_SPAWN_MODE          SPAWN_MODE_UNIFORM
+#define DEFAULT_PARAM_SPAWN_REGIONS       8
+#define DEFAULT_PARAM_SPAWN_REGION_FLOOR  0.0
+#define DEFAULT_PARAM_ROI_X               0
+#define DEFAULT_PARAM_ROI_Y               0
+#define DEFAULT_PARAM_ROI_WIDTH           0
+#define DEFAULT_PARAM_ROI_HEIGHT          0
+#define DEFAULT_PARAM_ROI_FEATHER         0.0
+#define DEFAULT_PARAM_WRAP                0
+#define DEFAULT_PARAM_EPOCH_SIZE          50000
+#define DEFAULT_PARAM_CONVERGE_THRESHOLD  0.0
+#define DEFAULT_PARAM_TIME_BUDGET         0.0
 
-#define DEFAULT_PARAM                                         \
-    (SimulationParameters) {                                  \
-        .n                  = DEFAULT_PARAM_N,                \
-        .ttl                = DEFAULT_PARAM_TTL,              \
-        .seed               = DEFAULT_PARAM_SEED,             \
-        .p_radius           = DEFAULT_PARAM_RADIUS,           \
-        .p_inertia          = DEFAULT_PARAM_INERTIA,          \
-        .p_capacity         = DEFAULT_PARAM_CAPACITY,         \
-        .p_gravity          = DEFAULT_PARAM_GRAVITY,          \
-        .p_evaporation      = DEFAULT_PARAM_EVAPORATION,      \
-        .p_erosion          = DEFAULT_PARAM_EROSION,          \
-        .p_deposition       = DEFAULT_PARAM_DEPOSITION,       \
-        .p_min_slope        = DEFAULT_PARAM_MIN_SLOPE,        \
-        .p_initial_velocity = DEFAULT_PARAM_INITIAL_VELOCITY, \
-        .p_initial_water    = DEFAULT_PARAM_INITIAL_WATER,    \
+#define DEFAULT_PARAM                                           \
+    (SimulationParameters) {                                    \
+        .n                  = DEFAULT_PARAM_N,                  \
+        .ttl                = DEFAULT_PARAM_TTL,                \
+        .seed               = DEFAULT_PARAM_SEED,               \
+        .p_radius           = DEFAULT_PARAM_RADIUS,             \
+        .p_inertia          = DEFAULT_PARAM_INERTIA,            \
+        .p_capacity         = DEFAULT_PARAM_CAPACITY,           \
+        .p_gravity          = DEFAULT_PARAM_GRAVITY,            \
+        .p_evaporation      = DEFAULT_PARAM_EVAPORATION,        \
+        .p_erosion          = DEFAULT_PARAM_EROSION,            \
+        .p_deposition       = DEFAULT_PARAM_DEPOSITION,         \
+        .p_min_slope        = DEFAULT_PARAM_MIN_SLOPE,          \
+        .p_initial_velocity = DEFAULT_PARAM_INITIAL_VELOCITY,   \
+        .p_initial_water    = DEFAULT_PARAM_INITIAL_WATER,      \
+        .thermal_iterations = DEFAULT_PARAM_THERMAL_ITERATIONS, \
+        .thermal_talus      = DEFAULT_PARAM_THERMAL_TALUS,      \
+        .thermal_rate       = DEFAULT_PARAM_THERMAL_RATE,       \
+        .thermal_first      = DEFAULT_PARAM_THERMAL_FIRST,      \
+        .pyramid_levels     = DEFAULT_PARAM_PYRAMID_LEVELS,     \
+        .pyramid_refine     = DEFAULT_PARAM_PYRAMID_REFINE,     \
+        .spawn_mode         = DEFAULT_PARAM_SPAWN_MODE,         \
+        .spawn_regions      = DEFAULT_PARAM_SPAWN_REGIONS,      \
+        .spawn_region_floor = DEFAULT_PARAM_SPAWN_REGION_FLOOR, \
+        .roi_x              = DEFAULT_PARAM_ROI_X,              \
+        .roi_y              = DEFAULT_PARAM_ROI_Y,              \
+        .roi_width          = DEFAULT_PARAM_ROI_WIDTH,          \
+        .roi_height         = DEFAULT_PARAM_ROI_HEIGHT,         \
+        .roi_feather        = DEFAULT_PARAM_ROI_FEATHER,        \
+        .wrap               = DEFAULT_PARAM_WRAP,               \
+        .epoch_size         = DEFAULT_PARAM_EPOCH_SIZE,         \
+        .converge_threshold = DEFAULT_PARAM_CONVERGE_THRESHOLD, \
+        .time_budget        = DEFAULT_PARAM_TIME_BUDGET,        \
     }
 
+/*
+ * Where particles are spawned.
+ */
+typedef enum SpawnMode {
+    SPAWN_MODE_UNIFORM = 0, /* uniformly over the whole map */
+    SPAWN_MODE_HEIGHT,      /* proportional to height */
+    SPAWN_MODE_SLOPE,       /* proportional to slope */
+    SPAWN_MODE_MAP,         /* proportional to a user supplied density map */
+} SpawnMode;
+
 /*
  * Simulation parameters.
  */
@@ -49,6 +95,24 @@ typedef struct SimulationParameters {
     float p_min_slope;
     float p_initial_velocity;
     float p_initial_water;
+    int thermal_iterations;
+    float thermal_talus;
+    float thermal_rate;
+    int thermal_first;
+    int pyramid_levels;
+    float pyramid_refine;
+    SpawnMode spawn_mode;
+    int spawn_regions;
+    float spawn_region_floor;
+    int roi_x;
+    int roi_y;
+    int roi_width;       /* region of interest is disabled if width or height is 0 */
+    int roi_height;
+    float roi_feather;
+    int wrap;                 /* toroidal (wrap-around) map edges */
+    int epoch_size;
+    float converge_threshold; /* adaptive mode is enabled if this or time_budget is > 0 */
+    float time_budget;        /* seconds */
 } SimulationParameters;
 
 #endif
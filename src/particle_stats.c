@@ -0,0 +1,54 @@
+#include "particle_stats.h"
+#include "log.h"
+
+/* width of the bars of the lifetime histogram */
+#define HISTOGRAM_WIDTH 40
+
+void particle_stats_add(ParticleStats *dst, const ParticleStats *src)
+{
+    dst->n_particles       += src->n_particles;
+    dst->n_left_map        += src->n_left_map;
+    dst->n_ttl_reached     += src->n_ttl_reached;
+    dst->n_stalled         += src->n_stalled;
+    dst->total_steps       += src->total_steps;
+    dst->eroded            += src->eroded;
+    dst->deposited         += src->deposited;
+    dst->sediment_at_death += src->sediment_at_death;
+    for (int i = 0; i < PARTICLE_STATS_BINS; i++) {
+        dst->lifetime[i] += src->lifetime[i];
+    }
+}
+
+void particle_stats_log(const ParticleStats *stats)
+{
+    if (stats->n_particles == 0) {
+        log_info("Particle statistics: no particles simulated.");
+        return;
+    }
+    double n = (double) stats->n_particles;
+    log_info("Particle statistics (%ld particles):", (long) stats->n_particles);
+    log_info("  mean lifetime:     %.2f steps", stats->total_steps / n);
+    log_info("  left map:          %5.1f%%", 100.0 * stats->n_left_map / n);
+    log_info("  ttl reached:       %5.1f%%", 100.0 * stats->n_ttl_reached / n);
+    log_info("  stalled:           %5.1f%%", 100.0 * stats->n_stalled / n);
+    log_info("  eroded:            %g", stats->eroded);
+    log_info("  deposited:         %g", stats->deposited);
+    log_info("  sediment at death: %g (%.1f%% of eroded)", stats->sediment_at_death,
+             (stats->eroded > 0.0) ? 100.0 * stats->sediment_at_death / stats->eroded : 0.0);
+
+    int64_t max_count = 1;
+    for (int i = 0; i < PARTICLE_STATS_BINS; i++) {
+        max_count = (stats->lifetime[i] > max_count) ? stats->lifetime[i] : max_count;
+    }
+    log_info("  lifetime [%% of ttl]:");
+    for (int i = 0; i < PARTICLE_STATS_BINS; i++) {
+        char bar[HISTOGRAM_WIDTH + 1];
+        int len = (int)(HISTOGRAM_WIDTH * stats->lifetime[i] / max_count);
+        for (int j = 0; j < len; j++) {
+            bar[j] = '#';
+        }
+        bar[len] = '\0';
+        log_info("  %3d-%3d%% %5.1f%% %s", 100 * i / PARTICLE_STATS_BINS, 100 * (i + 1) / PARTICLE_STATS_BINS,
+                 100.0 * stats->lifetime[i] / n, bar);
+    }
+}
@@ -0,0 +1,36 @@
+#ifndef PARTICLE_STATS_H
+#define PARTICLE_STATS_H
+
+#include <stdint.h>
+
+/* number of lifetime histogram bins, each covering 1/PARTICLE_STATS_BINS of the ttl */
+#define PARTICLE_STATS_BINS 20
+
+/*
+ * What particles did during a run: how long they lived, why they died and
+ * how much material they moved. Collected per thread and summed up at the
+ * end of the run.
+ */
+typedef struct ParticleStats {
+    _Alignas(64) int64_t n_particles;
+    int64_t n_left_map;                     /* moved off the map */
+    int64_t n_ttl_reached;                  /* still moving when the ttl ran out */
+    int64_t n_stalled;                      /* trapped in a pit when the ttl ran out */
+    int64_t total_steps;
+    int64_t lifetime[PARTICLE_STATS_BINS];  /* particles by steps lived relative to the ttl */
+    double eroded;
+    double deposited;
+    double sediment_at_death;               /* sediment still carried when particles died */
+} ParticleStats;
+
+/*
+ * Adds the counts of `src` to `dst`.
+ */
+void particle_stats_add(ParticleStats *dst, const ParticleStats *src);
+
+/*
+ * Logs a summary of `stats`.
+ */
+void particle_stats_log(const ParticleStats *stats);
+
+#endif /* PARTICLE_STATS_H */
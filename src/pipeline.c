@@ -0,0 +1,66 @@
+#include "pipeline.h"
+#include "thermal_sim.h"
+#include "pyramid_sim.h"
+#include "profile.h"
+#include "trace.h"
+
+#include <stddef.h>
+
+/*
+ * Runs hydraulic erosion with `hydraulic_sim_run`, timed as a profile
+ * region.
+ */
+static bool run_hydraulic(bool (*hydraulic_sim_run)(ErodrImage *, SimulationParameters *, const ErosionSimOptions *),
+                          ErodrImage *hmap, SimulationParameters *params, const ErosionSimOptions *opts)
+{
+    double t_trace = trace_begin();
+    PROFILE_REGION_BEGIN("hydraulic");
+    bool completed = hydraulic_sim_run(hmap, params, opts);
+    PROFILE_REGION_END();
+    trace_end("hydraulic erosion", "sim", t_trace);
+    return completed;
+}
+
+/*
+ * Runs thermal erosion, timed as a profile region.
+ */
+static bool run_thermal(ErodrImage *hmap, SimulationParameters *params, const ErosionSimOptions *opts)
+{
+    double t_trace = trace_begin();
+    PROFILE_REGION_BEGIN("thermal");
+    bool completed = thermal_sim_run(hmap, params, (opts != NULL) ? opts->workspace : NULL,
+                                     (opts != NULL) ? opts->cancel : NULL);
+    PROFILE_REGION_END();
+    trace_end("thermal erosion", "sim", t_trace);
+    return completed;
+}
+
+/*
+ * Runs the stages of the pipeline in order.
+ */
+static bool run_stages(ErodrImage *hmap, SimulationParameters *params, const ErosionSimOptions *opts)
+{
+    bool (*hydraulic_sim_run)(ErodrImage *, SimulationParameters *, const ErosionSimOptions *) = 
+        (params->pyramid_levels > 1) ? pyramid_sim_run : erosion_sim_run;
+
+    if (params->thermal_first) {
+        /* a checkpoint is taken after the initial thermal erosion */
+        if ((opts == NULL || opts->resume == NULL) && !run_thermal(hmap, params, opts)) {
+            return false;
+        }
+        return run_hydraulic(hydraulic_sim_run, hmap, params, opts);
+    }
+
+    if (!run_hydraulic(hydraulic_sim_run, hmap, params, opts)) {
+        return false;
+    }
+    return run_thermal(hmap, params, opts);
+}
+
+bool pipeline_run(ErodrImage *hmap, SimulationParameters *params, const ErosionSimOptions *opts)
+{
+    PROFILE_RUN_BEGIN();
+    bool completed = run_stages(hmap, params, opts);
+    PROFILE_RUN_END();
+    return completed;
+}
@@ -0,0 +1,19 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "image.h"
+#include "params.h"
+#include "erosion_sim.h"
+
+#include <stdbool.h>
+
+/*
+ * Runs the full simulation pipeline (hydraulic + thermal erosion) on
+ * `hmap`. Hydraulic erosion runs over an image pyramid if
+ * `params->pyramid_levels` > 1. `opts` may be NULL. Returns false if the
+ * run was cancelled through the progress callback or the cancel flag of
+ * `opts`.
+ */
+bool pipeline_run(ErodrImage *hmap, SimulationParameters *params, const ErosionSimOptions *opts);
+
+#endif /* PIPELINE_H */
@@ -0,0 +1,344 @@
+#undef _GNU_SOURCE // gets rid of vim warning
+#define _GNU_SOURCE
+
+#include "profile.h"
+#include "log.h"
+#include "timer.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#define PROFILE_MAX_REGIONS 64
+#define PROFILE_MAX_DEPTH   16
+
+typedef enum ProfileCounter {
+    PROFILE_COUNTER_CYCLES = 0,
+    PROFILE_COUNTER_INSTRUCTIONS,
+    PROFILE_COUNTER_LLC_MISSES,
+    PROFILE_COUNTER_DTLB_MISSES,
+    PROFILE_N_COUNTERS,
+} ProfileCounter;
+
+/*
+ * Wall-clock time spent in a region. Repeated regions with the same name
+ * and parent are merged.
+ */
+typedef struct ProfileRegion {
+    const char *name;
+    int parent;         /* -1 for top-level regions */
+    int64_t count;
+    double seconds;
+    double begin;
+} ProfileRegion;
+
+/*
+ * Hardware counters of the thread that ran as index `thread` in `run`.
+ */
+typedef struct ProfileCounters {
+    int run;
+    int fds[PROFILE_N_COUNTERS];
+    int64_t values[PROFILE_N_COUNTERS]; /* -1 if unavailable */
+} ProfileCounters;
+
+static const char *phase_names[PROFILE_N_PHASES] = {
+    "spawn", "sample", "direction", "erode", "deposit",
+};
+
+static const char *counter_names[PROFILE_N_COUNTERS] = {
+    "cycles", "instructions", "llc_misses", "dtlb_misses",
+};
+
+ProfileThread profile_threads[THREAD_POOL_MAX_THREADS];
+
+static ProfileRegion regions[PROFILE_MAX_REGIONS];
+static int n_regions = 0;
+static int region_stack[PROFILE_MAX_DEPTH];
+static int region_depth = 0;
+
+static ProfileCounters counters[THREAD_POOL_MAX_THREADS];
+static int current_run = 0;     /* 0 while no run is being measured */
+static int last_run = 0;
+static int n_threads = 1;
+static double wall_begin, wall_seconds;
+static uint64_t ticks_begin;
+static double ticks_per_second = 1e9;
+
+#ifdef __linux__
+/*
+ * Opens a counter for user-space events of the calling thread. Returns -1
+ * if unavailable (no PMU, or forbidden by perf_event_paranoid).
+ */
+static int perf_open(uint32_t type, uint64_t config)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size           = sizeof(attr);
+    attr.type           = type;
+    attr.config         = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+void profile_thread_attach(int thread)
+{
+    ProfileCounters *c = &counters[thread];
+    if (current_run == 0 || c->run == current_run) {
+        return;
+    }
+    c->run = current_run;
+#ifdef __linux__
+    c->fds[PROFILE_COUNTER_CYCLES]       = perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    c->fds[PROFILE_COUNTER_INSTRUCTIONS] = perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    c->fds[PROFILE_COUNTER_LLC_MISSES]   = perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    c->fds[PROFILE_COUNTER_DTLB_MISSES]  = perf_open(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB |
+                                                     (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                                     (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+#else
+    for (int i = 0; i < PROFILE_N_COUNTERS; i++) {
+        c->fds[i] = -1;
+    }
+#endif
+}
+
+/*
+ * Reads and closes the counters of `c`.
+ */
+static void counters_close(ProfileCounters *c)
+{
+    for (int i = 0; i < PROFILE_N_COUNTERS; i++) {
+        c->values[i] = -1;
+#ifdef __linux__
+        if (c->fds[i] < 0) {
+            continue;
+        }
+        uint64_t value;
+        if (read(c->fds[i], &value, sizeof(value)) == sizeof(value)) {
+            c->values[i] = (int64_t) value;
+        }
+        close(c->fds[i]);
+        c->fds[i] = -1;
+#endif
+    }
+}
+
+void profile_region_begin(const char *name)
+{
+    int parent = (region_depth > 0) ? region_stack[region_depth - 1] : -1;
+    int r = 0;
+    while (r < n_regions && !(regions[r].parent == parent && strcmp(regions[r].name, name) == 0)) {
+        r++;
+    }
+    if (r == n_regions) {
+        if (n_regions == PROFILE_MAX_REGIONS) {
+            r = -1;
+        } else {
+            regions[n_regions++] = (ProfileRegion) {.name = name, .parent = parent};
+        }
+    }
+    if (r >= 0) {
+        regions[r].begin = timer_now();
+    }
+    /* overflowing regions still take a stack slot so that `end` pairs up */
+    if (region_depth < PROFILE_MAX_DEPTH) {
+        region_stack[region_depth] = r;
+    }
+    region_depth++;
+}
+
+void profile_region_end(void)
+{
+    if (region_depth == 0) {
+        return;
+    }
+    region_depth--;
+    int r = (region_depth < PROFILE_MAX_DEPTH) ? region_stack[region_depth] : -1;
+    if (r >= 0) {
+        regions[r].seconds += timer_now() - regions[r].begin;
+        regions[r].count++;
+    }
+}
+
+void profile_run_begin(void)
+{
+    memset(profile_threads, 0, sizeof(profile_threads));
+    n_regions = 0;
+    region_depth = 0;
+    current_run = ++last_run;
+    n_threads = parallel_n_threads();
+    profile_thread_attach(0);
+    wall_begin = timer_now();
+    ticks_begin = profile_ticks();
+}
+
+/*
+ * Returns the sum of counter `i` over all threads, or -1 if it was
+ * unavailable on any of them.
+ */
+static int64_t counter_total(int i)
+{
+    int64_t total = 0;
+    for (int t = 0; t < n_threads; t++) {
+        if (counters[t].run != last_run) {
+            continue;
+        }
+        if (counters[t].values[i] < 0) {
+            return -1;
+        }
+        total += counters[t].values[i];
+    }
+    return total;
+}
+
+/*
+ * Logs region `parent`'s children, depth first.
+ */
+static void print_regions(int parent, int depth)
+{
+    for (int r = 0; r < n_regions; r++) {
+        if (regions[r].parent != parent) {
+            continue;
+        }
+        log_info("  %*s%-*s %10.4f %8ld", 2 * depth, "", 28 - 2 * depth, regions[r].name,
+                 regions[r].seconds, (long) regions[r].count);
+        print_regions(r, depth + 1);
+    }
+}
+
+/*
+ * Logs the summary table of the last run.
+ */
+static void profile_print(void)
+{
+    log_info("Profile: %.4f s wall time, %d thread(s).", wall_seconds, n_threads);
+    log_info("  %-28s %10s %8s", "region", "time [s]", "count");
+    print_regions(-1, 0);
+
+    ProfileThread total = {0};
+    for (int t = 0; t < n_threads; t++) {
+        for (int p = 0; p < PROFILE_N_PHASES; p++) {
+            total.ticks[p] += profile_threads[t].ticks[p];
+            total.calls[p] += profile_threads[t].calls[p];
+        }
+        total.exits += profile_threads[t].exits;
+    }
+    uint64_t total_ticks = 0;
+    for (int p = 0; p < PROFILE_N_PHASES; p++) {
+        total_ticks += total.ticks[p];
+    }
+    log_info("  %-12s %12s %8s %14s %10s", "phase", "time [s]", "share", "calls", "ns/call");
+    for (int p = 0; p < PROFILE_N_PHASES; p++) {
+        double seconds = total.ticks[p] / ticks_per_second;
+        log_info("  %-12s %12.4f %7.1f%% %14lu %10.2f", phase_names[p], seconds,
+                 (total_ticks > 0) ? 100.0 * total.ticks[p] / total_ticks : 0.0,
+                 (unsigned long) total.calls[p],
+                 (total.calls[p] > 0) ? 1e9 * seconds / total.calls[p] : 0.0);
+    }
+    uint64_t n_particles = total.calls[PROFILE_PHASE_SPAWN];
+    log_info("  particles: %lu, bounds exits: %lu (%.1f%%)", (unsigned long) n_particles,
+             (unsigned long) total.exits, (n_particles > 0) ? 100.0 * total.exits / n_particles : 0.0);
+
+    int64_t values[PROFILE_N_COUNTERS];
+    for (int i = 0; i < PROFILE_N_COUNTERS; i++) {
+        values[i] = counter_total(i);
+    }
+    if (values[PROFILE_COUNTER_CYCLES] < 0) {
+        log_info("  hardware counters unavailable (see /proc/sys/kernel/perf_event_paranoid)");
+        return;
+    }
+    for (int i = 0; i < PROFILE_N_COUNTERS; i++) {
+        if (values[i] < 0) {
+            log_info("  %-12s %16s", counter_names[i], "n/a");
+        } else {
+            log_info("  %-12s %16ld %12.2f / particle", counter_names[i], (long) values[i],
+                     (n_particles > 0) ? (double) values[i] / n_particles : 0.0);
+        }
+    }
+    if (values[PROFILE_COUNTER_INSTRUCTIONS] >= 0 && values[PROFILE_COUNTER_CYCLES] > 0) {
+        log_info("  %-12s %16.2f", "ipc",
+                 (double) values[PROFILE_COUNTER_INSTRUCTIONS] / values[PROFILE_COUNTER_CYCLES]);
+    }
+}
+
+void profile_run_end(void)
+{
+    if (current_run == 0) {
+        return;
+    }
+    wall_seconds = timer_now() - wall_begin;
+    uint64_t ticks = profile_ticks() - ticks_begin;
+    ticks_per_second = (wall_seconds > 0.0 && ticks > 0) ? ticks / wall_seconds : 1e9;
+    while (region_depth > 0) {
+        profile_region_end();
+    }
+    for (int t = 0; t < THREAD_POOL_MAX_THREADS; t++) {
+        if (counters[t].run == current_run) {
+            counters_close(&counters[t]);
+        }
+    }
+    current_run = 0;
+    profile_print();
+}
+
+/*
+ * Writes the hardware counters `values` as a JSON object.
+ */
+static void write_counters_json(FILE *fp, const int64_t *values)
+{
+    fprintf(fp, "{");
+    for (int i = 0; i < PROFILE_N_COUNTERS; i++) {
+        if (values[i] < 0) {
+            fprintf(fp, "%s\"%s\": null", (i > 0) ? ", " : "", counter_names[i]);
+        } else {
+            fprintf(fp, "%s\"%s\": %ld", (i > 0) ? ", " : "", counter_names[i], (long) values[i]);
+        }
+    }
+    fprintf(fp, "}");
+}
+
+void profile_write_json(FILE *fp)
+{
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"wall_seconds\": %.6f,\n", wall_seconds);
+    fprintf(fp, "  \"ticks_per_second\": %.1f,\n", ticks_per_second);
+    fprintf(fp, "  \"threads\": %d,\n", n_threads);
+
+    fprintf(fp, "  \"regions\": [\n");
+    for (int r = 0; r < n_regions; r++) {
+        fprintf(fp, "    {\"id\": %d, \"parent\": %d, \"name\": \"%s\", \"seconds\": %.6f, \"count\": %ld}%s\n",
+                r, regions[r].parent, regions[r].name, regions[r].seconds, (long) regions[r].count,
+                (r + 1 < n_regions) ? "," : "");
+    }
+    fprintf(fp, "  ],\n");
+
+    int64_t totals[PROFILE_N_COUNTERS];
+    for (int i = 0; i < PROFILE_N_COUNTERS; i++) {
+        totals[i] = counter_total(i);
+    }
+    fprintf(fp, "  \"counters\": ");
+    write_counters_json(fp, totals);
+    fprintf(fp, ",\n");
+
+    fprintf(fp, "  \"threads_detail\": [\n");
+    for (int t = 0; t < n_threads; t++) {
+        const ProfileThread *pt = &profile_threads[t];
+        fprintf(fp, "    {\"thread\": %d, \"phases\": {", t);
+        for (int p = 0; p < PROFILE_N_PHASES; p++) {
+            fprintf(fp, "%s\"%s\": {\"seconds\": %.6f, \"calls\": %lu}", (p > 0) ? ", " : "",
+                    phase_names[p], pt->ticks[p] / ticks_per_second, (unsigned long) pt->calls[p]);
+        }
+        fprintf(fp, "}, \"bounds_exits\": %lu, \"counters\": ", (unsigned long) pt->exits);
+        int64_t none[PROFILE_N_COUNTERS] = {-1, -1, -1, -1};
+        write_counters_json(fp, (counters[t].run == last_run) ? counters[t].values : none);
+        fprintf(fp, "}%s\n", (t + 1 < n_threads) ? "," : "");
+    }
+    fprintf(fp, "  ]\n");
+    fprintf(fp, "}\n");
+}
@@ -0,0 +1,135 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+/*
+ * Opt-in instrumentation of the simulation, enabled by compiling with
+ * -DERODR_PROFILE (`make PROFILE=1 ...`). Without it, all macros below
+ * expand to nothing.
+ *
+ * Two kinds of measurements are taken:
+ *  - Regions: nested wall-clock timers around the stages of a run (thermal
+ *    erosion, pyramid levels, particle batches, ...). Only the thread
+ *    driving the simulation opens regions.
+ *  - Phases: per-thread cycle counters for the phases of a particle's life,
+ *    taken inside the particle loop.
+ * On Linux, hardware counters (cycles, instructions, LLC misses, dTLB
+ * misses) of every simulation thread are collected with perf_event_open.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+typedef enum ProfilePhase {
+    PROFILE_PHASE_SPAWN = 0,    /* spawn position sampling */
+    PROFILE_PHASE_SAMPLE,       /* height & gradient interpolation */
+    PROFILE_PHASE_DIRECTION,    /* direction & position update, bounds check */
+    PROFILE_PHASE_ERODE,        /* capacity, erosion scatter, velocity update */
+    PROFILE_PHASE_DEPOSIT,      /* capacity, deposition, velocity update */
+    PROFILE_N_PHASES,
+} ProfilePhase;
+
+#ifdef ERODR_PROFILE
+
+#include "thread_pool.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+/*
+ * Phase counters of one thread, padded to separate cache lines.
+ */
+typedef struct ProfileThread {
+    _Alignas(64) uint64_t ticks[PROFILE_N_PHASES];
+    uint64_t calls[PROFILE_N_PHASES];
+    uint64_t exits;     /* particles that left the map */
+} ProfileThread;
+
+extern ProfileThread profile_threads[THREAD_POOL_MAX_THREADS];
+
+/*
+ * Returns a timestamp in cycles (TSC) on x86, nanoseconds otherwise.
+ */
+static inline uint64_t profile_ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+/*
+ * Adds the ticks since `*t` to `phase` of `thread` and restarts `*t`.
+ */
+static inline void profile_lap(int thread, ProfilePhase phase, uint64_t *t)
+{
+    uint64_t now = profile_ticks();
+    profile_threads[thread].ticks[phase] += now - *t;
+    profile_threads[thread].calls[phase]++;
+    *t = now;
+}
+
+/*
+ * Counts a particle leaving the map on `thread`.
+ */
+static inline void profile_count_exit(int thread)
+{
+    profile_threads[thread].exits++;
+}
+
+/*
+ * Starts hardware counters for the calling thread as `thread`, if not yet
+ * done.
+ */
+void profile_thread_attach(int thread);
+
+/*
+ * Opens and closes a (nested) region named `name`. `name` must be a string
+ * literal or otherwise outlive the profile.
+ */
+void profile_region_begin(const char *name);
+void profile_region_end(void);
+
+/*
+ * Resets all measurements. Called at the start of a run.
+ */
+void profile_run_begin(void);
+
+/*
+ * Stops the measurements of the current run and logs a summary table.
+ */
+void profile_run_end(void);
+
+/*
+ * Writes the measurements of the last run to `fp` as JSON.
+ */
+void profile_write_json(FILE *fp);
+
+#define PROFILE_START(t)                uint64_t t = profile_ticks()
+#define PROFILE_LAP(thread, phase, t)   profile_lap((thread), (phase), &(t))
+#define PROFILE_EXIT(thread)            profile_count_exit(thread)
+#define PROFILE_THREAD_ATTACH(thread)   profile_thread_attach(thread)
+#define PROFILE_REGION_BEGIN(name)      profile_region_begin(name)
+#define PROFILE_REGION_END()            profile_region_end()
+#define PROFILE_RUN_BEGIN()             profile_run_begin()
+#define PROFILE_RUN_END()               profile_run_end()
+
+#else
+
+#define PROFILE_START(t)
+#define PROFILE_LAP(thread, phase, t)
+#define PROFILE_EXIT(thread)
+#define PROFILE_THREAD_ATTACH(thread)
+#define PROFILE_REGION_BEGIN(name)
+#define PROFILE_REGION_END()
+#define PROFILE_RUN_BEGIN()
+#define PROFILE_RUN_END()
+
+#endif /* ERODR_PROFILE */
+
+#endif /* PROFILE_H */
@@ -0,0 +1,145 @@
+#include "pyramid_sim.h"
+#include "erosion_sim.h"
+#include "timer.h"
+#include "log.h"
+#include "thread_pool.h"
+#include "profile.h"
+#include "trace.h"
+
+#include <math.h>
+
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+#define PYRAMID_MAX_LEVELS 16
+#define PYRAMID_MIN_SIZE   32
+
+_Static_assert(WORKSPACE_SLOT_PYRAMID + 2 * PYRAMID_MAX_LEVELS <= WORKSPACE_MAX_IMAGES,
+               "not enough workspace slots for the pyramid");
+
+/*
+ * Returns the simulation parameters for pyramid level `level` (0 = full
+ * resolution) of a pyramid with `n_levels` levels. A pixel at level `level`
+ * spans `s` = 2^level full resolution pixels, so distances measured in 
+ * pixels (radius, ttl) shrink by `s` while per-pixel height differences 
+ * (min slope, and thereby sediment capacity) grow by `s`. The coarsest 
+ * level is simulated with the same particle density as the full resolution
+ * map. Every finer level uses `pyramid_refine` times the density of the 
+ * level below it. The region of interest is scaled to the level's resolution.
+ */
+static SimulationParameters level_params(SimulationParameters *params, int level, int n_levels)
+{
+    SimulationParameters p = *params;
+    float s = (float)(1 << level);
+    float density = powf(params->pyramid_refine, (float)(n_levels - 1 - level));
+    p.n           = (int)((float)params->n * density / (s * s));
+    p.ttl         = MAX(1, (int)((float)params->ttl / s));
+    p.p_radius    = (params->p_radius > 0) ? MAX(1, (int)roundf(params->p_radius / s)) : 0;
+    p.p_capacity  = params->p_capacity / s;
+    p.p_min_slope = params->p_min_slope * s;
+    p.roi_x       = (int)(params->roi_x / s);
+    p.roi_y       = (int)(params->roi_y / s);
+    p.roi_width   = (params->roi_width > 0) ? MAX(1, (int)ceilf(params->roi_width / s)) : 0;
+    p.roi_height  = (params->roi_height > 0) ? MAX(1, (int)ceilf(params->roi_height / s)) : 0;
+    p.roi_feather = params->roi_feather / s;
+    return p;
+}
+
+/*
+ * Runs hydraulic erosion simulation over an image pyramid.
+ */
+bool pyramid_sim_run(ErodrImage *hmap, SimulationParameters *params, const ErosionSimOptions *opts)
+{
+    ErodrImage original[PYRAMID_MAX_LEVELS];
+    ErodrImage work[PYRAMID_MAX_LEVELS];
+    double level_time[PYRAMID_MAX_LEVELS];
+
+    Workspace local_ws = {0};
+    Workspace *ws = (opts != NULL && opts->workspace != NULL) ? opts->workspace : &local_ws;
+
+    /* build pyramid of original heightmaps. Level 0 is `hmap` itself. */
+    int n_levels = 1;
+    original[0] = *hmap;
+    work[0] = *hmap;
+    while (n_levels < params->pyramid_levels && n_levels < PYRAMID_MAX_LEVELS) {
+        ErodrImage *finer = &original[n_levels - 1];
+        int width = (finer->width + 1) / 2;
+        int height = (finer->height + 1) / 2;
+        if (width < PYRAMID_MIN_SIZE || height < PYRAMID_MIN_SIZE) {
+            break;
+        }
+        ErodrImage *o = workspace_image(ws, WORKSPACE_SLOT_PYRAMID + 2 * n_levels, width, height);
+        ErodrImage *w = workspace_image(ws, WORKSPACE_SLOT_PYRAMID + 2 * n_levels + 1, width, height);
+        if (o == NULL || w == NULL) {
+            log_error("Error: could not allocate pyramid level %d.", n_levels);
+            break;
+        }
+        original[n_levels] = *o;
+        work[n_levels] = *w;
+        image_downsample(&original[n_levels], finer);
+        n_levels++;
+    }
+
+    if (n_levels < params->pyramid_levels) {
+        log_info("Heightmap too small for %d pyramid levels, using %d.", params->pyramid_levels, n_levels);
+    }
+
+    /* checkpoints are not supported across pyramid levels */
+    ErosionSimOptions level_opts = {0};
+    if (opts != NULL) {
+        level_opts.spawn_density = opts->spawn_density;
+        level_opts.progress      = opts->progress;
+        level_opts.progress_user = opts->progress_user;
+        level_opts.stats         = opts->stats;
+        level_opts.cancel        = opts->cancel;
+        level_opts.slice         = opts->slice;
+        level_opts.counters      = opts->counters;
+    }
+    level_opts.workspace = ws;
+
+    /* erode coarse to fine. */
+    bool completed = true;
+    double t_total = timer_now();
+    for (int level = n_levels - 1; level >= 0 && completed; level--) {
+        double t_level = timer_now();
+        double t_trace = trace_begin();
+        PROFILE_REGION_BEGIN("pyramid level");
+        PROFILE_REGION_BEGIN("resample");
+        if (level > 0) {
+            image_copy(&work[level], &original[level]);
+        }
+
+        /* carry over the erosion delta from the coarser level. */
+        if (level < n_levels - 1) {
+            ErodrImage *coarse = &work[level + 1];
+            image_sub(coarse, &original[level + 1]);
+            image_upsample_add(&work[level], coarse);
+        }
+        PROFILE_REGION_END();
+
+        SimulationParameters p = level_params(params, level, n_levels);
+        log_info("Pyramid level %d (%dx%d): %d particles, ttl = %d, radius = %d",
+                 level, work[level].width, work[level].height, p.n, p.ttl, p.p_radius);
+        /* output layers and snapshots have the resolution of the finest level */
+        level_opts.layers = (level == 0 && opts != NULL) ? opts->layers : NULL;
+        level_opts.snapshots = (level == 0 && opts != NULL) ? opts->snapshots : NULL;
+        level_opts.live = (level == 0 && opts != NULL) ? opts->live : NULL; /* coarser levels use scaled coefficients */
+        completed = erosion_sim_run(&work[level], &p, &level_opts);
+        PROFILE_REGION_END();
+        trace_end_n("pyramid level", "sim", t_trace, level);
+        level_time[level] = timer_now() - t_level;
+    }
+    t_total = timer_now() - t_total;
+
+    /* report */
+    if (completed) {
+        for (int level = n_levels - 1; level >= 0; level--) {
+            log_info("Pyramid level %d time: %.3f s", level, level_time[level]);
+        }
+        log_info("Pyramid total time: %.3f s", t_total);
+    }
+
+    if (ws == &local_ws) {
+        workspace_free(&local_ws);
+    }
+    return completed;
+}
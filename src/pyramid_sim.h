@@ -0,0 +1,17 @@
+#ifndef PYRAMID_SIM_H
+#define PYRAMID_SIM_H
+
+#include "image.h"
+#include "params.h"
+#include "erosion_sim.h"
+
+/*
+ * Runs hydraulic erosion coarse-to-fine over an image pyramid with
+ * `params->pyramid_levels` levels. The erosion delta of each level is
+ * upsampled onto the next finer level, which is then refined with fewer
+ * particles. `opts` may be NULL. Checkpoints and resuming are not
+ * supported. Returns false if the run was cancelled.
+ */
+bool pyramid_sim_run(ErodrImage *hmap, SimulationParameters *params, const ErosionSimOptions *opts);
+
+#endif /* PYRAMID_SIM_H */
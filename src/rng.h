@@ -0,0 +1,51 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdint.h>
+
+/*
+ * Small, fast pseudo random number generator (splitmix64). Every particle
+ * gets its own generator seeded from the simulation seed and the particle
+ * index, so the random sequence of a particle doesn't depend on which thread
+ * simulates it or in which order.
+ */
+typedef struct Rng {
+    uint64_t state;
+} Rng;
+
+/*
+ * Returns a generator for stream `stream` of seed `seed`.
+ */
+static inline Rng rng_make(uint64_t seed, uint64_t stream)
+{
+    return (Rng) {.state = seed ^ (stream * 0xD1B54A32D192ED03ull)};
+}
+
+/*
+ * Returns the next 64 random bits from `rng`.
+ */
+static inline uint64_t rng_next(Rng *rng)
+{
+    uint64_t z = (rng->state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+/*
+ * Returns a uniformly distributed float in [0, 1).
+ */
+static inline float rng_float(Rng *rng)
+{
+    return (float)(rng_next(rng) >> 40) * (1.0f / 16777216.0f);
+}
+
+/*
+ * Returns a uniformly distributed integer in [0, n).
+ */
+static inline uint32_t rng_range(Rng *rng, uint32_t n)
+{
+    return (uint32_t)(((rng_next(rng) >> 32) * (uint64_t)n) >> 32);
+}
+
+#endif /* RNG_H */
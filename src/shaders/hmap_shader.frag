@@ -3,9 +3,8 @@
 in vec2 fragTexCoord;
 in vec4 fragColor;
 
-uniform sampler2D texture0;
+uniform sampler2D texture1;  /* height, gradient, snow pooling gradient (see derived.h) */
 uniform int mode;
-uniform float res;
 uniform float snow_threshold;
 uniform float snow_pooling;
 
@@ -31,25 +30,18 @@ float remap(float in_min, float in_max, float out_min, float out_max, float valu
 
 void main()
 {
-    /* raw albedo */
-    float v = texture(texture0, fragTexCoord).r;
-
-    /* gradient */
-    float s0 = texture(texture0, fragTexCoord - 0.5 * vec2(1.0/res)).r;
-    float d1 = abs(s0 - texture(texture0, fragTexCoord + 0.5 * vec2(0, 1.0/res)).r);
-    float d2 = abs(s0 - texture(texture0, fragTexCoord + 0.5 * vec2(1.0/res, 0)).r);
-    float gradient = sqrt(d1*d1 + d2*d2);
+    /* raw albedo and gradient, precomputed on the CPU */
+    vec4 derived = texture(texture1, fragTexCoord);
+    float v = derived.r;
+    float gradient = derived.g;
 
     switch (mode) {
         /* snow cover visualizer */
         case 0: {
             /* gradient adjusted for snow pooling (samples further away) */
-            s0 = texture(texture0, fragTexCoord - 0.5*snow_pooling * vec2(1.0/res)).r;
-            d1 = abs(s0 - texture(texture0, fragTexCoord + 0.5*snow_pooling * vec2(0, 1.0/res)).r);
-            d2 = abs(s0 - texture(texture0, fragTexCoord + 0.5*snow_pooling * vec2(1.0/res, 0)).r);
+            float snow_gradient = derived.b;
 
             /* calculate color */
-            float snow_gradient = sqrt(d1*d1 + d2*d2);
             float snow_amount = clamp(remap(snow_pooling*snow_threshold,
                                             snow_pooling*snow_threshold-0.0006/pow(v, 1.5),
                                             0.0, 1.0, snow_gradient/pow(v, 1.5)), 0, 1);
@@ -0,0 +1,26 @@
+#version 330
+
+in vec3 vertexPosition;
+in vec2 vertexTexCoord;
+in vec4 vertexColor;
+
+uniform mat4 mvp;
+uniform sampler2D texture0;
+uniform float terrain_height;
+uniform vec3 patch_rect;    /* uv offset (xy) and uv size (z) of the terrain patch */
+uniform float skirt_depth;
+
+out vec2 fragTexCoord;
+out vec4 fragColor;
+
+void main()
+{
+    /* displace the flat patch by the heightmap, skirt vertices (y = -1) hang below it */
+    vec2 uv = patch_rect.xy + patch_rect.z * vertexTexCoord;
+    float h = textureLod(texture0, uv, 0.0).r;
+    vec3 position = vec3(vertexPosition.x, terrain_height * h + skirt_depth * vertexPosition.y, vertexPosition.z);
+
+    fragTexCoord = uv;
+    fragColor = vertexColor;
+    gl_Position = mvp * vec4(position, 1.0);
+}
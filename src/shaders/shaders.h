@@ -5,81 +5,100 @@
 // This file has been autogenerated. DO NOT MODIFY.
 //
 
+static const char SHADERS_HMAP_VERT_SRC[] = {
+    35, 118, 101, 114, 115, 105, 111, 110, 32, 51, 51, 48, 10, 10, 105, 110, 32, 118, 101, 99, 
+    51, 32, 118, 101, 114, 116, 101, 120, 80, 111, 115, 105, 116, 105, 111, 110, 59, 10, 105, 110, 
+    32, 118, 101, 99, 50, 32, 118, 101, 114, 116, 101, 120, 84, 101, 120, 67, 111, 111, 114, 100, 
+    59, 10, 105, 110, 32, 118, 101, 99, 52, 32, 118, 101, 114, 116, 101, 120, 67, 111, 108, 111, 
+    114, 59, 10, 10, 117, 110, 105, 102, 111, 114, 109, 32, 109, 97, 116, 52, 32, 109, 118, 112, 
+    59, 10, 117, 110, 105, 102, 111, 114, 109, 32, 115, 97, 109, 112, 108, 101, 114, 50, 68, 32, 
+    116, 101, 120, 116, 117, 114, 101, 48, 59, 10, 117, 110, 105, 102, 111, 114, 109, 32, 102, 108, 
+    111, 97, 116, 32, 116, 101, 114, 114, 97, 105, 110, 95, 104, 101, 105, 103, 104, 116, 59, 10, 
+    117, 110, 105, 102, 111, 114, 109, 32, 118, 101, 99, 51, 32, 112, 97, 116, 99, 104, 95, 114, 
+    101, 99, 116, 59, 32, 32, 32, 32, 47, 42, 32, 117, 118, 32, 111, 102, 102, 115, 101, 116, 
+    32, 40, 120, 121, 41, 32, 97, 110, 100, 32, 117, 118, 32, 115, 105, 122, 101, 32, 40, 122, 
+    41, 32, 111, 102, 32, 116, 104, 101, 32, 116, 101, 114, 114, 97, 105, 110, 32, 112, 97, 116, 
+    99, 104, 32, 42, 47, 10, 117, 110, 105, 102, 111, 114, 109, 32, 102, 108, 111, 97, 116, 32, 
+    115, 107, 105, 114, 116, 95, 100, 101, 112, 116, 104, 59, 10, 10, 111, 117, 116, 32, 118, 101, 
+    99, 50, 32, 102, 114, 97, 103, 84, 101, 120, 67, 111, 111, 114, 100, 59, 10, 111, 117, 116, 
+    32, 118, 101, 99, 52, 32, 102, 114, 97, 103, 67, 111, 108, 111, 114, 59, 10, 10, 118, 111, 
+    105, 100, 32, 109, 97, 105, 110, 40, 41, 10, 123, 10, 32, 32, 32, 32, 47, 42, 32, 100, 
+    105, 115, 112, 108, 97, 99, 101, 32, 116, 104, 101, 32, 102, 108, 97, 116, 32, 112, 97, 116, 
+    99, 104, 32, 98, 121, 32, 116, 104, 101, 32, 104, 101, 105, 103, 104, 116, 109, 97, 112, 44, 
+    32, 115, 107, 105, 114, 116, 32, 118, 101, 114, 116, 105, 99, 101, 115, 32, 40, 121, 32, 61, 
+    32, 45, 49, 41, 32, 104, 97, 110, 103, 32, 98, 101, 108, 111, 119, 32, 105, 116, 32, 42, 
+    47, 10, 32, 32, 32, 32, 118, 101, 99, 50, 32, 117, 118, 32, 61, 32, 112, 97, 116, 99, 
+    104, 95, 114, 101, 99, 116, 46, 120, 121, 32, 43, 32, 112, 97, 116, 99, 104, 95, 114, 101, 
+    99, 116, 46, 122, 32, 42, 32, 118, 101, 114, 116, 101, 120, 84, 101, 120, 67, 111, 111, 114, 
+    100, 59, 10, 32, 32, 32, 32, 102, 108, 111, 97, 116, 32, 104, 32, 61, 32, 116, 101, 120, 
+    116, 117, 114, 101, 76, 111, 100, 40, 116, 101, 120, 116, 117, 114, 101, 48, 44, 32, 117, 118, 
+    44, 32, 48, 46, 48, 41, 46, 114, 59, 10, 32, 32, 32, 32, 118, 101, 99, 51, 32, 112, 
+    111, 115, 105, 116, 105, 111, 110, 32, 61, 32, 118, 101, 99, 51, 40, 118, 101, 114, 116, 101, 
+    120, 80, 111, 115, 105, 116, 105, 111, 110, 46, 120, 44, 32, 116, 101, 114, 114, 97, 105, 110, 
+    95, 104, 101, 105, 103, 104, 116, 32, 42, 32, 104, 32, 43, 32, 115, 107, 105, 114, 116, 95, 
+    100, 101, 112, 116, 104, 32, 42, 32, 118, 101, 114, 116, 101, 120, 80, 111, 115, 105, 116, 105, 
+    111, 110, 46, 121, 44, 32, 118, 101, 114, 116, 101, 120, 80, 111, 115, 105, 116, 105, 111, 110, 
+    46, 122, 41, 59, 10, 10, 32, 32, 32, 32, 102, 114, 97, 103, 84, 101, 120, 67, 111, 111, 
+    114, 100, 32, 61, 32, 117, 118, 59, 10, 32, 32, 32, 32, 102, 114, 97, 103, 67, 111, 108, 
+    111, 114, 32, 61, 32, 118, 101, 114, 116, 101, 120, 67, 111, 108, 111, 114, 59, 10, 32, 32, 
+    32, 32, 103, 108, 95, 80, 111, 115, 105, 116, 105, 111, 110, 32, 61, 32, 109, 118, 112, 32, 
+    42, 32, 118, 101, 99, 52, 40, 112, 111, 115, 105, 116, 105, 111, 110, 44, 32, 49, 46, 48, 
+    41, 59, 10, 125, 10
+    , 0
+};
+
 static const char SHADERS_HMAP_FRAG_SRC[] = {
     35, 118, 101, 114, 115, 105, 111, 110, 32, 51, 51, 48, 10, 10, 105, 110, 32, 118, 101, 99, 
     50, 32, 102, 114, 97, 103, 84, 101, 120, 67, 111, 111, 114, 100, 59, 10, 105, 110, 32, 118, 
     101, 99, 52, 32, 102, 114, 97, 103, 67, 111, 108, 111, 114, 59, 10, 10, 117, 110, 105, 102, 
     111, 114, 109, 32, 115, 97, 109, 112, 108, 101, 114, 50, 68, 32, 116, 101, 120, 116, 117, 114, 
-    101, 48, 59, 10, 117, 110, 105, 102, 111, 114, 109, 32, 105, 110, 116, 32, 109, 111, 100, 101, 
-    59, 10, 117, 110, 105, 102, 111, 114, 109, 32, 102, 108, 111, 97, 116, 32, 114, 101, 115, 59, 
-    10, 117, 110, 105, 102, 111, 114, 109, 32, 102, 108, 111, 97, 116, 32, 115, 110, 111, 119, 95, 
-    116, 104, 114, 101, 115, 104, 111, 108, 100, 59, 10, 117, 110, 105, 102, 111, 114, 109, 32, 102, 
-    108, 111, 97, 116, 32, 115, 110, 111, 119, 95, 112, 111, 111, 108, 105, 110, 103, 59, 10, 10, 
-    111, 117, 116, 32, 118, 101, 99, 52, 32, 102, 105, 110, 97, 108, 67, 111, 108, 111, 114, 59, 
-    10, 10, 35, 100, 101, 102, 105, 110, 101, 32, 80, 73, 32, 51, 46, 49, 52, 49, 57, 50, 
-    57, 53, 10, 10, 102, 108, 111, 97, 116, 32, 108, 101, 114, 112, 40, 102, 108, 111, 97, 116, 
-    32, 97, 44, 32, 102, 108, 111, 97, 116, 32, 98, 44, 32, 102, 108, 111, 97, 116, 32, 116, 
-    41, 10, 123, 10, 32, 32, 32, 32, 114, 101, 116, 117, 114, 110, 32, 40, 49, 46, 48, 32, 
-    45, 32, 116, 41, 32, 42, 32, 97, 32, 43, 32, 116, 32, 42, 32, 98, 59, 10, 125, 10, 
-    10, 102, 108, 111, 97, 116, 32, 105, 108, 101, 114, 112, 40, 102, 108, 111, 97, 116, 32, 97, 
-    44, 32, 102, 108, 111, 97, 116, 32, 98, 44, 32, 102, 108, 111, 97, 116, 32, 118, 97, 108, 
-    117, 101, 41, 10, 123, 10, 32, 32, 32, 32, 114, 101, 116, 117, 114, 110, 32, 40, 118, 97, 
-    108, 117, 101, 32, 45, 32, 97, 41, 32, 47, 32, 40, 98, 32, 45, 32, 97, 41, 59, 10, 
-    125, 10, 10, 102, 108, 111, 97, 116, 32, 114, 101, 109, 97, 112, 40, 102, 108, 111, 97, 116, 
-    32, 105, 110, 95, 109, 105, 110, 44, 32, 102, 108, 111, 97, 116, 32, 105, 110, 95, 109, 97, 
-    120, 44, 32, 102, 108, 111, 97, 116, 32, 111, 117, 116, 95, 109, 105, 110, 44, 32, 102, 108, 
-    111, 97, 116, 32, 111, 117, 116, 95, 109, 97, 120, 44, 32, 102, 108, 111, 97, 116, 32, 118, 
-    97, 108, 117, 101, 41, 10, 123, 10, 32, 32, 32, 32, 102, 108, 111, 97, 116, 32, 116, 32, 
-    61, 32, 105, 108, 101, 114, 112, 40, 105, 110, 95, 109, 105, 110, 44, 32, 105, 110, 95, 109, 
-    97, 120, 44, 32, 118, 97, 108, 117, 101, 41, 59, 10, 32, 32, 32, 32, 114, 101, 116, 117, 
-    114, 110, 32, 108, 101, 114, 112, 40, 111, 117, 116, 95, 109, 105, 110, 44, 32, 111, 117, 116, 
-    95, 109, 97, 120, 44, 32, 116, 41, 59, 10, 125, 10, 10, 118, 111, 105, 100, 32, 109, 97, 
-    105, 110, 40, 41, 10, 123, 10, 32, 32, 32, 32, 47, 42, 32, 114, 97, 119, 32, 97, 108, 
-    98, 101, 100, 111, 32, 42, 47, 10, 32, 32, 32, 32, 102, 108, 111, 97, 116, 32, 118, 32, 
-    61, 32, 116, 101, 120, 116, 117, 114, 101, 40, 116, 101, 120, 116, 117, 114, 101, 48, 44, 32, 
-    102, 114, 97, 103, 84, 101, 120, 67, 111, 111, 114, 100, 41, 46, 114, 59, 10, 10, 32, 32, 
-    32, 32, 47, 42, 32, 103, 114, 97, 100, 105, 101, 110, 116, 32, 42, 47, 10, 32, 32, 32, 
-    32, 102, 108, 111, 97, 116, 32, 115, 48, 32, 61, 32, 116, 101, 120, 116, 117, 114, 101, 40, 
-    116, 101, 120, 116, 117, 114, 101, 48, 44, 32, 102, 114, 97, 103, 84, 101, 120, 67, 111, 111, 
-    114, 100, 32, 45, 32, 48, 46, 53, 32, 42, 32, 118, 101, 99, 50, 40, 49, 46, 48, 47, 
-    114, 101, 115, 41, 41, 46, 114, 59, 10, 32, 32, 32, 32, 102, 108, 111, 97, 116, 32, 100, 
-    49, 32, 61, 32, 97, 98, 115, 40, 115, 48, 32, 45, 32, 116, 101, 120, 116, 117, 114, 101, 
-    40, 116, 101, 120, 116, 117, 114, 101, 48, 44, 32, 102, 114, 97, 103, 84, 101, 120, 67, 111, 
-    111, 114, 100, 32, 43, 32, 48, 46, 53, 32, 42, 32, 118, 101, 99, 50, 40, 48, 44, 32, 
-    49, 46, 48, 47, 114, 101, 115, 41, 41, 46, 114, 41, 59, 10, 32, 32, 32, 32, 102, 108, 
-    111, 97, 116, 32, 100, 50, 32, 61, 32, 97, 98, 115, 40, 115, 48, 32, 45, 32, 116, 101, 
-    120, 116, 117, 114, 101, 40, 116, 101, 120, 116, 117, 114, 101, 48, 44, 32, 102, 114, 97, 103, 
-    84, 101, 120, 67, 111, 111, 114, 100, 32, 43, 32, 48, 46, 53, 32, 42, 32, 118, 101, 99, 
-    50, 40, 49, 46, 48, 47, 114, 101, 115, 44, 32, 48, 41, 41, 46, 114, 41, 59, 10, 32, 
-    32, 32, 32, 102, 108, 111, 97, 116, 32, 103, 114, 97, 100, 105, 101, 110, 116, 32, 61, 32, 
-    115, 113, 114, 116, 40, 100, 49, 42, 100, 49, 32, 43, 32, 100, 50, 42, 100, 50, 41, 59, 
-    10, 10, 32, 32, 32, 32, 115, 119, 105, 116, 99, 104, 32, 40, 109, 111, 100, 101, 41, 32, 
-    123, 10, 32, 32, 32, 32, 32, 32, 32, 32, 47, 42, 32, 115, 110, 111, 119, 32, 99, 111, 
-    118, 101, 114, 32, 118, 105, 115, 117, 97, 108, 105, 122, 101, 114, 32, 42, 47, 10, 32, 32, 
-    32, 32, 32, 32, 32, 32, 99, 97, 115, 101, 32, 48, 58, 32, 123, 10, 32, 32, 32, 32, 
-    32, 32, 32, 32, 32, 32, 32, 32, 47, 42, 32, 103, 114, 97, 100, 105, 101, 110, 116, 32, 
-    97, 100, 106, 117, 115, 116, 101, 100, 32, 102, 111, 114, 32, 115, 110, 111, 119, 32, 112, 111, 
-    111, 108, 105, 110, 103, 32, 40, 115, 97, 109, 112, 108, 101, 115, 32, 102, 117, 114, 116, 104, 
-    101, 114, 32, 97, 119, 97, 121, 41, 32, 42, 47, 10, 32, 32, 32, 32, 32, 32, 32, 32, 
-    32, 32, 32, 32, 115, 48, 32, 61, 32, 116, 101, 120, 116, 117, 114, 101, 40, 116, 101, 120, 
-    116, 117, 114, 101, 48, 44, 32, 102, 114, 97, 103, 84, 101, 120, 67, 111, 111, 114, 100, 32, 
-    45, 32, 48, 46, 53, 42, 115, 110, 111, 119, 95, 112, 111, 111, 108, 105, 110, 103, 32, 42, 
-    32, 118, 101, 99, 50, 40, 49, 46, 48, 47, 114, 101, 115, 41, 41, 46, 114, 59, 10, 32, 
-    32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 100, 49, 32, 61, 32, 97, 98, 115, 40, 
-    115, 48, 32, 45, 32, 116, 101, 120, 116, 117, 114, 101, 40, 116, 101, 120, 116, 117, 114, 101, 
-    48, 44, 32, 102, 114, 97, 103, 84, 101, 120, 67, 111, 111, 114, 100, 32, 43, 32, 48, 46, 
-    53, 42, 115, 110, 111, 119, 95, 112, 111, 111, 108, 105, 110, 103, 32, 42, 32, 118, 101, 99, 
-    50, 40, 48, 44, 32, 49, 46, 48, 47, 114, 101, 115, 41, 41, 46, 114, 41, 59, 10, 32, 
-    32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 100, 50, 32, 61, 32, 97, 98, 115, 40, 
-    115, 48, 32, 45, 32, 116, 101, 120, 116, 117, 114, 101, 40, 116, 101, 120, 116, 117, 114, 101, 
-    48, 44, 32, 102, 114, 97, 103, 84, 101, 120, 67, 111, 111, 114, 100, 32, 43, 32, 48, 46, 
-    53, 42, 115, 110, 111, 119, 95, 112, 111, 111, 108, 105, 110, 103, 32, 42, 32, 118, 101, 99, 
-    50, 40, 49, 46, 48, 47, 114, 101, 115, 44, 32, 48, 41, 41, 46, 114, 41, 59, 10, 10, 
-    32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 47, 42, 32, 99, 97, 108, 99, 117, 
-    108, 97, 116, 101, 32, 99, 111, 108, 111, 114, 32, 42, 47, 10, 32, 32, 32, 32, 32, 32, 
-    32, 32, 32, 32, 32, 32, 102, 108, 111, 97, 116, 32, 115, 110, 111, 119, 95, 103, 114, 97, 
-    100, 105, 101, 110, 116, 32, 61, 32, 115, 113, 114, 116, 40, 100, 49, 42, 100, 49, 32, 43, 
-    32, 100, 50, 42, 100, 50, 41, 59, 10, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 
+    101, 49, 59, 32, 32, 47, 42, 32, 104, 101, 105, 103, 104, 116, 44, 32, 103, 114, 97, 100, 
+    105, 101, 110, 116, 44, 32, 115, 110, 111, 119, 32, 112, 111, 111, 108, 105, 110, 103, 32, 103, 
+    114, 97, 100, 105, 101, 110, 116, 32, 40, 115, 101, 101, 32, 100, 101, 114, 105, 118, 101, 100, 
+    46, 104, 41, 32, 42, 47, 10, 117, 110, 105, 102, 111, 114, 109, 32, 105, 110, 116, 32, 109, 
+    111, 100, 101, 59, 10, 117, 110, 105, 102, 111, 114, 109, 32, 102, 108, 111, 97, 116, 32, 115, 
+    110, 111, 119, 95, 116, 104, 114, 101, 115, 104, 111, 108, 100, 59, 10, 117, 110, 105, 102, 111, 
+    114, 109, 32, 102, 108, 111, 97, 116, 32, 115, 110, 111, 119, 95, 112, 111, 111, 108, 105, 110, 
+    103, 59, 10, 10, 111, 117, 116, 32, 118, 101, 99, 52, 32, 102, 105, 110, 97, 108, 67, 111, 
+    108, 111, 114, 59, 10, 10, 35, 100, 101, 102, 105, 110, 101, 32, 80, 73, 32, 51, 46, 49, 
+    52, 49, 57, 50, 57, 53, 10, 10, 102, 108, 111, 97, 116, 32, 108, 101, 114, 112, 40, 102, 
+    108, 111, 97, 116, 32, 97, 44, 32, 102, 108, 111, 97, 116, 32, 98, 44, 32, 102, 108, 111, 
+    97, 116, 32, 116, 41, 10, 123, 10, 32, 32, 32, 32, 114, 101, 116, 117, 114, 110, 32, 40, 
+    49, 46, 48, 32, 45, 32, 116, 41, 32, 42, 32, 97, 32, 43, 32, 116, 32, 42, 32, 98, 
+    59, 10, 125, 10, 10, 102, 108, 111, 97, 116, 32, 105, 108, 101, 114, 112, 40, 102, 108, 111, 
+    97, 116, 32, 97, 44, 32, 102, 108, 111, 97, 116, 32, 98, 44, 32, 102, 108, 111, 97, 116, 
+    32, 118, 97, 108, 117, 101, 41, 10, 123, 10, 32, 32, 32, 32, 114, 101, 116, 117, 114, 110, 
+    32, 40, 118, 97, 108, 117, 101, 32, 45, 32, 97, 41, 32, 47, 32, 40, 98, 32, 45, 32, 
+    97, 41, 59, 10, 125, 10, 10, 102, 108, 111, 97, 116, 32, 114, 101, 109, 97, 112, 40, 102, 
+    108, 111, 97, 116, 32, 105, 110, 95, 109, 105, 110, 44, 32, 102, 108, 111, 97, 116, 32, 105, 
+    110, 95, 109, 97, 120, 44, 32, 102, 108, 111, 97, 116, 32, 111, 117, 116, 95, 109, 105, 110, 
+    44, 32, 102, 108, 111, 97, 116, 32, 111, 117, 116, 95, 109, 97, 120, 44, 32, 102, 108, 111, 
+    97, 116, 32, 118, 97, 108, 117, 101, 41, 10, 123, 10, 32, 32, 32, 32, 102, 108, 111, 97, 
+    116, 32, 116, 32, 61, 32, 105, 108, 101, 114, 112, 40, 105, 110, 95, 109, 105, 110, 44, 32, 
+    105, 110, 95, 109, 97, 120, 44, 32, 118, 97, 108, 117, 101, 41, 59, 10, 32, 32, 32, 32, 
+    114, 101, 116, 117, 114, 110, 32, 108, 101, 114, 112, 40, 111, 117, 116, 95, 109, 105, 110, 44, 
+    32, 111, 117, 116, 95, 109, 97, 120, 44, 32, 116, 41, 59, 10, 125, 10, 10, 118, 111, 105, 
+    100, 32, 109, 97, 105, 110, 40, 41, 10, 123, 10, 32, 32, 32, 32, 47, 42, 32, 114, 97, 
+    119, 32, 97, 108, 98, 101, 100, 111, 32, 97, 110, 100, 32, 103, 114, 97, 100, 105, 101, 110, 
+    116, 44, 32, 112, 114, 101, 99, 111, 109, 112, 117, 116, 101, 100, 32, 111, 110, 32, 116, 104, 
+    101, 32, 67, 80, 85, 32, 42, 47, 10, 32, 32, 32, 32, 118, 101, 99, 52, 32, 100, 101, 
+    114, 105, 118, 101, 100, 32, 61, 32, 116, 101, 120, 116, 117, 114, 101, 40, 116, 101, 120, 116, 
+    117, 114, 101, 49, 44, 32, 102, 114, 97, 103, 84, 101, 120, 67, 111, 111, 114, 100, 41, 59, 
+    10, 32, 32, 32, 32, 102, 108, 111, 97, 116, 32, 118, 32, 61, 32, 100, 101, 114, 105, 118, 
+    101, 100, 46, 114, 59, 10, 32, 32, 32, 32, 102, 108, 111, 97, 116, 32, 103, 114, 97, 100, 
+    105, 101, 110, 116, 32, 61, 32, 100, 101, 114, 105, 118, 101, 100, 46, 103, 59, 10, 10, 32, 
+    32, 32, 32, 115, 119, 105, 116, 99, 104, 32, 40, 109, 111, 100, 101, 41, 32, 123, 10, 32, 
+    32, 32, 32, 32, 32, 32, 32, 47, 42, 32, 115, 110, 111, 119, 32, 99, 111, 118, 101, 114, 
+    32, 118, 105, 115, 117, 97, 108, 105, 122, 101, 114, 32, 42, 47, 10, 32, 32, 32, 32, 32, 
+    32, 32, 32, 99, 97, 115, 101, 32, 48, 58, 32, 123, 10, 32, 32, 32, 32, 32, 32, 32, 
+    32, 32, 32, 32, 32, 47, 42, 32, 103, 114, 97, 100, 105, 101, 110, 116, 32, 97, 100, 106, 
+    117, 115, 116, 101, 100, 32, 102, 111, 114, 32, 115, 110, 111, 119, 32, 112, 111, 111, 108, 105, 
+    110, 103, 32, 40, 115, 97, 109, 112, 108, 101, 115, 32, 102, 117, 114, 116, 104, 101, 114, 32, 
+    97, 119, 97, 121, 41, 32, 42, 47, 10, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 
+    32, 102, 108, 111, 97, 116, 32, 115, 110, 111, 119, 95, 103, 114, 97, 100, 105, 101, 110, 116, 
+    32, 61, 32, 100, 101, 114, 105, 118, 101, 100, 46, 98, 59, 10, 10, 32, 32, 32, 32, 32, 
+    32, 32, 32, 32, 32, 32, 32, 47, 42, 32, 99, 97, 108, 99, 117, 108, 97, 116, 101, 32, 
+    99, 111, 108, 111, 114, 32, 42, 47, 10, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 
     32, 102, 108, 111, 97, 116, 32, 115, 110, 111, 119, 95, 97, 109, 111, 117, 110, 116, 32, 61, 
     32, 99, 108, 97, 109, 112, 40, 114, 101, 109, 97, 112, 40, 115, 110, 111, 119, 95, 112, 111, 
     111, 108, 105, 110, 103, 42, 115, 110, 111, 119, 95, 116, 104, 114, 101, 115, 104, 111, 108, 100, 
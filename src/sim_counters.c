@@ -0,0 +1,28 @@
+#include "sim_counters.h"
+#include "timer.h"
+
+void sim_counters_init(SimCounters *c)
+{
+    c->n_threads = parallel_n_threads();
+    if (c->n_threads > THREAD_POOL_MAX_THREADS) {
+        c->n_threads = THREAD_POOL_MAX_THREADS;
+    }
+    for (int t = 0; t < THREAD_POOL_MAX_THREADS; t++) {
+        atomic_init(&c->threads[t].n_particles, 0);
+        atomic_init(&c->threads[t].n_steps, 0);
+        atomic_init(&c->threads[t].busy_ns, 0);
+    }
+}
+
+void sim_counters_read(const SimCounters *c, SimCountersSample *sample)
+{
+    sample->time = timer_now();
+    sample->n_particles = 0;
+    sample->n_steps = 0;
+    for (int t = 0; t < c->n_threads; t++) {
+        const SimThreadCounters *tc = &c->threads[t];
+        sample->n_particles += atomic_load_explicit(&tc->n_particles, memory_order_relaxed);
+        sample->n_steps     += atomic_load_explicit(&tc->n_steps, memory_order_relaxed);
+        sample->busy_ns[t]   = atomic_load_explicit(&tc->busy_ns, memory_order_relaxed);
+    }
+}
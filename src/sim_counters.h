@@ -0,0 +1,63 @@
+#ifndef SIM_COUNTERS_H
+#define SIM_COUNTERS_H
+
+#include "thread_pool.h"
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+/*
+ * Counters of one simulation thread. Only written by the thread with that
+ * index, and aligned to a cache line so that threads don't share lines.
+ */
+typedef struct SimThreadCounters {
+    _Alignas(64) atomic_int_fast64_t n_particles;
+    atomic_int_fast64_t n_steps;
+    atomic_int_fast64_t busy_ns;            /* time spent simulating particles */
+} SimThreadCounters;
+
+/*
+ * Running totals of the particle simulation, readable by other threads
+ * (the UI) while a run is going. Counters are only ever incremented, with
+ * relaxed atomics, once per chunk of particles, so the simulation never
+ * waits for a reader and readers compute rates from differences between
+ * two reads.
+ */
+typedef struct SimCounters {
+    int n_threads;
+    SimThreadCounters threads[THREAD_POOL_MAX_THREADS];
+} SimCounters;
+
+/*
+ * Totals of `SimCounters` at one point in time.
+ */
+typedef struct SimCountersSample {
+    double time;                            /* seconds, from `timer_now` */
+    int64_t n_particles;
+    int64_t n_steps;
+    int64_t busy_ns[THREAD_POOL_MAX_THREADS];
+} SimCountersSample;
+
+/*
+ * Zeroes `c` for `parallel_n_threads()` threads.
+ */
+void sim_counters_init(SimCounters *c);
+
+/*
+ * Adds a finished chunk of `n_particles` particles that took `n_steps`
+ * steps and `busy` seconds to the counters of `thread`.
+ */
+static inline void sim_counters_add(SimCounters *c, int thread, int64_t n_particles, int64_t n_steps, double busy)
+{
+    SimThreadCounters *t = &c->threads[thread];
+    atomic_fetch_add_explicit(&t->n_particles, n_particles, memory_order_relaxed);
+    atomic_fetch_add_explicit(&t->n_steps, n_steps, memory_order_relaxed);
+    atomic_fetch_add_explicit(&t->busy_ns, (int64_t)(busy * 1e9), memory_order_relaxed);
+}
+
+/*
+ * Reads the current totals of `c` into `sample`.
+ */
+void sim_counters_read(const SimCounters *c, SimCountersSample *sample);
+
+#endif /* SIM_COUNTERS_H */
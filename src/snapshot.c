@@ -0,0 +1,146 @@
+#include "snapshot.h"
+#include "timer.h"
+#include "trace.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* the middle buffer holds a snapshot the reader hasn't seen yet */
+#define SNAPSHOT_FRESH 4
+#define SNAPSHOT_INDEX 3
+
+int snapshot_buffer_init(SnapshotBuffer *sb, int width, int height, float max_overhead)
+{
+    *sb = (SnapshotBuffer) {0};
+    sb->width   = width;
+    sb->height  = height;
+    sb->tiles_x = (width + SNAPSHOT_TILE_SIZE - 1) / SNAPSHOT_TILE_SIZE;
+    sb->tiles_y = (height + SNAPSHOT_TILE_SIZE - 1) / SNAPSHOT_TILE_SIZE;
+    sb->n_words = (sb->tiles_x * sb->tiles_y + 63) / 64;
+
+    bool ok = true;
+    for (int i = 0; i < 3; i++) {
+        sb->snapshots[i].hmap    = image_alloc(width, height);
+        sb->snapshots[i].changed = calloc(sb->n_words, sizeof(uint64_t));
+        sb->stale[i]             = calloc(sb->n_words, sizeof(uint64_t));
+        ok = ok && sb->snapshots[i].hmap.data != NULL && sb->snapshots[i].changed != NULL && sb->stale[i] != NULL;
+    }
+    sb->dirty = calloc(sb->n_words, sizeof(uint64_t));
+    sb->carry = calloc(sb->n_words, sizeof(uint64_t));
+    sb->delta = calloc(sb->n_words, sizeof(uint64_t));
+    if (!ok || sb->dirty == NULL || sb->carry == NULL || sb->delta == NULL) {
+        snapshot_buffer_free(sb);
+        return -1;
+    }
+
+    sb->back  = 0;
+    sb->front = 2;
+    atomic_init(&sb->middle, 1);
+    sb->max_overhead = max_overhead;
+    snapshot_mark_all(sb);
+    return 0;
+}
+
+void snapshot_buffer_free(SnapshotBuffer *sb)
+{
+    for (int i = 0; i < 3; i++) {
+        image_free(&sb->snapshots[i].hmap);
+        free(sb->snapshots[i].changed);
+        free(sb->stale[i]);
+    }
+    free((void *) sb->dirty);
+    free(sb->carry);
+    free(sb->delta);
+}
+
+void snapshot_mark_all(SnapshotBuffer *sb)
+{
+    snapshot_mark_dirty(sb, 0, 0, sb->width - 1, sb->height - 1);
+}
+
+/*
+ * Copies the tiles of `src` set in bitmap `tiles` to `dst`. Horizontal
+ * runs of tiles are copied together.
+ */
+static void copy_tiles(SnapshotBuffer *sb, ErodrImage *dst, ErodrImage *src, const uint64_t *tiles)
+{
+    for (int ty = 0; ty < sb->tiles_y; ty++) {
+        int y = ty * SNAPSHOT_TILE_SIZE;
+        int h = (y + SNAPSHOT_TILE_SIZE > sb->height) ? sb->height - y : SNAPSHOT_TILE_SIZE;
+        for (int tx = 0; tx < sb->tiles_x; tx++) {
+            if (!snapshot_tile_test(sb, tiles, tx, ty)) {
+                continue;
+            }
+            int tx_end = tx + 1;
+            while (tx_end < sb->tiles_x && snapshot_tile_test(sb, tiles, tx_end, ty)) {
+                tx_end++;
+            }
+            int x = tx * SNAPSHOT_TILE_SIZE;
+            int x_end = (tx_end * SNAPSHOT_TILE_SIZE > sb->width) ? sb->width : tx_end * SNAPSHOT_TILE_SIZE;
+            ErodrImage dst_view = image_view(dst, x, y, x_end - x, h);
+            ErodrImage src_view = image_view(src, x, y, x_end - x, h);
+            image_copy(&dst_view, &src_view);
+            tx = tx_end;
+        }
+    }
+}
+
+bool snapshot_publish(SnapshotBuffer *sb, ErodrImage *hmap, bool force)
+{
+    double t_start = timer_now();
+    if (!force) {
+        /* copying for `cost` every `interval` seconds takes `cost / (interval + cost)` of the time */
+        float f = sb->max_overhead;
+        if (f <= 0.0f || t_start - sb->last_publish < sb->publish_cost * (1.0f - f) / f) {
+            return false;
+        }
+    }
+
+    /* collect the tiles marked since the last publish */
+    double t_trace = trace_begin();
+    int n_tiles = 0;
+    for (int i = 0; i < sb->n_words; i++) {
+        uint64_t d = atomic_exchange_explicit(&sb->dirty[i], 0, memory_order_relaxed);
+        sb->delta[i] = d;
+        sb->carry[i] |= d;
+        for (int b = 0; b < 3; b++) {
+            sb->stale[b][i] |= d;
+        }
+        n_tiles += __builtin_popcountll(d);
+    }
+    if (n_tiles == 0) {
+        return false;
+    }
+
+    /* bring the back buffer up to date */
+    Snapshot *s = &sb->snapshots[sb->back];
+    copy_tiles(sb, &s->hmap, hmap, sb->stale[sb->back]);
+    memset(sb->stale[sb->back], 0, sb->n_words * sizeof(uint64_t));
+    memcpy(s->changed, sb->carry, sb->n_words * sizeof(uint64_t));
+    s->version = ++sb->next_version;
+
+    int prev = atomic_exchange_explicit(&sb->middle, sb->back | SNAPSHOT_FRESH, memory_order_acq_rel);
+    sb->back = prev & SNAPSHOT_INDEX;
+    if (!(prev & SNAPSHOT_FRESH)) {
+        /* the reader has taken the previous snapshot, so it has seen everything up to it */
+        memcpy(sb->carry, sb->delta, sb->n_words * sizeof(uint64_t));
+    }
+    trace_end_n("publish snapshot", "sim", t_trace, n_tiles);
+
+    double t_end = timer_now();
+    double cost = t_end - t_start;
+    sb->publish_cost = (sb->next_version == 1) ? cost : 0.75 * sb->publish_cost + 0.25 * cost;
+    sb->last_publish = t_end;
+    if (sb->notify != NULL) {
+        sb->notify(sb->notify_user);
+    }
+    return true;
+}
+
+const Snapshot *snapshot_acquire(SnapshotBuffer *sb)
+{
+    if (atomic_load_explicit(&sb->middle, memory_order_relaxed) & SNAPSHOT_FRESH) {
+        sb->front = atomic_exchange_explicit(&sb->middle, sb->front, memory_order_acq_rel) & SNAPSHOT_INDEX;
+    }
+    return &sb->snapshots[sb->front];
+}
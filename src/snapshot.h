@@ -0,0 +1,133 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "image.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+/* heightmaps are tracked in tiles of SNAPSHOT_TILE_SIZE x SNAPSHOT_TILE_SIZE pixels */
+#define SNAPSHOT_TILE_SHIFT 6
+#define SNAPSHOT_TILE_SIZE  (1 << SNAPSHOT_TILE_SHIFT)
+
+/*
+ * A published copy of the heightmap. `changed` is a bitmap (bit
+ * `ty * tiles_x + tx`) of the tiles that differ from the snapshot the
+ * reader acquired before this one.
+ */
+typedef struct Snapshot {
+    ErodrImage hmap;
+    uint64_t version;
+    uint64_t *changed;
+} Snapshot;
+
+/*
+ * Hands copies of a heightmap from the simulation (a single writer thread)
+ * to the UI (a single reader thread) without locks.
+ *
+ * The heightmap is copied into one of three buffers. The writer owns the
+ * back buffer, the reader owns the front buffer and the middle buffer is
+ * swapped atomically by both. A publish never waits for the reader and
+ * the reader always gets the newest complete snapshot, never a torn one.
+ *
+ * Whoever modifies the heightmap marks the modified tiles dirty (from any
+ * thread). A publish only copies the tiles that changed since the back
+ * buffer was last written, and tells the reader which tiles changed, so
+ * that neither side touches unchanged parts of the heightmap.
+ *
+ * Publishing still costs a copy of the dirty tiles, so `snapshot_publish`
+ * rate limits itself: it skips publishes that would push the time spent
+ * copying above `max_overhead` of the elapsed time.
+ *
+ * A reader that sleeps while nothing changes can set `notify` (before the
+ * writer starts publishing) to be woken after every publish.
+ */
+typedef struct SnapshotBuffer {
+    Snapshot snapshots[3];
+    _Atomic uint64_t *dirty;  /* tiles changed since the last publish */
+    uint64_t *stale[3];       /* tiles changed since each buffer was last written */
+    uint64_t *carry;          /* tiles changed since the last snapshot known to be acquired */
+    uint64_t *delta;          /* tiles of the current publish */
+    int width;
+    int height;
+    int tiles_x;
+    int tiles_y;
+    int n_words;
+    atomic_int middle;        /* index of the middle buffer | SNAPSHOT_FRESH */
+    int back;                 /* owned by the writer */
+    int front;                /* owned by the reader */
+    uint64_t next_version;
+    float max_overhead;       /* fraction of time the writer may spend publishing */
+    double publish_cost;      /* moving average of the copy time, in seconds */
+    double last_publish;
+    void (*notify)(void *user);   /* if set, called by the writer after every publish */
+    void *notify_user;
+} SnapshotBuffer;
+
+/*
+ * Allocates the buffers of `sb` for `width` x `height` heightmaps. All
+ * tiles start out dirty. Returns 0 on success.
+ */
+int snapshot_buffer_init(SnapshotBuffer *sb, int width, int height, float max_overhead);
+
+/*
+ * Frees the buffers of `sb`.
+ */
+void snapshot_buffer_free(SnapshotBuffer *sb);
+
+/*
+ * Marks the tiles overlapping pixels [x0, x1] x [y0, y1] dirty. The
+ * rectangle is clipped to the heightmap. Safe to call from any thread,
+ * and cheap for tiles that are already dirty.
+ */
+static inline void snapshot_mark_dirty(SnapshotBuffer *sb, int x0, int y0, int x1, int y1)
+{
+    x0 = (x0 < 0) ? 0 : x0;
+    y0 = (y0 < 0) ? 0 : y0;
+    x1 = (x1 >= sb->width) ? sb->width - 1 : x1;
+    y1 = (y1 >= sb->height) ? sb->height - 1 : y1;
+    for (int ty = y0 >> SNAPSHOT_TILE_SHIFT; ty <= y1 >> SNAPSHOT_TILE_SHIFT; ty++) {
+        for (int tx = x0 >> SNAPSHOT_TILE_SHIFT; tx <= x1 >> SNAPSHOT_TILE_SHIFT; tx++) {
+            int tile = ty * sb->tiles_x + tx;
+            uint64_t bit = (uint64_t) 1 << (tile & 63);
+            _Atomic uint64_t *word = &sb->dirty[tile >> 6];
+            if (!(atomic_load_explicit(word, memory_order_relaxed) & bit)) {
+                atomic_fetch_or_explicit(word, bit, memory_order_relaxed);
+            }
+        }
+    }
+}
+
+/*
+ * Marks the whole heightmap dirty.
+ */
+void snapshot_mark_all(SnapshotBuffer *sb);
+
+/*
+ * Returns true if tile (`tx`, `ty`) is set in tile bitmap `tiles`.
+ */
+static inline bool snapshot_tile_test(const SnapshotBuffer *sb, const uint64_t *tiles, int tx, int ty)
+{
+    int tile = ty * sb->tiles_x + tx;
+    return (tiles[tile >> 6] >> (tile & 63)) & 1;
+}
+
+/*
+ * Publishes the dirty tiles of `hmap`, which must have the dimensions
+ * `sb` was initialized with. Every modification of `hmap` since the last
+ * publish must have been marked dirty. Unless `force` is set, the publish
+ * is skipped if it would exceed the overhead budget (the dirty tiles are
+ * then published later). Returns true if a snapshot was published.
+ * Writer thread only.
+ */
+bool snapshot_publish(SnapshotBuffer *sb, ErodrImage *hmap, bool force);
+
+/*
+ * Returns the newest published snapshot (version 0 until the first
+ * publish). The snapshot stays valid until the next call. Reader thread
+ * only.
+ */
+const Snapshot *snapshot_acquire(SnapshotBuffer *sb);
+
+#endif /* SNAPSHOT_H */
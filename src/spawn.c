@@ -0,0 +1,231 @@
+#include "spawn.h"
+#include "log.h"
+#include "thread_pool.h"
+#include "mem.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+/*
+ * Turns the weights in `prob[0..n)` into an alias table (Vose's method).
+ * `work` is scratch space for `n` ints. The small and large worklists share
+ * `work`, growing from opposite ends.
+ */
+static void alias_build(float *prob, int *alias, int *work, int n, double sum)
+{
+    if (!(sum > 0.0)) {
+        for (int i = 0; i < n; i++) {
+            prob[i] = 1.0f;
+            alias[i] = i;
+        }
+        return;
+    }
+
+    int n_small = 0;
+    int n_large = 0;
+    for (int i = 0; i < n; i++) {
+        prob[i] = (float)(prob[i] * n / sum);
+        alias[i] = i;
+        if (prob[i] < 1.0f) {
+            work[n_small++] = i;
+        } else {
+            work[n - 1 - n_large++] = i;
+        }
+    }
+
+    while (n_small > 0 && n_large > 0) {
+        int s = work[--n_small];
+        int l = work[n - n_large--];
+        alias[s] = l;
+        prob[l] = (prob[l] + prob[s]) - 1.0f;
+        if (prob[l] < 1.0f) {
+            work[n_small++] = l;
+        } else {
+            work[n - 1 - n_large++] = l;
+        }
+    }
+
+    /* leftovers are (up to rounding errors) exactly 1 */
+    while (n_small > 0) prob[work[--n_small]] = 1.0f;
+    while (n_large > 0) prob[work[n - n_large--]] = 1.0f;
+}
+
+/*
+ * Returns the unnormalized spawn density of cell (x, y), i.e. the quad
+ * spanned by the pixels (x, y) and (x + 1, y + 1) of `hmap`.
+ */
+static inline float cell_density(ErodrImage *hmap, ErodrImage *density, SpawnMode mode, int x, int y)
+{
+    const float *row = &hmap->data[y * hmap->stride];
+    const float *row_below = &hmap->data[(y + 1) * hmap->stride];
+    switch (mode) {
+        case SPAWN_MODE_HEIGHT: {
+            return fmaxf(0.0f, 0.25f * (row[x] + row[x + 1] + row_below[x] + row_below[x + 1]));
+        }
+        case SPAWN_MODE_SLOPE: {
+            float gx = 0.5f * ((row[x + 1] - row[x]) + (row_below[x + 1] - row_below[x]));
+            float gy = 0.5f * ((row_below[x] - row[x]) + (row_below[x + 1] - row[x + 1]));
+            return sqrtf(gx*gx + gy*gy);
+        }
+        case SPAWN_MODE_MAP: {
+            int dx = MIN(density->width - 1, (int)(((float)x + 0.5f) * density->width / (hmap->width - 1)));
+            int dy = MIN(density->height - 1, (int)(((float)y + 0.5f) * density->height / (hmap->height - 1)));
+            return fmaxf(0.0f, density->data[dy * density->stride + dx]);
+        }
+        default: {
+            return 1.0f;
+        }
+    }
+}
+
+/*
+ * `parallel_for` context of the per-region alias table construction.
+ */
+typedef struct RegionBuildContext {
+    SpawnMap *sm;
+    ErodrImage *hmap;
+    ErodrImage *density;
+    SpawnMode mode;
+} RegionBuildContext;
+
+/*
+ * Evaluates the spawn density of regions [r_begin, r_end) and builds their
+ * alias tables.
+ */
+static void build_regions(void *arg, int64_t r_begin, int64_t r_end, int thread)
+{
+    (void) thread;
+    RegionBuildContext *ctx = (RegionBuildContext *) arg;
+    SpawnMap *sm = ctx->sm;
+    for (int r = (int) r_begin; r < r_end; r++) {
+        int x0 = (r % sm->regions_x) * sm->region_size;
+        int y0 = (r / sm->regions_x) * sm->region_size;
+        int rw = MIN(sm->region_size, sm->width - x0);
+        int rh = MIN(sm->region_size, sm->height - y0);
+        float *prob = &sm->cell_prob[sm->region_offset[r]];
+        int *alias = &sm->cell_alias[sm->region_offset[r]];
+        double sum = 0.0;
+        for (int y = 0; y < rh; y++) {
+            for (int x = 0; x < rw; x++) {
+                float d = cell_density(ctx->hmap, ctx->density, ctx->mode, x0 + x, y0 + y);
+                prob[y * rw + x] = d;
+                sum += d;
+            }
+        }
+        sm->mass[r] = sum;
+        alias_build(prob, alias, &sm->work[sm->region_offset[r]], rw * rh, sum);
+    }
+}
+
+int spawn_map_build(SpawnMap *sm, ErodrImage *hmap, ErodrImage *density, SimulationParameters *params)
+{
+    SpawnMode mode = params->spawn_mode;
+    if (mode == SPAWN_MODE_MAP && density == NULL) {
+        log_error("Error: spawn mode `map` requires a spawn density map.");
+        return -1;
+    }
+
+    int width         = hmap->width - 1;
+    int height        = hmap->height - 1;
+    int regions_x     = (params->spawn_regions > 0) ? MIN(params->spawn_regions, width) : 1;
+    int region_size   = (width + regions_x - 1) / regions_x;
+    regions_x         = (width + region_size - 1) / region_size;
+    int regions_y     = (height + region_size - 1) / region_size;
+
+    int n_regions     = regions_x * regions_y;
+    int n_cells       = width * height;
+    if (n_cells > sm->cell_capacity || n_regions > sm->region_capacity) {
+        spawn_map_free(sm);
+        /* the per-cell tables are sampled at random, so they get huge pages too */
+        sm->cell_capacity   = n_cells;
+        sm->region_capacity = n_regions;
+        sm->region_prob     = malloc(sizeof(float) * n_regions);
+        sm->region_alias    = malloc(sizeof(int) * n_regions);
+        sm->region_offset   = malloc(sizeof(int) * n_regions);
+        sm->mass            = malloc(sizeof(double) * n_regions);
+        sm->cell_prob       = mem_alloc(sizeof(float) * n_cells);
+        sm->cell_alias      = mem_alloc(sizeof(int) * n_cells);
+        sm->work            = mem_alloc(sizeof(int) * n_cells); /* n_regions <= n_cells */
+        if (sm->region_prob == NULL || sm->region_alias == NULL || sm->region_offset == NULL ||
+            sm->mass == NULL || sm->cell_prob == NULL || sm->cell_alias == NULL || sm->work == NULL) {
+            log_error("Error: could not allocate spawn map.");
+            spawn_map_free(sm);
+            return -1;
+        }
+    }
+    sm->width         = width;
+    sm->height        = height;
+    sm->region_size   = region_size;
+    sm->regions_x     = regions_x;
+    sm->regions_y     = regions_y;
+    int *work = sm->work;
+    double *mass = sm->mass;
+
+    /* regions are stored one after another in the cell tables */
+    int offset = 0;
+    for (int r = 0; r < n_regions; r++) {
+        int x0 = (r % sm->regions_x) * sm->region_size;
+        int y0 = (r / sm->regions_x) * sm->region_size;
+        sm->region_offset[r] = offset;
+        offset += MIN(sm->region_size, sm->width - x0) * MIN(sm->region_size, sm->height - y0);
+    }
+
+    /* evaluate density & build the alias table of every region in parallel */
+    RegionBuildContext ctx = {
+        .sm      = sm,
+        .hmap    = hmap,
+        .density = density,
+        .mode    = mode,
+    };
+    parallel_for(0, n_regions, 1, build_regions, &ctx);
+
+    /* region budgets: proportional to density mass, but never less than
+     * `spawn_region_floor` times the budget of a uniform distribution. */
+    double total = 0.0;
+    for (int r = 0; r < n_regions; r++) {
+        total += mass[r];
+    }
+    double min_share = fmin(fmax(params->spawn_region_floor, 0.0), 1.0);
+    double budget_sum = 0.0;
+    for (int r = 0; r < n_regions; r++) {
+        int n_region_cells = ((r + 1 < n_regions) ? sm->region_offset[r + 1] : n_cells) - sm->region_offset[r];
+        double uniform_share = (double)n_region_cells / n_cells;
+        double share = (total > 0.0) ? mass[r] / total : uniform_share;
+        sm->region_prob[r] = (float)((1.0 - min_share) * share + min_share * uniform_share);
+        budget_sum += sm->region_prob[r];
+    }
+    alias_build(sm->region_prob, sm->region_alias, work, n_regions, budget_sum);
+    return 0;
+}
+
+int spawn_mode_parse(const char *str, SpawnMode *mode)
+{
+    static const char *names[] = {
+        [SPAWN_MODE_UNIFORM] = "uniform",
+        [SPAWN_MODE_HEIGHT]  = "height",
+        [SPAWN_MODE_SLOPE]   = "slope",
+        [SPAWN_MODE_MAP]     = "map",
+    };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (strcmp(str, names[i]) == 0) {
+            *mode = (SpawnMode) i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+void spawn_map_free(SpawnMap *sm)
+{
+    free(sm->region_prob);
+    free(sm->region_alias);
+    free(sm->region_offset);
+    mem_free(sm->cell_prob, sizeof(float) * sm->cell_capacity);
+    mem_free(sm->cell_alias, sizeof(int) * sm->cell_capacity);
+    mem_free(sm->work, sizeof(int) * sm->cell_capacity);
+    free(sm->mass);
+    *sm = (SpawnMap) {0};
+}
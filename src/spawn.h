@@ -0,0 +1,81 @@
+#ifndef SPAWN_H
+#define SPAWN_H
+
+#include "image.h"
+#include "params.h"
+#include "vector.h"
+#include "rng.h"
+
+/*
+ * Importance sampler for particle spawn positions. The map is divided into
+ * square regions. A top level alias table picks a region according to its
+ * particle budget, and a per-region alias table picks a cell within the
+ * region according to the spawn density. Both draws are O(1).
+ */
+typedef struct SpawnMap {
+    int width;           /* number of spawn cells along x (hmap->width - 1) */
+    int height;          /* number of spawn cells along y (hmap->height - 1) */
+    int region_size;     /* side length of a region in cells */
+    int regions_x;
+    int regions_y;
+    float *region_prob;  /* alias table over regions */
+    int *region_alias;
+    int *region_offset;  /* index of first cell of each region in cell_* */
+    float *cell_prob;    /* per-region alias tables, stored region by region */
+    int *cell_alias;
+    int *work;           /* alias table construction scratch */
+    double *mass;        /* per-region density mass scratch */
+    int cell_capacity;   /* allocated size of the per-cell arrays */
+    int region_capacity; /* allocated size of the per-region arrays */
+} SpawnMap;
+
+/*
+ * Builds spawn map `sm` for heightmap `hmap` according to
+ * `params->spawn_mode`. `density` is only used for SPAWN_MODE_MAP and is
+ * resampled to the size of `hmap` if necessary. `sm` must be zeroed or
+ * hold a previously built map, whose buffers are reused if large enough.
+ * Returns 0 on success.
+ */
+int spawn_map_build(SpawnMap *sm, ErodrImage *hmap, ErodrImage *density, SimulationParameters *params);
+
+/*
+ * Parses spawn mode name `str` ("uniform", "height", "slope" or "map") into
+ * `mode`. Returns 0 on success.
+ */
+int spawn_mode_parse(const char *str, SpawnMode *mode);
+
+/*
+ * Frees spawn map `sm`.
+ */
+void spawn_map_free(SpawnMap *sm);
+
+/*
+ * Draws a spawn position from spawn map `sm`.
+ */
+static inline Vec2 spawn_map_sample(SpawnMap *sm, Rng *rng)
+{
+    int r = (int)rng_range(rng, (uint32_t)(sm->regions_x * sm->regions_y));
+    if (rng_float(rng) >= sm->region_prob[r]) {
+        r = sm->region_alias[r];
+    }
+
+    int rx = r % sm->regions_x;
+    int ry = r / sm->regions_x;
+    int x0 = rx * sm->region_size;
+    int y0 = ry * sm->region_size;
+    int rw = ((x0 + sm->region_size) < sm->width) ? sm->region_size : sm->width - x0;
+    int rh = ((y0 + sm->region_size) < sm->height) ? sm->region_size : sm->height - y0;
+
+    int offset = sm->region_offset[r];
+    int c = (int)rng_range(rng, (uint32_t)(rw * rh));
+    if (rng_float(rng) >= sm->cell_prob[offset + c]) {
+        c = sm->cell_alias[offset + c];
+    }
+
+    return (Vec2) {
+        .x = (float)(x0 + c % rw) + rng_float(rng) * 0.999f,
+        .y = (float)(y0 + c / rw) + rng_float(rng) * 0.999f,
+    };
+}
+
+#endif /* SPAWN_H */
@@ -0,0 +1,198 @@
+#include "terrain.h"
+
+#include "rlgl.h"
+
+#define RAYMATH_STATIC_INLINE
+#include "raymath.h"
+
+#include <math.h>
+
+/* patches closer than TERRAIN_LOD_DISTANCE times their size are subdivided */
+#define TERRAIN_LOD_DISTANCE 2.0f
+#define TERRAIN_MAX_DEPTH    10
+
+#define PATCH_RES (TERRAIN_PATCH_QUADS + 1)
+
+typedef struct Frustum {
+    Vector4 planes[6];   /* (normal, distance), pointing inwards */
+} Frustum;
+
+/*
+ * Extracts the view frustum planes from the current modelview and
+ * projection matrices.
+ */
+static Frustum frustum_get(void)
+{
+    Matrix m = MatrixMultiply(rlGetMatrixModelview(), rlGetMatrixProjection());
+    Frustum f = {
+        .planes = {
+            {m.m3 + m.m0, m.m7 + m.m4, m.m11 + m.m8,  m.m15 + m.m12},   /* left */
+            {m.m3 - m.m0, m.m7 - m.m4, m.m11 - m.m8,  m.m15 - m.m12},   /* right */
+            {m.m3 + m.m1, m.m7 + m.m5, m.m11 + m.m9,  m.m15 + m.m13},   /* bottom */
+            {m.m3 - m.m1, m.m7 - m.m5, m.m11 - m.m9,  m.m15 - m.m13},   /* top */
+            {m.m3 + m.m2, m.m7 + m.m6, m.m11 + m.m10, m.m15 + m.m14},   /* near */
+            {m.m3 - m.m2, m.m7 - m.m6, m.m11 - m.m10, m.m15 - m.m14},   /* far */
+        },
+    };
+    return f;
+}
+
+/*
+ * Returns false if box [`min`, `max`] lies completely outside frustum `f`.
+ */
+static bool frustum_test_box(const Frustum *f, Vector3 min, Vector3 max)
+{
+    for (int i = 0; i < 6; i++) {
+        Vector4 p = f->planes[i];
+        /* corner furthest along the plane normal */
+        Vector3 c = {
+            (p.x >= 0.0f) ? max.x : min.x,
+            (p.y >= 0.0f) ? max.y : min.y,
+            (p.z >= 0.0f) ? max.z : min.z,
+        };
+        if (p.x * c.x + p.y * c.y + p.z * c.z + p.w < 0.0f) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Generates the unit patch: a grid over [0, 1] x [0, 1] in the xz-plane at
+ * y = 0, plus a skirt of vertices at y = -1 below each edge. The vertex
+ * shader moves skirt vertices down by the skirt depth.
+ */
+static Mesh gen_patch_mesh(void)
+{
+    const int n_grid = PATCH_RES * PATCH_RES;
+    const int n_quads = TERRAIN_PATCH_QUADS * TERRAIN_PATCH_QUADS + 4 * TERRAIN_PATCH_QUADS;
+    Mesh mesh = {0};
+    mesh.vertexCount   = n_grid + 4 * PATCH_RES;
+    mesh.triangleCount = 2 * n_quads;
+    mesh.vertices  = MemAlloc(mesh.vertexCount * 3 * sizeof(float));
+    mesh.texcoords = MemAlloc(mesh.vertexCount * 2 * sizeof(float));
+    mesh.indices   = MemAlloc(mesh.triangleCount * 3 * sizeof(unsigned short));
+
+    /* grid */
+    for (int z = 0; z < PATCH_RES; z++) {
+        for (int x = 0; x < PATCH_RES; x++) {
+            int i = z * PATCH_RES + x;
+            float u = (float) x / TERRAIN_PATCH_QUADS;
+            float v = (float) z / TERRAIN_PATCH_QUADS;
+            mesh.vertices[3*i + 0] = u;
+            mesh.vertices[3*i + 1] = 0.0f;
+            mesh.vertices[3*i + 2] = v;
+            mesh.texcoords[2*i + 0] = u;
+            mesh.texcoords[2*i + 1] = v;
+        }
+    }
+    int t = 0;
+    for (int z = 0; z < TERRAIN_PATCH_QUADS; z++) {
+        for (int x = 0; x < TERRAIN_PATCH_QUADS; x++) {
+            int i = z * PATCH_RES + x;
+            mesh.indices[t++] = i + PATCH_RES;
+            mesh.indices[t++] = i + 1;
+            mesh.indices[t++] = i;
+            mesh.indices[t++] = i + PATCH_RES;
+            mesh.indices[t++] = i + PATCH_RES + 1;
+            mesh.indices[t++] = i + 1;
+        }
+    }
+
+    /* skirts along the edges z = 0, z = 1, x = 0 and x = 1 */
+    for (int edge = 0; edge < 4; edge++) {
+        int first = n_grid + edge * PATCH_RES;
+        for (int k = 0; k < PATCH_RES; k++) {
+            int on_edge;
+            switch (edge) {
+                case 0:  on_edge = k; break;
+                case 1:  on_edge = (PATCH_RES - 1) * PATCH_RES + k; break;
+                case 2:  on_edge = k * PATCH_RES; break;
+                default: on_edge = k * PATCH_RES + PATCH_RES - 1; break;
+            }
+            int i = first + k;
+            mesh.vertices[3*i + 0] = mesh.vertices[3*on_edge + 0];
+            mesh.vertices[3*i + 1] = -1.0f;
+            mesh.vertices[3*i + 2] = mesh.vertices[3*on_edge + 2];
+            mesh.texcoords[2*i + 0] = mesh.texcoords[2*on_edge + 0];
+            mesh.texcoords[2*i + 1] = mesh.texcoords[2*on_edge + 1];
+            if (k > 0) {
+                int a = (edge < 2) ? on_edge - 1 : on_edge - PATCH_RES;
+                mesh.indices[t++] = a;
+                mesh.indices[t++] = on_edge;
+                mesh.indices[t++] = i;
+                mesh.indices[t++] = a;
+                mesh.indices[t++] = i;
+                mesh.indices[t++] = i - 1;
+            }
+        }
+    }
+
+    UploadMesh(&mesh, false);
+    return mesh;
+}
+
+void terrain_init(TerrainRenderer *t, Material *material, float size, int hmap_width, int hmap_height)
+{
+    *t = (TerrainRenderer) {0};
+    t->patch     = gen_patch_mesh();
+    t->material  = material;
+    t->patch_loc = GetShaderLocation(material->shader, "patch_rect");
+    t->skirt_loc = GetShaderLocation(material->shader, "skirt_depth");
+    t->size      = size;
+
+    /* deep enough for one grid cell per heightmap pixel */
+    int resolution = (hmap_width > hmap_height) ? hmap_width : hmap_height;
+    while (t->max_depth < TERRAIN_MAX_DEPTH && (TERRAIN_PATCH_QUADS << t->max_depth) < resolution) {
+        t->max_depth++;
+    }
+}
+
+/*
+ * Draws the patch covering uv rectangle [`u0`, `u0` + `uv_size`] x [`v0`,
+ * `v0` + `uv_size`], or its children if the camera is close enough.
+ */
+static void draw_node(TerrainRenderer *t, const Frustum *f, Vector3 eye, Vector3 origin,
+                      float terrain_height, float u0, float v0, float uv_size, int depth)
+{
+    float world_size = uv_size * t->size;
+    Vector3 min = {origin.x + (u0 - 0.5f) * t->size, origin.y + fminf(terrain_height, 0.0f), origin.z + (v0 - 0.5f) * t->size};
+    Vector3 max = {min.x + world_size, origin.y + fmaxf(terrain_height, 0.0f), min.z + world_size};
+    if (!frustum_test_box(f, min, max)) {
+        return;
+    }
+
+    /* distance from the camera to the closest point of the patch */
+    Vector3 closest = Vector3Clamp(eye, min, max);
+    if (depth < t->max_depth && Vector3Distance(eye, closest) < TERRAIN_LOD_DISTANCE * world_size) {
+        float half = uv_size / 2.0f;
+        draw_node(t, f, eye, origin, terrain_height, u0,        v0,        half, depth + 1);
+        draw_node(t, f, eye, origin, terrain_height, u0 + half, v0,        half, depth + 1);
+        draw_node(t, f, eye, origin, terrain_height, u0,        v0 + half, half, depth + 1);
+        draw_node(t, f, eye, origin, terrain_height, u0 + half, v0 + half, half, depth + 1);
+        return;
+    }
+
+    /* skirts must cover the height error between neighbouring detail levels */
+    Vector3 patch = {u0, v0, uv_size};
+    float skirt_depth = fabsf(terrain_height) * uv_size + 0.01f;
+    SetShaderValue(t->material->shader, t->patch_loc, &patch, SHADER_UNIFORM_VEC3);
+    SetShaderValue(t->material->shader, t->skirt_loc, &skirt_depth, SHADER_UNIFORM_FLOAT);
+    Matrix transform = MatrixMultiply(MatrixScale(world_size, 1.0f, world_size), MatrixTranslate(min.x, origin.y, min.z));
+    DrawMesh(t->patch, *t->material, transform);
+    t->n_drawn++;
+}
+
+void terrain_draw(TerrainRenderer *t, Camera camera, Vector3 origin, float terrain_height)
+{
+    Frustum f = frustum_get();
+    t->n_drawn = 0;
+    rlDisableBackfaceCulling(); /* skirts are seen from both sides */
+    draw_node(t, &f, camera.position, origin, terrain_height, 0.0f, 0.0f, 1.0f, 0);
+    rlEnableBackfaceCulling();
+}
+
+void terrain_free(TerrainRenderer *t)
+{
+    UnloadMesh(t->patch);
+}
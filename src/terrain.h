@@ -0,0 +1,49 @@
+#ifndef TERRAIN_H
+#define TERRAIN_H
+
+#include "raylib.h"
+
+/*
+ * Level of detail terrain rendering for the UI.
+ *
+ * The terrain is a quadtree of square patches. Every patch is drawn with
+ * the same grid mesh of (TERRAIN_PATCH_QUADS + 1)^2 vertices (well below
+ * raylib's 16-bit index limit), scaled to the size of the patch and
+ * displaced by the heightmap texture in the vertex shader. Patches close
+ * to the camera are subdivided until a grid cell covers a single pixel of
+ * the heightmap, patches outside the view frustum are skipped. Each patch
+ * has a skirt hanging down from its edges, which hides the cracks between
+ * neighbouring patches of different detail levels.
+ */
+
+#define TERRAIN_PATCH_QUADS 64
+
+typedef struct TerrainRenderer {
+    Mesh patch;          /* unit grid with skirts, shared by all patches */
+    Material *material;  /* heightmap shader & texture */
+    int patch_loc;       /* shader location of the patch uv rectangle */
+    int skirt_loc;       /* shader location of the skirt depth */
+    int max_depth;       /* quadtree depth at which patches reach full resolution */
+    float size;          /* world size of the terrain */
+    int n_drawn;         /* patches drawn by the last `terrain_draw` */
+} TerrainRenderer;
+
+/*
+ * Prepares rendering of a `hmap_width` x `hmap_height` heightmap as a
+ * terrain of `size` x `size` world units with `material`, whose shader
+ * must be the heightmap shader. `material` must outlive `t`.
+ */
+void terrain_init(TerrainRenderer *t, Material *material, float size, int hmap_width, int hmap_height);
+
+/*
+ * Draws the terrain centered at `origin`, as seen from `camera`. Must be
+ * called in 3D mode (between `BeginMode3D` and `EndMode3D`).
+ */
+void terrain_draw(TerrainRenderer *t, Camera camera, Vector3 origin, float terrain_height);
+
+/*
+ * Frees the patch mesh of `t`.
+ */
+void terrain_free(TerrainRenderer *t);
+
+#endif /* TERRAIN_H */
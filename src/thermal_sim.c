@@ -0,0 +1,275 @@
+#include "thermal_sim.h"
+#include "log.h"
+#include "thread_pool.h"
+#include "write_mask.h"
+
+#include <math.h>
+#include <assert.h>
+
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+/* A band of rows is the unit of work handed to a thread. Within a band the
+ * stencil walks column blocks so that the three source rows touched by a
+ * block stay resident in L1/L2 for wide maps. */
+#define THERMAL_BAND_ROWS   32
+#define THERMAL_BLOCK_COLS 512
+
+#define SQRT_2 1.41421356f
+
+/*
+ * Signed amount of material exchanged across a height difference `d` with
+ * talus threshold `t`. Positive when material flows into the cell.
+ */
+static inline float slip(float d, float t)
+{
+    return copysignf(fmaxf(0.0f, fabsf(d) - t), d);
+}
+
+/*
+ * Returns the net inflow into cell `x` of `row` from its 8 neighbours in
+ * `row_above`, `row` and `row_below`, at columns `xl`, `x` and `xr`.
+ * Neighbours whose `has_*` flag is false are outside the map and read as
+ * the height of the cell, so nothing flows across the map edges. The flags
+ * are constant in the interior and compile away there.
+ */
+static inline float thermal_inflow(const float *row_above, const float *row, const float *row_below,
+                                   int x, int xl, int xr, bool has_a, bool has_b, bool has_l, bool has_r,
+                                   float talus, float talus_diag)
+{
+    float h  = row[x];
+    float l  = has_l ? row[xl] : h;
+    float r  = has_r ? row[xr] : h;
+    float a  = has_a ? row_above[x] : h;
+    float b  = has_b ? row_below[x] : h;
+    float al = has_a && has_l ? row_above[xl] : h;
+    float ar = has_a && has_r ? row_above[xr] : h;
+    float bl = has_b && has_l ? row_below[xl] : h;
+    float br = has_b && has_r ? row_below[xr] : h;
+    return slip(l - h, talus) +
+           slip(r - h, talus) +
+           slip(a - h, talus) +
+           slip(b - h, talus) +
+           slip(al - h, talus_diag) +
+           slip(ar - h, talus_diag) +
+           slip(bl - h, talus_diag) +
+           slip(br - h, talus_diag);
+}
+
+/*
+ * Applies one iteration of the thermal erosion stencil to rows [y0, y1)
+ * of `src`, writing the result to `dst`. Neighbours outside the map are
+ * treated as having the same height as the center cell (i.e. no flow), or
+ * with `wrap` are taken from the opposite edge.
+ */
+static inline void thermal_band(float *dst, const float *src, int width, int height,
+                                int y0, int y1, float talus, float k, bool wrap)
+{
+    const float talus_diag = talus * SQRT_2;
+    for (int bx = 0; bx < width; bx += THERMAL_BLOCK_COLS) {
+        int bx_end = MIN(width, bx + THERMAL_BLOCK_COLS);
+        for (int y = y0; y < y1; y++) {
+            int ya = wrap ? (y + height - 1) % height : MAX(y - 1, 0);
+            int yb = wrap ? (y + 1) % height : MIN(y + 1, height - 1);
+            bool has_a = wrap || y > 0;
+            bool has_b = wrap || y < height - 1;
+            const float *row_above = &src[ya * width];
+            const float *row       = &src[y * width];
+            const float *row_below = &src[yb * width];
+            if (wrap || (has_a && has_b)) {
+                /* interior row: only the first and last column can miss neighbours */
+                int x0 = MAX(bx, 1);
+                int x1 = MIN(bx_end, width - 1);
+                if (bx == 0) {
+                    int xl = wrap ? width - 1 : 0;
+                    float f = thermal_inflow(row_above, row, row_below, 0, xl, MIN(1, width - 1),
+                                             true, true, wrap, width > 1, talus, talus_diag);
+                    dst[y * width] = row[0] + k * f;
+                }
+                for (int x = x0; x < x1; x++) {
+                    float f = thermal_inflow(row_above, row, row_below, x, x - 1, x + 1,
+                                             true, true, true, true, talus, talus_diag);
+                    dst[y * width + x] = row[x] + k * f;
+                }
+                if (bx_end == width && width > 1) {
+                    int x = width - 1;
+                    int xr = wrap ? 0 : x;
+                    float f = thermal_inflow(row_above, row, row_below, x, x - 1, xr,
+                                             true, true, true, wrap, talus, talus_diag);
+                    dst[y * width + x] = row[x] + k * f;
+                }
+            } else {
+                for (int x = bx; x < bx_end; x++) {
+                    int xl = x - (x > 0);
+                    int xr = x + (x < width - 1);
+                    float f = thermal_inflow(row_above, row, row_below, x, xl, xr,
+                                             has_a, has_b, x > 0, x < width - 1, talus, talus_diag);
+                    dst[y * width + x] = row[x] + k * f;
+                }
+            }
+        }
+    }
+}
+
+/*
+ * `parallel_for` context of one thermal erosion iteration.
+ */
+typedef struct ThermalContext {
+    float *dst;
+    const float *src;
+    int width;
+    int height;
+    float talus;
+    float k;
+    bool wrap;
+    const atomic_bool *cancel;  /* remaining bands are skipped once set */
+} ThermalContext;
+
+static void thermal_bands(void *arg, int64_t band_begin, int64_t band_end, int thread)
+{
+    (void) thread;
+    ThermalContext *ctx = (ThermalContext *) arg;
+    for (int64_t band = band_begin; band < band_end; band++) {
+        if (ctx->cancel != NULL && atomic_load_explicit(ctx->cancel, memory_order_relaxed)) {
+            return;
+        }
+        int y0 = (int) band * THERMAL_BAND_ROWS;
+        int y1 = MIN(ctx->height, y0 + THERMAL_BAND_ROWS);
+        if (ctx->wrap) {
+            thermal_band(ctx->dst, ctx->src, ctx->width, ctx->height, y0, y1, ctx->talus, ctx->k, true);
+        } else {
+            thermal_band(ctx->dst, ctx->src, ctx->width, ctx->height, y0, y1, ctx->talus, ctx->k, false);
+        }
+    }
+}
+
+/*
+ * Runs `iterations` iterations of thermal erosion on the contiguous image
+ * `img`, using `scratch` (of the same size) as the second buffer. Returns
+ * false if cancelled, leaving the last full iteration in `img`.
+ */
+static bool thermal_iterate(ErodrImage *img, ErodrImage *scratch, int iterations, float talus, float k,
+                            bool wrap, const atomic_bool *cancel)
+{
+    const int n_bands = (img->height + THERMAL_BAND_ROWS - 1) / THERMAL_BAND_ROWS;
+    float *src = img->data;
+    float *dst = scratch->data;
+
+    bool completed = true;
+    for (int i = 0; i < iterations; i++) {
+        ThermalContext ctx = {
+            .dst    = dst,
+            .src    = src,
+            .width  = img->width,
+            .height = img->height,
+            .talus  = talus,
+            .k      = k,
+            .wrap   = wrap,
+            .cancel = cancel,
+        };
+        parallel_for(0, n_bands, 1, thermal_bands, &ctx);
+        if (cancel != NULL && atomic_load_explicit(cancel, memory_order_relaxed)) {
+            /* `dst` may be partially updated, keep the last full iteration */
+            completed = false;
+            break;
+        }
+        float *tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+
+    /* make sure the result ends up in `img`. */
+    if (src != img->data) {
+        image_copy(img, scratch);
+    }
+    return completed;
+}
+
+/*
+ * Runs thermal erosion simulation. With a region of interest, the
+ * iterations run on a copy of the region, its feathered border and a halo
+ * of one pixel per iteration (the reach of the stencil), so the weighted
+ * part of the copy erodes exactly like the full map would. The copy is then
+ * blended back with the write mask of the particle simulation. In wrap mode
+ * the halo may cross the map edges, so the whole map is copied.
+ */
+bool thermal_sim_run(ErodrImage *hmap, SimulationParameters *params, Workspace *ws, const atomic_bool *cancel)
+{
+    if (params->thermal_iterations <= 0) {
+        return true;
+    }
+    assert(hmap->stride == hmap->width);
+
+    Workspace local_ws = {0};
+    if (ws == NULL) {
+        ws = &local_ws;
+    }
+
+    WriteMask mask;
+    bool roi = write_mask_init(&mask, params, hmap->width, hmap->height);
+    int view_x0 = 0;
+    int view_y0 = 0;
+    int view_x1 = hmap->width;
+    int view_y1 = hmap->height;
+    if (roi && !params->wrap) {
+        int halo = (int) ceilf(MAX(params->roi_feather, 0.0f)) + params->thermal_iterations + 1;
+        view_x0 = MAX(mask.x0 - halo, 0);
+        view_y0 = MAX(mask.y0 - halo, 0);
+        view_x1 = MIN(mask.x1 + halo, hmap->width);
+        view_y1 = MIN(mask.y1 + halo, hmap->height);
+    }
+    int view_w = view_x1 - view_x0;
+    int view_h = view_y1 - view_y0;
+
+    /* double buffer: every iteration reads `src` and writes `dst`. */
+    ErodrImage *img = hmap;
+    if (roi) {
+        img = workspace_image(ws, WORKSPACE_SLOT_THERMAL_ROI, view_w, view_h);
+    }
+    ErodrImage *scratch = workspace_image(ws, WORKSPACE_SLOT_THERMAL, view_w, view_h);
+    if (img == NULL || scratch == NULL) {
+        log_error("Error: could not allocate thermal erosion buffer.");
+        if (ws == &local_ws) {
+            workspace_free(&local_ws);
+        }
+        return true;
+    }
+    if (roi) {
+        ErodrImage view = image_view(hmap, view_x0, view_y0, view_w, view_h);
+        image_copy(img, &view);
+    }
+
+    /* Each cell exchanges material with 8 neighbours. Scaling the rate by
+     * 1/16 keeps the explicit update stable for `thermal_rate` <= 1. */
+    const float k = params->thermal_rate / 16.0f;
+    const float talus = params->thermal_talus;
+
+    if (roi) {
+        log_info("Starting thermal erosion (%d iterations) of region %dx%d at (%d, %d).",
+                 params->thermal_iterations, mask.x1 - mask.x0, mask.y1 - mask.y0, mask.x0, mask.y0);
+    } else {
+        log_info("Starting thermal erosion (%d iterations).", params->thermal_iterations);
+    }
+    bool completed = thermal_iterate(img, scratch, params->thermal_iterations, talus, k,
+                                     params->wrap != 0, cancel);
+
+    /* blend the eroded region back, weighted like the particle writes */
+    if (roi) {
+        for (int y = 0; y < view_h; y++) {
+            float *dst = &hmap->data[(view_y0 + y) * hmap->stride + view_x0];
+            const float *src = &img->data[y * img->stride];
+            for (int x = 0; x < view_w; x++) {
+                float w = write_mask_weight(&mask, view_x0 + x, view_y0 + y);
+                if (w > 0.0f) {
+                    dst[x] += w * (src[x] - dst[x]);
+                }
+            }
+        }
+    }
+
+    if (ws == &local_ws) {
+        workspace_free(&local_ws);
+    }
+    log_info("Thermal erosion %s.", completed ? "finished" : "cancelled");
+    return completed;
+}
@@ -0,0 +1,22 @@
+#ifndef THERMAL_SIM_H
+#define THERMAL_SIM_H
+
+#include "image.h"
+#include "params.h"
+#include "workspace.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+/*
+ * Runs `params->thermal_iterations` iterations of thermal erosion (talus
+ * slippage) on heightmap `hmap`. Material moves from a cell to each of its
+ * 8 neighbours wherever the height difference exceeds `params->thermal_talus`
+ * per unit of distance. Scratch buffers are taken from `ws` (may be NULL).
+ * If `cancel` is set (may be NULL), the run stops as soon as it becomes
+ * true, leaving the result of the last full iteration in `hmap`. Returns
+ * false if cancelled.
+ */
+bool thermal_sim_run(ErodrImage *hmap, SimulationParameters *params, Workspace *ws, const atomic_bool *cancel);
+
+#endif /* THERMAL_SIM_H */
@@ -0,0 +1,305 @@
+#undef _GNU_SOURCE // gets rid of vim warning
+#define _GNU_SOURCE
+
+#include "thread_pool.h"
+#include "numa.h"
+#include "trace.h"
+
+#include <stdlib.h>
+#include <stdatomic.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+#define THREAD_POOL_INITIAL_QUEUE_CAPACITY 64
+
+/* index of the calling thread in `parallel_for` (0 for non-worker threads) */
+static _Thread_local int current_thread = 0;
+
+/* set while the calling thread runs a `parallel_for` chunk */
+static _Thread_local bool in_parallel = false;
+
+/* pin the threads of the global pool to CPUs as they start */
+static bool pin_threads = false;
+
+static ThreadPool global_pool;
+static pthread_once_t global_pool_once = PTHREAD_ONCE_INIT;
+
+typedef struct WorkerArgs {
+    ThreadPool *pool;
+    int index;
+} WorkerArgs;
+
+/*
+ * State of a `parallel_for` running on the pool.
+ */
+typedef struct ParallelJob {
+    ParallelForFn fn;
+    void *ctx;
+    int64_t begin;
+    int64_t end;
+    int64_t grain;
+    int64_t n_chunks;
+    atomic_int_fast64_t next_chunk;
+} ParallelJob;
+
+static int cpu_count(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int) info.dwNumberOfProcessors;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return (n > 0) ? (int) n : 1;
+#endif
+}
+
+static void *thread_pool_worker(void *arg)
+{
+    WorkerArgs args = *(WorkerArgs *) arg;
+    free(arg);
+    ThreadPool *pool = args.pool;
+    current_thread = args.index;
+    trace_set_thread_name("pool worker");
+    if (pin_threads && pool == &global_pool) {
+        numa_pin_thread(args.index);
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    while (true) {
+        while (pool->queue_count == 0 && !pool->quit) {
+            pthread_cond_wait(&pool->work_cvar, &pool->mutex);
+        }
+        if (pool->queue_count == 0) {
+            break; /* quit */
+        }
+        Task task = pool->queue[pool->queue_head];
+        pool->queue_head = (pool->queue_head + 1) % pool->queue_capacity;
+        pool->queue_count--;
+        pthread_mutex_unlock(&pool->mutex);
+
+        task.fn(task.arg);
+
+        pthread_mutex_lock(&pool->mutex);
+        if (task.group != NULL && --task.group->pending == 0) {
+            pthread_cond_broadcast(&pool->done_cvar);
+        }
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return NULL;
+}
+
+int thread_pool_init(ThreadPool *pool, int n_threads)
+{
+    *pool = (ThreadPool) {0};
+    pool->queue = malloc(sizeof(Task) * THREAD_POOL_INITIAL_QUEUE_CAPACITY);
+    pool->threads = malloc(sizeof(pthread_t) * (n_threads > 0 ? n_threads : 1));
+    if (pool->queue == NULL || pool->threads == NULL) {
+        free(pool->queue);
+        free(pool->threads);
+        return -1;
+    }
+    pool->queue_capacity = THREAD_POOL_INITIAL_QUEUE_CAPACITY;
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->work_cvar, NULL);
+    pthread_cond_init(&pool->done_cvar, NULL);
+
+    for (int i = 0; i < n_threads; i++) {
+        WorkerArgs *args = malloc(sizeof(WorkerArgs));
+        if (args == NULL) {
+            break;
+        }
+        /* worker threads have indices 1..n, the caller of parallel_for is 0 */
+        *args = (WorkerArgs) {.pool = pool, .index = i + 1};
+        if (pthread_create(&pool->threads[i], NULL, thread_pool_worker, args) != 0) {
+            free(args);
+            break;
+        }
+        pool->n_threads++;
+    }
+    return 0;
+}
+
+void thread_pool_destroy(ThreadPool *pool)
+{
+    pthread_mutex_lock(&pool->mutex);
+    pool->quit = true;
+    pthread_cond_broadcast(&pool->work_cvar);
+    pthread_mutex_unlock(&pool->mutex);
+    for (int i = 0; i < pool->n_threads; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_cond_destroy(&pool->work_cvar);
+    pthread_cond_destroy(&pool->done_cvar);
+    free(pool->threads);
+    free(pool->queue);
+    *pool = (ThreadPool) {0};
+}
+
+void thread_pool_submit(ThreadPool *pool, TaskFn fn, void *arg, TaskGroup *group)
+{
+    pthread_mutex_lock(&pool->mutex);
+    if (pool->n_threads == 0) {
+        pthread_mutex_unlock(&pool->mutex);
+        fn(arg);
+        return;
+    }
+    if (pool->queue_count == pool->queue_capacity) {
+        /* grow the ring buffer, unwrapping it in the process */
+        Task *queue = malloc(sizeof(Task) * pool->queue_capacity * 2);
+        if (queue == NULL) {
+            pthread_mutex_unlock(&pool->mutex);
+            fn(arg);
+            return;
+        }
+        for (int i = 0; i < pool->queue_count; i++) {
+            queue[i] = pool->queue[(pool->queue_head + i) % pool->queue_capacity];
+        }
+        free(pool->queue);
+        pool->queue = queue;
+        pool->queue_head = 0;
+        pool->queue_capacity *= 2;
+    }
+    int tail = (pool->queue_head + pool->queue_count) % pool->queue_capacity;
+    pool->queue[tail] = (Task) {.fn = fn, .arg = arg, .group = group};
+    pool->queue_count++;
+    if (group != NULL) {
+        group->pending++;
+    }
+    pthread_cond_signal(&pool->work_cvar);
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+void thread_pool_wait(ThreadPool *pool, TaskGroup *group)
+{
+    pthread_mutex_lock(&pool->mutex);
+    while (group->pending > 0) {
+        pthread_cond_wait(&pool->done_cvar, &pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+static void thread_pool_global_init(void)
+{
+    int n_threads = cpu_count();
+    const char *env = getenv("ERODR_NUM_THREADS");
+    if (env != NULL && atoi(env) > 0) {
+        n_threads = atoi(env);
+    }
+    n_threads = MIN(n_threads, THREAD_POOL_MAX_THREADS);
+    thread_pool_init(&global_pool, n_threads - 1);
+}
+
+ThreadPool *thread_pool_global(void)
+{
+    pthread_once(&global_pool_once, thread_pool_global_init);
+    return &global_pool;
+}
+
+int parallel_n_threads(void)
+{
+#ifdef _OPENMP
+    return MIN(omp_get_max_threads(), THREAD_POOL_MAX_THREADS);
+#else
+    return thread_pool_global()->n_threads + 1;
+#endif
+}
+
+void parallel_pin_threads(void)
+{
+    numa_pin_thread(0);
+#ifdef _OPENMP
+    /* OpenMP keeps the same threads for teams of the same size */
+    #pragma omp parallel num_threads(parallel_n_threads())
+    numa_pin_thread(omp_get_thread_num());
+#else
+    pin_threads = true;
+#endif
+}
+
+#ifndef _OPENMP
+static void parallel_job_run(ParallelJob *job)
+{
+    int thread = current_thread;
+    bool was_in_parallel = in_parallel;
+    in_parallel = true;
+    while (true) {
+        int64_t chunk = atomic_fetch_add(&job->next_chunk, 1);
+        if (chunk >= job->n_chunks) {
+            break;
+        }
+        int64_t begin = job->begin + chunk * job->grain;
+        job->fn(job->ctx, begin, MIN(begin + job->grain, job->end), thread);
+    }
+    in_parallel = was_in_parallel;
+}
+
+static void parallel_job_task(void *arg)
+{
+    parallel_job_run((ParallelJob *) arg);
+}
+#endif
+
+void parallel_for(int64_t begin, int64_t end, int64_t grain, ParallelForFn fn, void *ctx)
+{
+    if (end <= begin) {
+        return;
+    }
+    if (in_parallel) {
+        fn(ctx, begin, end, current_thread);
+        return;
+    }
+
+    int n_threads = parallel_n_threads();
+    if (grain <= 0) {
+        grain = (end - begin + n_threads - 1) / n_threads;
+    }
+    int64_t n_chunks = (end - begin + grain - 1) / grain;
+
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic) num_threads(n_threads)
+    for (int64_t chunk = 0; chunk < n_chunks; chunk++) {
+        int64_t chunk_begin = begin + chunk * grain;
+        in_parallel = true;
+        fn(ctx, chunk_begin, MIN(chunk_begin + grain, end), omp_get_thread_num());
+        in_parallel = false;
+    }
+#else
+    if (n_chunks == 1 || n_threads == 1) {
+        in_parallel = true;
+        fn(ctx, begin, end, current_thread);
+        in_parallel = false;
+        return;
+    }
+
+    ParallelJob job = {
+        .fn       = fn,
+        .ctx      = ctx,
+        .begin    = begin,
+        .end      = end,
+        .grain    = grain,
+        .n_chunks = n_chunks,
+    };
+    atomic_init(&job.next_chunk, 0);
+
+    ThreadPool *pool = thread_pool_global();
+    TaskGroup group = {0};
+    int n_helpers = (int) MIN((int64_t) pool->n_threads, n_chunks - 1);
+    for (int i = 0; i < n_helpers; i++) {
+        thread_pool_submit(pool, parallel_job_task, &job, &group);
+    }
+    parallel_job_run(&job);
+    thread_pool_wait(pool, &group);
+#endif
+}
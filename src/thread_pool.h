@@ -0,0 +1,103 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#define THREAD_POOL_MAX_THREADS 256
+
+/*
+ * Task function of `thread_pool_submit`.
+ */
+typedef void (*TaskFn)(void *arg);
+
+/*
+ * Body of a `parallel_for` loop. Called with a chunk [begin, end) of the
+ * iteration range and the index (0 <= thread < parallel_n_threads()) of
+ * the thread running it. No two chunks run with the same thread index at
+ * the same time, so `thread` can index per-thread accumulators.
+ */
+typedef void (*ParallelForFn)(void *ctx, int64_t begin, int64_t end, int thread);
+
+/*
+ * Counts unfinished tasks so that a group of tasks can be waited on.
+ */
+typedef struct TaskGroup {
+    int pending;
+} TaskGroup;
+
+typedef struct Task {
+    TaskFn fn;
+    void *arg;
+    TaskGroup *group;
+} Task;
+
+/*
+ * Persistent pool of worker threads with a FIFO task queue.
+ */
+typedef struct ThreadPool {
+    pthread_t *threads;
+    int n_threads;
+    Task *queue;            /* ring buffer */
+    int queue_capacity;
+    int queue_head;
+    int queue_count;
+    bool quit;
+    pthread_mutex_t mutex;
+    pthread_cond_t work_cvar;
+    pthread_cond_t done_cvar;
+} ThreadPool;
+
+/*
+ * Starts a pool with `n_threads` workers. Returns 0 on success.
+ */
+int thread_pool_init(ThreadPool *pool, int n_threads);
+
+/*
+ * Finishes queued tasks and stops the workers of `pool`.
+ */
+void thread_pool_destroy(ThreadPool *pool);
+
+/*
+ * Queues task `fn(arg)` on `pool`. `group` may be NULL. Tasks are never
+ * dropped: if the queue is full it grows, and if that fails the task runs
+ * on the calling thread.
+ */
+void thread_pool_submit(ThreadPool *pool, TaskFn fn, void *arg, TaskGroup *group);
+
+/*
+ * Waits until every task of `group` has finished.
+ */
+void thread_pool_wait(ThreadPool *pool, TaskGroup *group);
+
+/*
+ * Returns the process-wide pool, starting it on first use. It has one
+ * worker less than `parallel_n_threads()` since the thread calling
+ * `parallel_for` works too. The size can be set with the
+ * `ERODR_NUM_THREADS` environment variable.
+ */
+ThreadPool *thread_pool_global(void);
+
+/*
+ * Returns the number of threads `parallel_for` runs on.
+ */
+int parallel_n_threads(void);
+
+/*
+ * Pins the thread calling `parallel_for` to the first CPU and every
+ * worker thread `i` to the `i`th CPU of the process' affinity mask. Must
+ * be called before the first `parallel_for` when not using OpenMP.
+ */
+void parallel_pin_threads(void);
+
+/*
+ * Runs `fn` over [begin, end) in parallel, in chunks of `grain`
+ * iterations. A `grain` of 0 splits the range into one chunk per thread.
+ * Chunks are handed out dynamically. Uses OpenMP when compiled with
+ * `-fopenmp`, the global thread pool otherwise. Nested calls run
+ * serially.
+ */
+void parallel_for(int64_t begin, int64_t end, int64_t grain, ParallelForFn fn, void *ctx);
+
+#endif /* THREAD_POOL_H */
@@ -0,0 +1,16 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <time.h>
+
+/*
+ * Returns a timestamp in seconds. Only useful for measuring intervals.
+ */
+static inline double timer_now(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+#endif /* TIMER_H */
@@ -0,0 +1,236 @@
+#undef _GNU_SOURCE // gets rid of vim warning
+#define _GNU_SOURCE
+
+#include "trace.h"
+#include "timer.h"
+#include "log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#ifndef _WIN32
+#include <signal.h>
+#endif
+
+/* events kept per thread, older events are overwritten */
+#define TRACE_BUFFER_CAPACITY (1 << 16)
+
+/* `n` of events without argument */
+#define TRACE_NO_ARG INT64_MIN
+
+typedef struct TraceEvent {
+    const char *name;
+    const char *category;
+    double ts;              /* seconds since trace start */
+    double dur;             /* seconds */
+    int64_t n;
+} TraceEvent;
+
+typedef struct TraceBuffer {
+    pthread_mutex_t mutex;  /* uncontended except while dumping */
+    TraceEvent *events;
+    uint64_t n_written;
+    int tid;
+    char thread_name[32];
+    struct TraceBuffer *next;
+} TraceBuffer;
+
+static atomic_bool trace_enabled = false;
+static const char *trace_filepath = NULL;
+static double trace_t0 = 0.0;
+
+static pthread_mutex_t buffers_mutex = PTHREAD_MUTEX_INITIALIZER;
+static TraceBuffer *buffers = NULL;
+static int n_buffers = 0;
+static _Thread_local TraceBuffer *local_buffer = NULL;
+
+/*
+ * Returns the buffer of the calling thread, creating it on first use.
+ * Returns NULL if out of memory.
+ */
+static TraceBuffer *thread_buffer(void)
+{
+    if (local_buffer != NULL) {
+        return local_buffer;
+    }
+    TraceBuffer *b = calloc(1, sizeof(TraceBuffer));
+    TraceEvent *events = malloc(TRACE_BUFFER_CAPACITY * sizeof(TraceEvent));
+    if (b == NULL || events == NULL) {
+        free(b);
+        free(events);
+        return NULL;
+    }
+    pthread_mutex_init(&b->mutex, NULL);
+    b->events = events;
+
+    pthread_mutex_lock(&buffers_mutex);
+    b->tid = ++n_buffers;
+    snprintf(b->thread_name, sizeof(b->thread_name), "thread %d", b->tid);
+    b->next = buffers;
+    buffers = b;
+    pthread_mutex_unlock(&buffers_mutex);
+
+    local_buffer = b;
+    return b;
+}
+
+#ifndef _WIN32
+/*
+ * Waits for the signals blocked by `trace_start` and dumps the trace.
+ */
+static void *trace_signal_run(void *arg)
+{
+    sigset_t *set = (sigset_t *) arg;
+    while (true) {
+        int sig;
+        if (sigwait(set, &sig) != 0) {
+            continue;
+        }
+        trace_dump();
+        if (sig == SIGUSR1) {
+            continue;
+        }
+
+        /* terminate like the signal would have */
+        atomic_store(&trace_enabled, false);
+        signal(sig, SIG_DFL);
+        sigset_t unblock;
+        sigemptyset(&unblock);
+        sigaddset(&unblock, sig);
+        pthread_sigmask(SIG_UNBLOCK, &unblock, NULL);
+        raise(sig);
+        return NULL;
+    }
+}
+#endif
+
+/*
+ * atexit handler.
+ */
+static void trace_dump_at_exit(void)
+{
+    if (atomic_load(&trace_enabled)) {
+        trace_dump();
+    }
+}
+
+bool trace_start(const char *filepath)
+{
+    trace_filepath = filepath;
+    trace_t0 = timer_now();
+    atomic_store(&trace_enabled, true);
+    trace_set_thread_name("main");
+    if (atexit(trace_dump_at_exit) != 0) {
+        return false;
+    }
+
+#ifndef _WIN32
+    /* threads started later inherit the blocked signals */
+    static sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    sigaddset(&set, SIGUSR1);
+    pthread_t thread;
+    if (pthread_sigmask(SIG_BLOCK, &set, NULL) != 0 ||
+        pthread_create(&thread, NULL, trace_signal_run, &set) != 0) {
+        return false;
+    }
+    pthread_detach(thread);
+#endif
+    return true;
+}
+
+double trace_begin(void)
+{
+    return atomic_load_explicit(&trace_enabled, memory_order_relaxed) ? timer_now() : 0.0;
+}
+
+void trace_end_n(const char *name, const char *category, double t_begin, int64_t n)
+{
+    if (t_begin == 0.0 || !atomic_load_explicit(&trace_enabled, memory_order_relaxed)) {
+        return;
+    }
+    double t_end = timer_now();
+    TraceBuffer *b = thread_buffer();
+    if (b == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&b->mutex);
+    b->events[b->n_written % TRACE_BUFFER_CAPACITY] = (TraceEvent) {
+        .name     = name,
+        .category = category,
+        .ts       = t_begin - trace_t0,
+        .dur      = t_end - t_begin,
+        .n        = n,
+    };
+    b->n_written++;
+    pthread_mutex_unlock(&b->mutex);
+}
+
+void trace_end(const char *name, const char *category, double t_begin)
+{
+    trace_end_n(name, category, t_begin, TRACE_NO_ARG);
+}
+
+void trace_set_thread_name(const char *name)
+{
+    if (!atomic_load_explicit(&trace_enabled, memory_order_relaxed)) {
+        return;
+    }
+    TraceBuffer *b = thread_buffer();
+    if (b == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&b->mutex);
+    snprintf(b->thread_name, sizeof(b->thread_name), "%s", name);
+    pthread_mutex_unlock(&b->mutex);
+}
+
+int trace_dump(void)
+{
+    if (trace_filepath == NULL) {
+        return -1;
+    }
+    /* also keeps concurrent dumps from writing the file at the same time */
+    pthread_mutex_lock(&buffers_mutex);
+    FILE *fp = fopen(trace_filepath, "w");
+    if (fp == NULL) {
+        pthread_mutex_unlock(&buffers_mutex);
+        log_error("Error: could not open trace file `%s`.", trace_filepath);
+        return -1;
+    }
+
+    fprintf(fp, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    fprintf(fp, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"args\": {\"name\": \"erodr\"}}");
+    for (TraceBuffer *b = buffers; b != NULL; b = b->next) {
+        pthread_mutex_lock(&b->mutex);
+        fprintf(fp, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"%s\"}}",
+                b->tid, b->thread_name);
+        uint64_t first = (b->n_written > TRACE_BUFFER_CAPACITY) ? b->n_written - TRACE_BUFFER_CAPACITY : 0;
+        for (uint64_t i = first; i < b->n_written; i++) {
+            const TraceEvent *e = &b->events[i % TRACE_BUFFER_CAPACITY];
+            fprintf(fp, ",\n{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, "
+                    "\"ts\": %.3f, \"dur\": %.3f", e->name, e->category, b->tid, 1e6 * e->ts, 1e6 * e->dur);
+            if (e->n != TRACE_NO_ARG) {
+                fprintf(fp, ", \"args\": {\"n\": %ld}", (long) e->n);
+            }
+            fprintf(fp, "}");
+        }
+        pthread_mutex_unlock(&b->mutex);
+    }
+    fprintf(fp, "\n]}\n");
+
+    int err = ferror(fp);
+    fclose(fp);
+    pthread_mutex_unlock(&buffers_mutex);
+    if (err) {
+        log_error("Error: could not write trace file `%s`.", trace_filepath);
+        return -1;
+    }
+    log_info("Saved trace to: %s", trace_filepath);
+    return 0;
+}
@@ -0,0 +1,55 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/*
+ * Timeline tracing in the Chrome Trace Event format, viewable in Perfetto
+ * (https://ui.perfetto.dev) or chrome://tracing.
+ *
+ * Each thread records its events into its own ring buffer, so tracing
+ * doesn't serialize threads and the most recent events are kept if a
+ * buffer overflows. While tracing is disabled, every call costs a single
+ * atomic load. Events are meant for coarse-grained work (batches, I/O,
+ * frames), not single particle steps.
+ *
+ *     double t = trace_begin();
+ *     ...
+ *     trace_end("save pgm", "io", t);
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Enables tracing. The trace is written to `filepath` on exit, when the
+ * process receives SIGUSR1, and (before terminating) on SIGINT or SIGTERM.
+ * Signals are handled on a dedicated thread, so this must be called before
+ * any other thread is started. `filepath` must outlive the process.
+ * Returns false on failure.
+ */
+bool trace_start(const char *filepath);
+
+/*
+ * Returns the start timestamp of an event, or 0 if tracing is disabled.
+ */
+double trace_begin(void);
+
+/*
+ * Records event `name` of `category` lasting from `t_begin` until now.
+ * Both strings must be literals (or otherwise outlive the trace). `n` is
+ * shown as the event argument "n". Events begun while tracing was
+ * disabled are ignored.
+ */
+void trace_end(const char *name, const char *category, double t_begin);
+void trace_end_n(const char *name, const char *category, double t_begin, int64_t n);
+
+/*
+ * Names the calling thread in the trace.
+ */
+void trace_set_thread_name(const char *name);
+
+/*
+ * Writes all recorded events to the trace file. Returns 0 on success.
+ */
+int trace_dump(void);
+
+#endif /* TRACE_H */
@@ -1,6 +1,11 @@
 
 #include "ui.h"
 #include "shaders/shaders.h"
+#include "trace.h"
+#include "terrain.h"
+#include "derived.h"
+#include "hud.h"
+#include "timer.h"
 
 #include "raylib.h"
 #include "rlgl.h"
@@ -9,6 +14,7 @@
 #include "raymath.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 #include <stdio.h>
@@ -19,38 +25,21 @@
 #define FOV_Y             45.0f
 #define ZOOM_DEFAULT     100.0f
 #define PLANE_SIZE        64.0f
-#define MESH_RES         256
 #define SCREEN_WIDTH    1920
 #define SCREEN_HEIGHT   1080
 
-static float sample_hmap(ErodrImage *hmap, float xf, float yf)
-{
-#define MIN(a, b) ((a) < (b) ? (a) : (b))
+/* inertia below these is dropped, so that the camera comes to rest */
+#define PAN_EPSILON        0.01f
+#define ZOOM_EPSILON       0.001f
 
-#if 0
-    /* nearest */
-    int x = xf * hmap->width;
-    int y = yf * hmap->height;
-    return hmap->data[y * hmap->width + x];
-#else
-    /* bilinear */
-    float x = xf * hmap->width;
-    float y = yf * hmap->height;
-    float t_x = x - roundf(x - 0.5f);
-    float t_y = y - roundf(y - 0.5f);
-    int ileft   = (int) x;
-    int itop    = (int) y;
-    int iright  = MIN(ileft + 1, hmap->width - 1);
-    int ibottom = MIN(itop + 1, hmap->height - 1);
-    float top_left     = hmap->data[itop * hmap->width + ileft];
-    float top_right    = hmap->data[itop * hmap->width + iright];
-    float bottom_left  = hmap->data[ibottom * hmap->width + ileft];
-    float bottom_right = hmap->data[ibottom * hmap->width + iright];
-    float top = (1.0f - t_x) * top_left + t_x * top_right;
-    float bottom = (1.0f - t_x) * bottom_left + t_x * bottom_right;
-    return ((1.0f - t_y) * top + t_y * bottom);
-#endif
-}
+/* inertia is integrated with at most this frame time, since the first
+ * frame after an idle period includes the time spent waiting */
+#define MAX_FRAME_TIME   (1.0f / 30.0f)
+
+/* seconds between recomputes of the snow pooling gradient while it is adjusted */
+#define POOLING_UPDATE_INTERVAL 0.1
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
 
 static float clamp(float value, float min, float max)
 {
@@ -59,13 +48,139 @@ static float clamp(float value, float min, float max)
     return value;
 }
 
+/* raylib is built on GLFW but doesn't expose its empty events */
+void glfwPostEmptyEvent(void);
+
+/* set while the UI thread waits for events */
+static atomic_bool ui_waiting;
+
+/* number of `ui_wake` calls so far */
+static atomic_uint ui_wakes;
+
+/*
+ * Everything a frame depends on besides the textures. A frame is only
+ * drawn if this differs from the last drawn frame or a texture changed.
+ * Compared bytewise, so it must be zeroed before it is filled in.
+ */
+typedef struct ViewState {
+    Camera camera;
+    float terrain_height;
+    int shader_mode;
+    float snow_thresh;
+    float snow_pooling;
+    bool show_controls;
+    bool show_hud;
+    int screen_width;
+    int screen_height;
+    SimState sim_state;
+    SimulationParameters sim_params;
+} ViewState;
+
+void ui_wake(void)
+{
+    /* pairs with `wait_for_events`: either the UI sees the new count
+     * before it sleeps, or this sees it sleeping */
+    atomic_fetch_add(&ui_wakes, 1);
+    if (atomic_load(&ui_waiting)) {
+        glfwPostEmptyEvent();
+    }
+}
+
+/*
+ * Polls the input events, sleeping until one arrives unless `ui_wake` has
+ * been called since it returned `wakes_seen`. Takes the place of the
+ * event polling of `EndDrawing` in frames that aren't drawn.
+ */
+static void wait_for_events(unsigned wakes_seen)
+{
+    atomic_store(&ui_waiting, true);
+    if (atomic_load(&ui_wakes) == wakes_seen) {
+        EnableEventWaiting();
+        PollInputEvents();
+        DisableEventWaiting();
+    } else {
+        PollInputEvents();
+    }
+    atomic_store(&ui_waiting, false);
+}
+
+/*
+ * Uploads the tiles changed in `snapshot` to `texture`, or the whole
+ * heightmap if `all` is set. Horizontal runs of changed tiles are staged
+ * in `staging` (room for SNAPSHOT_TILE_SIZE rows) and uploaded together.
+ * Returns the number of bytes uploaded.
+ */
+static size_t upload_texture(Texture2D texture, const SnapshotBuffer *sb, const Snapshot *snapshot, float *staging, bool all)
+{
+    const ErodrImage *hmap = &snapshot->hmap;
+    if (all) {
+        UpdateTexture(texture, hmap->data);
+        return (size_t) hmap->width * hmap->height * sizeof(float);
+    }
+    size_t n_bytes = 0;
+    for (int ty = 0; ty < sb->tiles_y; ty++) {
+        int y = ty * SNAPSHOT_TILE_SIZE;
+        int h = MIN(SNAPSHOT_TILE_SIZE, hmap->height - y);
+        for (int tx = 0; tx < sb->tiles_x; tx++) {
+            if (!snapshot_tile_test(sb, snapshot->changed, tx, ty)) {
+                continue;
+            }
+            int tx_end = tx + 1;
+            while (tx_end < sb->tiles_x && snapshot_tile_test(sb, snapshot->changed, tx_end, ty)) {
+                tx_end++;
+            }
+            int x = tx * SNAPSHOT_TILE_SIZE;
+            int w = MIN(tx_end * SNAPSHOT_TILE_SIZE, hmap->width) - x;
+            for (int row = 0; row < h; row++) {
+                memcpy(&staging[row * w], &hmap->data[(y + row) * hmap->stride + x], w * sizeof(float));
+            }
+            UpdateTextureRec(texture, (Rectangle) {x, y, w, h}, staging);
+            n_bytes += (size_t) w * h * sizeof(float);
+            tx = tx_end;
+        }
+    }
+    return n_bytes;
+}
+
+/*
+ * Sends `cmd` to the main thread without blocking the render loop.
+ * Repeated commands waiting in the queue are coalesced, except for those
+ * that take a step each time (pause toggles, undo and redo).
+ */
+static void send_command(CommandQueue *q, UiCommand cmd)
+{
+    double t_trace = trace_begin();
+    if (cmd == CMD_EXIT) {
+        command_queue_send(q, cmd, true); /* must not be lost */
+    } else if (!command_queue_try_send(q, cmd, cmd != CMD_PAUSE_SIMULATION && cmd != CMD_UNDO && cmd != CMD_REDO)) {
+        printf("Command queue full, dropped command %d.\n", cmd);
+    }
+    trace_end_n("queue send", "queue", t_trace, cmd);
+}
+
+/*
+ * Sends `cmd`, which stops a running simulation, to the main thread. The
+ * cancel flag stops the simulation right away, even in stages that don't
+ * check for commands.
+ */
+static void send_stop_command(UiArgs *ui_args, UiCommand cmd)
+{
+    if (atomic_load(ui_args->sim_state) != SIM_IDLE) {
+        atomic_store(ui_args->cancel, true);
+    }
+    send_command(ui_args->commands, cmd);
+}
+
 void *ui_run(void *args)
 {
     /* args */
     UiArgs *ui_args = (UiArgs *) args;
     SimulationParameters *sim_params = ui_args->sim_params;
-    ErodrImage *hmap = ui_args->hmap;
-    HglChan *c = ui_args->chan;
+    SnapshotBuffer *snapshots = ui_args->snapshots;
+    const Snapshot *snapshot = snapshot_acquire(snapshots);
+    const ErodrImage *hmap = &snapshot->hmap;
+    CommandQueue *c = ui_args->commands;
+    trace_set_thread_name("ui");
 
     /* Window */
     int screen_width  = SCREEN_WIDTH;
@@ -82,12 +197,8 @@ void *ui_run(void *args)
         .projection = CAMERA_PERSPECTIVE,
     };
 
-    /* Heightmap mesh */
-    Mesh hmap_mesh = GenMeshPlane(PLANE_SIZE, PLANE_SIZE, MESH_RES - 1, MESH_RES - 1);
-    assert(hmap_mesh.vertexCount <= 0x10000); // Raylib only supports short int indicies.. :/
-
-    /* Heightmap tform */
-    Matrix    hmap_tform    = MatrixTranslate(0.0f, 0.10f, 0.0f);
+    /* Heightmap origin */
+    Vector3 hmap_origin = {0.0f, 0.10f, 0.0f};
 
     /* Heightmap material */
     Material  hmap_material = LoadMaterialDefault();
@@ -104,32 +215,60 @@ void *ui_run(void *args)
     SetMaterialTexture(&hmap_material, MATERIAL_MAP_ALBEDO, hmap_texture);
 
     /* Heightmap material shader */
-    hmap_material.shader = LoadShaderFromMemory(NULL, SHADERS_HMAP_FRAG_SRC);
+    hmap_material.shader = LoadShaderFromMemory(SHADERS_HMAP_VERT_SRC, SHADERS_HMAP_FRAG_SRC);
     int shader_mode_loc         = GetShaderLocation(hmap_material.shader, "mode");
-    int shader_res_loc          = GetShaderLocation(hmap_material.shader, "res");
     int shader_snow_thresh_loc  = GetShaderLocation(hmap_material.shader, "snow_threshold");
     int shader_snow_pooling_loc = GetShaderLocation(hmap_material.shader, "snow_pooling");
+    int shader_height_loc       = GetShaderLocation(hmap_material.shader, "terrain_height");
     int shader_mode           = 0;
-    float shader_res          = (float) hmap->width;
     float shader_snow_thresh  = 0.006f;
     float shader_snow_pooling = 6.000f;
     SetShaderValue(hmap_material.shader, shader_mode_loc, &shader_mode, SHADER_UNIFORM_INT);
-    SetShaderValue(hmap_material.shader, shader_res_loc, &shader_res, SHADER_UNIFORM_FLOAT);
     SetShaderValue(hmap_material.shader, shader_snow_thresh_loc, &shader_snow_thresh, SHADER_UNIFORM_FLOAT);
     SetShaderValue(hmap_material.shader, shader_snow_pooling_loc, &shader_snow_pooling, SHADER_UNIFORM_FLOAT);
 
+    /* Derived visualization texture (height and gradients), bound to texture1 */
+    DerivedTexture derived;
+    if (derived_init(&derived, snapshots, snapshot, shader_snow_pooling) != 0) {
+        fprintf(stderr, "Failed to allocate the derived texture.\n");
+        exit(1);
+    }
+    SetMaterialTexture(&hmap_material, MATERIAL_MAP_METALNESS, derived.texture);
+
+    /* Heightmap terrain patches */
+    TerrainRenderer terrain;
+    terrain_init(&terrain, &hmap_material, PLANE_SIZE, hmap->width, hmap->height);
+
     /* Camera controls */
     Vector2 mouse = Vector2Zero();
     float zoom = 0.0f;
     
     /* misc */
     float terrain_height = 16.0f;
+    SetShaderValue(hmap_material.shader, shader_height_loc, &terrain_height, SHADER_UNIFORM_FLOAT);
+    uint64_t texture_version = snapshot->version;  /* snapshot the texture was uploaded from */
+    double t_pooling = 0.0;                        /* last recompute of the snow pooling gradient */
+    float *texture_staging = malloc(SNAPSHOT_TILE_SIZE * hmap->width * sizeof(float));
     bool running = true;
     bool show_controls = true;
 
+    /* Performance overlay */
+    PerfHud hud;
+    hud_init(&hud, ui_args->counters);
+    bool show_hud = false;
+    float frame_times[HUD_N_PHASES];
+
+    /* render on change */
+    ViewState drawn;
+    memset(&drawn, 0, sizeof(drawn));
+
     while (running) {
+        double t_frame = trace_begin();
+        double t_update = timer_now();
+        unsigned wakes_seen = atomic_load(&ui_wakes);
+
         /* ====== update ================================ */
-        float dt = GetFrameTime();
+        float dt = fminf(GetFrameTime(), MAX_FRAME_TIME);
 
         /* handle resizing */
         if (IsWindowResized() && !IsWindowFullscreen()) {
@@ -139,23 +278,36 @@ void *ui_run(void *args)
 
         /* reset heightmap */
         if (IsKeyPressed(KEY_R)) {
-            hgl_chan_send(c, (void *)CMD_RESET_HMAP);
+            send_stop_command(ui_args, CMD_RESET_HMAP);
+        }
+
+        /* undo/redo */
+        if (IsKeyPressed(KEY_Z)) {
+            send_stop_command(ui_args, CMD_UNDO);
+        }
+        if (IsKeyPressed(KEY_Y)) {
+            send_stop_command(ui_args, CMD_REDO);
         }
 
         /* reload simulation parameters */
         if (IsKeyPressed(KEY_E)) {
-            hgl_chan_send(c, (void *)CMD_RELOAD_SIMPARAMS);
+            send_command(c, CMD_RELOAD_SIMPARAMS);
         }
 
         /* save image */
         if (IsKeyPressed(KEY_S)) {
-            hgl_chan_send(c, (void *)CMD_SAVE_HMAP);
+            send_command(c, CMD_SAVE_HMAP);
         }
 
         /* hide controls */
         if (IsKeyPressed(KEY_H)) {
             show_controls = !show_controls;
         }
+
+        /* performance overlay */
+        if (IsKeyPressed(KEY_F3)) {
+            show_hud = !show_hud;
+        }
         
         /* view mode */
         if (IsKeyPressed(KEY_V)) {
@@ -170,9 +322,15 @@ void *ui_run(void *args)
             break;
         }
 
-        /* re-run simulation */
-        if (IsKeyPressed(KEY_ENTER) || IsKeyPressed(KEY_SPACE)) {
-            hgl_chan_send(c, (void *)CMD_RERUN_SIMULATION);
+        /* re-run, pause/resume or cancel simulation */
+        SimState sim_state = atomic_load(ui_args->sim_state);
+        if (IsKeyPressed(KEY_ENTER) || (IsKeyPressed(KEY_SPACE) && sim_state == SIM_IDLE)) {
+            send_command(c, CMD_RERUN_SIMULATION);
+        } else if (IsKeyPressed(KEY_SPACE)) {
+            send_command(c, CMD_PAUSE_SIMULATION);
+        }
+        if (IsKeyPressed(KEY_C)) {
+            send_stop_command(ui_args, CMD_CANCEL_SIMULATION);
         }
 
         /* toggle fullscreen */
@@ -198,12 +356,13 @@ void *ui_run(void *args)
         }
 
         /* adjust camera target/position based on terrain_height setting */
-        camera.target.y = hmap_tform.m13 + terrain_height/2.0f;
+        camera.target.y = hmap_origin.y + terrain_height/2.0f;
 
         /* terrain_height adjustment */
         Vector2 mouse_delta = GetMouseDelta();
         if (IsMouseButtonDown(1)) {
             terrain_height -= 0.1f*mouse_delta.y;
+            SetShaderValue(hmap_material.shader, shader_height_loc, &terrain_height, SHADER_UNIFORM_FLOAT);
         }
 
         /* "snow" threshold adjustment */
@@ -211,7 +370,6 @@ void *ui_run(void *args)
             if (IsKeyDown(KEY_LEFT_SHIFT)) {
                 shader_snow_pooling -= 0.01f*mouse_delta.y;
                 shader_snow_pooling = clamp(shader_snow_pooling, 1.0, 25.0);
-                SetShaderValue(hmap_material.shader, shader_snow_pooling_loc, &shader_snow_pooling, SHADER_UNIFORM_FLOAT);
             } else {
                 shader_snow_thresh -= 0.00005f*mouse_delta.y;
                 shader_snow_thresh = clamp(shader_snow_thresh, 0.0, 10.0);
@@ -219,76 +377,133 @@ void *ui_run(void *args)
             }
         }
 
-        /* camera movement */
+        /* camera movement. The camera is only touched while it moves, so
+         * that it comes to rest exactly and idle frames can be skipped. */
         if (IsMouseButtonDown(0)) {
             mouse = mouse_delta;
             zoom = 0.0f;
         }
-        Vector3 vcam = Vector3Subtract(camera.position, camera.target);
-        vcam = Vector3RotateByAxisAngle(vcam, camera.up, -mouse.x / 360.0f);
-        vcam = Vector3RotateByAxisAngle(vcam, Vector3CrossProduct(vcam, camera.up), mouse.y / 360.0f);
-        if (fabsf(Vector3DotProduct(Vector3Normalize(vcam), camera.up)) < 0.999f) {
-            camera.position = Vector3Add(camera.target, vcam);
+        if (mouse.x != 0.0f || mouse.y != 0.0f) {
+            Vector3 vcam = Vector3Subtract(camera.position, camera.target);
+            vcam = Vector3RotateByAxisAngle(vcam, camera.up, -mouse.x / 360.0f);
+            vcam = Vector3RotateByAxisAngle(vcam, Vector3CrossProduct(vcam, camera.up), mouse.y / 360.0f);
+            if (fabsf(Vector3DotProduct(Vector3Normalize(vcam), camera.up)) < 0.999f) {
+                camera.position = Vector3Add(camera.target, vcam);
+            }
+            mouse = Vector2Scale(mouse, (1.0f - dt)*PAN_INERTIA); // close enough...
+            if (fabsf(mouse.x) < PAN_EPSILON && fabsf(mouse.y) < PAN_EPSILON && !IsMouseButtonDown(0)) {
+                mouse = Vector2Zero();
+            }
         }
-        mouse = Vector2Scale(mouse, (1.0f - dt)*PAN_INERTIA); // close enough...
 
         /* camera zoom */
         float zoom_delta = GetMouseWheelMove();
         if ((fabsf(zoom_delta) > 0.001f) && camera.projection == CAMERA_PERSPECTIVE) {
             zoom = zoom_delta;
         }
-        Vector3 view_dir = Vector3Normalize(Vector3Subtract(camera.target, camera.position));
-        camera.position = Vector3Add(camera.position, Vector3Scale(view_dir, 3*zoom));
-        if (Vector3Length(Vector3Subtract(camera.target, camera.position)) < 10.0) {
-            camera.position = Vector3Add(camera.target, Vector3Scale(view_dir, -10.0));
-            zoom = 0;
-        }
-        zoom *= (1.0f - dt) * ZOOM_INERTIA; // close enough...
-
-        /* update mesh & texture */
-        for (int y = 0; y < MESH_RES; y++) {
-            for (int x = 0; x < MESH_RES; x++) {
-                float xf = (float)x / (float)MESH_RES;
-                float yf = (float)y / (float)MESH_RES;
-                hmap_mesh.vertices[y*MESH_RES*3 + x*3 + 1] = terrain_height * sample_hmap(hmap, xf, yf);
+        if (zoom != 0.0f) {
+            Vector3 view_dir = Vector3Normalize(Vector3Subtract(camera.target, camera.position));
+            camera.position = Vector3Add(camera.position, Vector3Scale(view_dir, 3*zoom));
+            if (Vector3Length(Vector3Subtract(camera.target, camera.position)) < 10.0) {
+                camera.position = Vector3Add(camera.target, Vector3Scale(view_dir, -10.0));
+                zoom = 0;
             }
+            zoom *= (1.0f - dt) * ZOOM_INERTIA; // close enough...
+            if (fabsf(zoom) < ZOOM_EPSILON) {
+                zoom = 0.0f;
+            }
+        }
+
+        /* update texture from the newest snapshot, only where it changed. The
+         * vertex shader displaces the mesh by the texture. */
+        double t_upload = timer_now();
+        frame_times[HUD_UPDATE] = (float)(t_upload - t_update);
+        size_t upload_bytes = 0;
+        bool uploaded = false;
+        snapshot = snapshot_acquire(snapshots);
+        hmap = &snapshot->hmap;
+        if (snapshot->version != texture_version) {
+            double t_trace = trace_begin();
+            upload_bytes += upload_texture(hmap_texture, snapshots, snapshot, texture_staging, texture_version == 0 || texture_staging == NULL);
+            upload_bytes += derived_update(&derived, snapshots, snapshot, derived.snow_pooling, texture_version == 0);
+            texture_version = snapshot->version;
+            uploaded = true;
+            trace_end("upload texture", "ui", t_trace);
+        }
+
+        /* recompute the snow pooling gradient, throttled while it is being
+         * adjusted. The shader always gets the pooling the gradient was
+         * computed with, so the preview stays consistent during the drag. */
+        bool pooling_pending = shader_snow_pooling != derived.snow_pooling;
+        if (pooling_pending && (!IsMouseButtonDown(2) || timer_now() - t_pooling >= POOLING_UPDATE_INTERVAL)) {
+            upload_bytes += derived_update(&derived, snapshots, snapshot, shader_snow_pooling, true);
+            SetShaderValue(hmap_material.shader, shader_snow_pooling_loc, &derived.snow_pooling, SHADER_UNIFORM_FLOAT);
+            t_pooling = timer_now();
+            pooling_pending = false;
+            uploaded = true;
         }
-        UpdateMeshBuffer(hmap_mesh, 0, hmap_mesh.vertices, MESH_RES*MESH_RES*3*sizeof(float), 0);
-        UpdateTexture(hmap_texture, hmap->data);
+
+        /* skip the frame if it would look like the last one */
+        ViewState view;
+        memset(&view, 0, sizeof(view));
+        view.camera         = camera;
+        view.terrain_height = terrain_height;
+        view.shader_mode    = shader_mode;
+        view.snow_thresh    = shader_snow_thresh;
+        view.snow_pooling   = shader_snow_pooling;
+        view.show_controls  = show_controls;
+        view.show_hud       = show_hud;
+        view.screen_width   = GetScreenWidth();
+        view.screen_height  = GetScreenHeight();
+        view.sim_state      = sim_state;
+        view.sim_params     = *sim_params;
+        bool live_hud = show_hud && sim_state != SIM_IDLE; /* graphs move while the simulation runs */
+        if (!uploaded && !live_hud && !pooling_pending && !IsWindowResized() && memcmp(&view, &drawn, sizeof(view)) == 0) {
+            wait_for_events(wakes_seen);
+            trace_end("idle", "ui", t_frame);
+            continue;
+        }
+        drawn = view;
 
         /* ====== draw ================================== */
+        double t_draw = timer_now();
+        frame_times[HUD_UPLOAD] = (float)(t_draw - t_upload);
+        hud_sample(&hud);
         BeginDrawing();
             ClearBackground(RAYWHITE);
 
             /* Draw heightmap */
             BeginMode3D(camera);
-                DrawMesh(hmap_mesh, hmap_material, hmap_tform);
+                terrain_draw(&terrain, camera, hmap_origin, terrain_height);
             EndMode3D();
         
             if (show_controls) {
                 /* Section "Commands" */
                 DrawText("Simulation Controls: ", 10, 10, 38, BLACK);
-                DrawText(TextFormat("R - reset heightmap"), 10, 50, 24, BLACK);
+                DrawText(TextFormat("R - reset heightmap, Z/Y - undo/redo"), 10, 50, 24, BLACK);
                 DrawText(TextFormat("E - reload simulation parameters from file"), 10, 80, 24, BLACK);
-                DrawText(TextFormat("Enter/Space - run erosion simulation"), 10, 110, 24, BLACK);
-                DrawText(TextFormat("S - Save image"), 10, 140, 24, BLACK);
-                DrawText(TextFormat("H - Show/Hide controls"), 10, 170, 24, BLACK);
-                DrawText(TextFormat("Esc/Q - exit"), 10, 200, 24, BLACK);
+                const char *state_names[] = {"idle", "running", "paused"};
+                DrawText(TextFormat("Enter/Space - run erosion simulation (%s)", state_names[sim_state]), 10, 110, 24, BLACK);
+                DrawText(TextFormat("Space/C - pause/resume or cancel a running simulation"), 10, 140, 24, BLACK);
+                DrawText(TextFormat("S - Save image"), 10, 170, 24, BLACK);
+                DrawText(TextFormat("H - Show/Hide controls"), 10, 200, 24, BLACK);
+                DrawText(TextFormat("Esc/Q - exit"), 10, 230, 24, BLACK);
 
                 //int xpos = screen_width - 770;
-                DrawText("Visualization Controls:", 10, 250, 38, BLACK);
-                DrawText(TextFormat("V - Cycle between visualizer modes (%d)", shader_mode + 1), 10, 290, 24, BLACK);
+                DrawText("Visualization Controls:", 10, 280, 38, BLACK);
+                DrawText(TextFormat("V - Cycle between visualizer modes (%d)", shader_mode + 1), 10, 320, 24, BLACK);
                 DrawText(TextFormat("P - projection mode (%s)", (camera.projection == CAMERA_PERSPECTIVE) ? 
-                                    "perspective" : "orthographic"), 10, 320, 24, BLACK);
-                DrawText(TextFormat("Left mouse button/scroll - move camera"), 10, 350, 24, BLACK);
-                DrawText(TextFormat("Middle mouse button - change snow cover (%2.5f)", shader_snow_thresh), 10, 380, 24, BLACK);
-                DrawText(TextFormat("Lshift + Middle mouse button - change snow pooling (%2.2f)", shader_snow_pooling), 10, 410, 24, BLACK);
-                DrawText(TextFormat("Right mouse button - change terrain height (%2.2f)", terrain_height), 10, 440, 24, BLACK);
+                                    "perspective" : "orthographic"), 10, 350, 24, BLACK);
+                DrawText(TextFormat("Left mouse button/scroll - move camera"), 10, 380, 24, BLACK);
+                DrawText(TextFormat("Middle mouse button - change snow cover (%2.5f)", shader_snow_thresh), 10, 410, 24, BLACK);
+                DrawText(TextFormat("Lshift + Middle mouse button - change snow pooling (%2.2f)", shader_snow_pooling), 10, 440, 24, BLACK);
+                DrawText(TextFormat("Right mouse button - change terrain height (%2.2f)", terrain_height), 10, 470, 24, BLACK);
+                DrawText(TextFormat("F3 - Show/Hide performance graphs"), 10, 500, 24, BLACK);
 
                 /* Section "Image Resolution" */
-                int ypos = screen_height - 550;
+                int ypos = screen_height - 640;
                 DrawText("Image Resolution:", 10, ypos, 38, BLACK);
-                DrawText(TextFormat("%dx%d (previewed as 256x256)", hmap->width, hmap->height), 10, ypos + 40, 24, BLACK);
+                DrawText(TextFormat("%dx%d (%d terrain patches drawn)", hmap->width, hmap->height, terrain.n_drawn), 10, ypos + 40, 24, BLACK);
 
                 /* Section "Simulation Parameters" */
                 DrawText("Simulation Parameters: ", 10, ypos + 100, 38, BLACK);
@@ -318,16 +533,34 @@ void *ui_run(void *args)
                 DrawText(TextFormat("= %f", sim_params->p_initial_velocity), 300, ypos + 470, 24, BLACK);
                 DrawText("p_initial_water  ", 10, ypos + 500, 24, BLACK); 
                 DrawText(TextFormat("= %f", sim_params->p_initial_water), 300, ypos + 500, 24, BLACK);
+                DrawText("thermal_iterations  ", 10, ypos + 530, 24, BLACK); 
+                DrawText(TextFormat("= %d", sim_params->thermal_iterations), 300, ypos + 530, 24, BLACK);
+                DrawText("thermal_talus  ", 10, ypos + 560, 24, BLACK); 
+                DrawText(TextFormat("= %f", sim_params->thermal_talus), 300, ypos + 560, 24, BLACK);
+                DrawText("thermal_rate  ", 10, ypos + 590, 24, BLACK); 
+                DrawText(TextFormat("= %f", sim_params->thermal_rate), 300, ypos + 590, 24, BLACK);
+            }
+
+            if (show_hud) {
+                hud_draw(&hud, screen_width - 20, 20);
             }
 
+        double t_present = timer_now();
+        frame_times[HUD_DRAW] = (float)(t_present - t_draw);
         EndDrawing();
+        frame_times[HUD_PRESENT] = (float)(timer_now() - t_present);
+        hud_add_frame(&hud, frame_times, upload_bytes);
+        trace_end("frame", "ui", t_frame);
     }
 
-    UnloadMesh(hmap_mesh);
+    terrain_free(&terrain);
+    derived_free(&derived);
+    hmap_material.maps[MATERIAL_MAP_METALNESS].texture = (Texture2D) {0};
     UnloadMaterial(hmap_material);
     UnloadTexture(hmap_texture);
+    free(texture_staging);
 
-    hgl_chan_send(c, (void *)CMD_EXIT);
+    send_stop_command(ui_args, CMD_EXIT);
 
     return NULL;
 }
@@ -2,26 +2,52 @@
 #define UI_H
 
 #include "image.h"
+#include "snapshot.h"
 #include "params.h"
-#include "hgl_chan.h"
+#include "command_queue.h"
+#include "sim_counters.h"
+
+#include <stdatomic.h>
 
 typedef enum
 {
+    CMD_NONE = COMMAND_NONE,    /* no command (an empty queue) */
     CMD_RERUN_SIMULATION,
+    CMD_PAUSE_SIMULATION,       /* pauses or resumes a running simulation */
+    CMD_CANCEL_SIMULATION,
     CMD_RELOAD_SIMPARAMS,
     CMD_RESET_HMAP,
+    CMD_UNDO,                   /* steps back to the state before the last run, reset or save */
+    CMD_REDO,
     CMD_SAVE_HMAP,
     CMD_EXIT,
 } UiCommand;
 
+typedef enum
+{
+    SIM_IDLE,
+    SIM_RUNNING,
+    SIM_PAUSED,
+} SimState;
+
 typedef struct
 {
-    ErodrImage *hmap; 
-    HglChan *chan;
+    SnapshotBuffer *snapshots;  /* read only by the UI thread */
+    CommandQueue *commands;     /* to the main thread */
     SimulationParameters *sim_params;
+    atomic_bool *cancel;        /* set together with commands that stop a running simulation */
+    const atomic_int *sim_state;
+    const SimCounters *counters;    /* throughput of the simulation, shown in the performance overlay */
 } UiArgs;
 
 void *ui_run(void *args);
 
+/*
+ * Wakes the UI thread if it is idle, so that it redraws whatever changed
+ * (a new snapshot, the simulation state or parameters). Safe to call from
+ * any thread, cheap while the UI isn't idle.
+ */
+void ui_wake(void);
+
 #endif /* UI_H */
 
@@ -0,0 +1,34 @@
+#include "workspace.h"
+
+#include <assert.h>
+
+ErodrImage *workspace_image(Workspace *ws, int slot, int width, int height)
+{
+    assert(slot >= 0 && slot < WORKSPACE_MAX_IMAGES);
+    ErodrImage *allocation = &ws->allocations[slot];
+    if ((size_t) width * height > (size_t) allocation->width * allocation->height) {
+        image_free(allocation);
+        *allocation = image_alloc(width, height);
+        if (allocation->data == NULL) {
+            *allocation = (ErodrImage) {0};
+            return NULL;
+        }
+    }
+    ErodrImage *img = &ws->images[slot];
+    *img = (ErodrImage) {
+        .data   = allocation->data,
+        .width  = width,
+        .height = height,
+        .stride = width,
+    };
+    return img;
+}
+
+void workspace_free(Workspace *ws)
+{
+    for (int i = 0; i < WORKSPACE_MAX_IMAGES; i++) {
+        image_free(&ws->allocations[i]);
+    }
+    spawn_map_free(&ws->spawn);
+    *ws = (Workspace) {0};
+}
@@ -0,0 +1,45 @@
+#ifndef WORKSPACE_H
+#define WORKSPACE_H
+
+#include "image.h"
+#include "spawn.h"
+
+#include <stddef.h>
+
+#define WORKSPACE_MAX_IMAGES 48
+
+/*
+ * Scratch image slots. Pyramid levels use two slots each, starting at
+ * WORKSPACE_SLOT_PYRAMID.
+ */
+typedef enum WorkspaceSlot {
+    WORKSPACE_SLOT_THERMAL = 0,  /* thermal erosion double buffer */
+    WORKSPACE_SLOT_EPOCH,        /* previous epoch of the adaptive mode */
+    WORKSPACE_SLOT_INPUT,        /* contiguous copy of a strided input */
+    WORKSPACE_SLOT_THERMAL_ROI,  /* region of interest of thermal erosion */
+    WORKSPACE_SLOT_PYRAMID,
+} WorkspaceSlot;
+
+/*
+ * Scratch buffers that are kept between simulation runs so that repeated
+ * runs (UI reruns, library calls) don't allocate. Buffers only ever grow.
+ */
+typedef struct Workspace {
+    ErodrImage allocations[WORKSPACE_MAX_IMAGES]; /* as allocated */
+    ErodrImage images[WORKSPACE_MAX_IMAGES];      /* as last handed out */
+    SpawnMap spawn;
+} Workspace;
+
+/*
+ * Returns a contiguous `width` x `height` scratch image in slot `slot` of
+ * `ws`, growing the slot if necessary. The contents are undefined. Returns
+ * NULL if the allocation fails.
+ */
+ErodrImage *workspace_image(Workspace *ws, int slot, int width, int height);
+
+/*
+ * Frees all buffers held by `ws`.
+ */
+void workspace_free(Workspace *ws);
+
+#endif /* WORKSPACE_H */
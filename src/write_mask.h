@@ -0,0 +1,62 @@
+#ifndef WRITE_MASK_H
+#define WRITE_MASK_H
+
+#include "params.h"
+
+#include <math.h>
+#include <stdbool.h>
+
+/*
+ * Write mask. Changes to the heightmap are weighted by 1 inside the
+ * rectangle [x0, x1) x [y0, y1), falling off linearly to 0 over
+ * 1 / `inv_feather` pixels outside of it.
+ */
+typedef struct WriteMask {
+    int x0;
+    int y0;
+    int x1;
+    int y1;
+    float inv_feather;
+} WriteMask;
+
+/*
+ * Sets `mask` to the region of interest of `params`, clamped to a `width` x
+ * `height` heightmap so that it is at least 2x2 pixels. Without a region of
+ * interest the mask covers the whole map and false is returned.
+ */
+static inline bool write_mask_init(WriteMask *mask, const SimulationParameters *params, int width, int height)
+{
+    bool roi = params->roi_width > 0 && params->roi_height > 0;
+    *mask = (WriteMask) {
+        .x0 = 0,
+        .y0 = 0,
+        .x1 = width,
+        .y1 = height,
+        .inv_feather = 1.0f / fmaxf(params->roi_feather, 1e-6f),
+    };
+    if (roi) {
+        mask->x0 = params->roi_x < 0 ? 0 : params->roi_x;
+        mask->x0 = mask->x0 > width - 2 ? width - 2 : mask->x0;
+        mask->y0 = params->roi_y < 0 ? 0 : params->roi_y;
+        mask->y0 = mask->y0 > height - 2 ? height - 2 : mask->y0;
+        int x1 = params->roi_x + params->roi_width;
+        int y1 = params->roi_y + params->roi_height;
+        x1 = x1 < mask->x0 + 2 ? mask->x0 + 2 : x1;
+        y1 = y1 < mask->y0 + 2 ? mask->y0 + 2 : y1;
+        mask->x1 = x1 > width ? width : x1;
+        mask->y1 = y1 > height ? height : y1;
+    }
+    return roi;
+}
+
+/*
+ * Returns the weight of write mask `mask` at (x, y).
+ */
+static inline float write_mask_weight(const WriteMask *mask, int x, int y)
+{
+    int dx = x < mask->x0 ? mask->x0 - x : (x >= mask->x1 ? x - (mask->x1 - 1) : 0);
+    int dy = y < mask->y0 ? mask->y0 - y : (y >= mask->y1 ? y - (mask->y1 - 1) : 0);
+    return fmaxf(0.0f, 1.0f - (float)(dx > dy ? dx : dy) * mask->inv_feather);
+}
+
+#endif /* WRITE_MASK_H */